@@ -1,13 +1,10 @@
 #include "Synth.h"
 
-Synth::Synth() {
+Synth::Synth(std::size_t max_voices) : SynthEngine(max_voices) {
      sprintf(message, "Synth End ");
-     a_amp = 0.2f;
-     b_amp = 0.2f;
-     c_amp = 0.2f;
 }
 
-bool Synth::open(PaDeviceIndex index) {
+bool Synth::open(PaDeviceIndex index, double sample_rate, unsigned long frames_per_buffer) {
     PaStreamParameters outputParameters{ };
 
     outputParameters.device = index;
@@ -26,12 +23,21 @@ bool Synth::open(PaDeviceIndex index) {
     outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
     outputParameters.hostApiSpecificStreamInfo = NULL;
 
-    PaError err = Pa_OpenStream(&stream, NULL, &outputParameters, SAMPLE_RATE, 512, 0, &Synth::paCallback, this);
+    if (Pa_IsFormatSupported(NULL, &outputParameters, sample_rate) != paFormatIsSupported)
+        return false;
+
+    // nothing is rendering yet, so the engine can be rescaled in place
+    set_sample_rate(sample_rate);
+    PaError err = Pa_OpenStream(&stream, NULL, &outputParameters, sample_rate, frames_per_buffer, 0, &Synth::paCallback, this);
 
     if (err != paNoError)
     {
         return false;
     }
+    device = index;
+    stream_rate = sample_rate;
+    stream_frames = frames_per_buffer;
+    perf.reset();
 
     err = Pa_SetStreamFinishedCallback(stream, &Synth::paStreamFinished);
 
@@ -68,6 +74,68 @@ bool Synth::stop() {
     return (err == paNoError);
 }
 
+bool Synth::reopen(double sample_rate, unsigned long frames_per_buffer) {
+    const PaDeviceIndex index = device;
+    if (stream != 0) {
+        stop();
+        close();
+    }
+    return open(index, sample_rate, frames_per_buffer) && start();
+}
+
+double Synth::output_latency() const {
+    if (stream == 0)
+        return 0;
+    const PaStreamInfo* info = Pa_GetStreamInfo(stream);
+    return info ? info->outputLatency : 0;
+}
+
+double Synth::cpu_load() const {
+    return stream == 0 ? 0 : Pa_GetStreamCpuLoad(stream);
+}
+
+bool Synth::begin_autotune() {
+    if (stream == 0 || !reopen(stream_rate, TUNE_BUFFER_SIZES[0]))
+        return false;
+    tuning = true;
+    tune_step = 0;
+    tune_started = Pa_GetStreamTime(stream);
+    tune_xruns = perf.xruns();
+    return true;
+}
+
+bool Synth::update_autotune() {
+    if (!tuning)
+        return false;
+    if (stream == 0) {
+        tuning = false;
+        return false;
+    }
+
+    const bool failed = perf.xruns() != tune_xruns;
+    if (!failed && Pa_GetStreamTime(stream) - tune_started < TUNE_SECONDS)
+        return true;
+
+    const std::size_t sizes = sizeof(TUNE_BUFFER_SIZES) / sizeof(TUNE_BUFFER_SIZES[0]);
+    if (failed || tune_step + 1 == sizes) {
+        // settle one step above the size that broke, or stay on the smallest if nothing did
+        tuning = false;
+        if (failed)
+            reopen(stream_rate, TUNE_BUFFER_SIZES[tune_step > 0 ? tune_step - 1 : 0]);
+        return false;
+    }
+
+    ++tune_step;
+    if (!reopen(stream_rate, TUNE_BUFFER_SIZES[tune_step])) {
+        tuning = false;
+        reopen(stream_rate, TUNE_BUFFER_SIZES[tune_step - 1]);
+        return false;
+    }
+    tune_started = Pa_GetStreamTime(stream);
+    tune_xruns = perf.xruns();
+    return true;
+}
+
 int Synth::paCallbackMethod(const void* inputBuffer, 
                             void* outputBuffer, 
                             unsigned long framesPerBuffer, 
@@ -76,26 +144,10 @@ int Synth::paCallbackMethod(const void* inputBuffer,
 
     float* out = (float*)outputBuffer;
     (void)timeInfo;
-    (void)statusFlags;
     (void)inputBuffer;
+    perf.record_status((statusFlags & paOutputUnderflow) != 0, (statusFlags & paOutputOverflow) != 0);
 
-    for (std::size_t i = 0; i < framesPerBuffer; i++) {
-        *out++ = amplitude.load(std::memory_order_relaxed) * (
-            a_amp * m_oscA.ps.amp * /*(half_f_add_one(2 * m_lfoA.lfo_amp * m_lfoA.interpolate_amp())) * */m_oscA.interpolate_left() +
-            b_amp * m_oscB.ps.amp * /*half_f_add_one(2 * m_lfoB.lfo_amp * m_lfoB.interpolate_amp()) * */m_oscB.interpolate_left() +
-            c_amp * m_oscC.ps.amp * /*half_f_add_one(2 * m_lfoC.lfo_amp * m_lfoC.interpolate_amp()) * */m_oscC.interpolate_left());
-        *out++ = amplitude.load(std::memory_order_relaxed) * (
-            a_amp * m_oscA.ps.amp */*(half_f_add_one(2 * m_lfoA.lfo_amp * m_lfoA.interpolate_amp())) * */m_oscA.interpolate_right() +
-            b_amp * m_oscB.ps.amp */*half_f_add_one(2 * m_lfoB.lfo_amp * m_lfoB.interpolate_amp()) * */m_oscB.interpolate_right() +
-            c_amp * m_oscC.ps.amp */*half_f_add_one(2 * m_lfoC.lfo_amp * m_lfoC.interpolate_amp()) * */m_oscC.interpolate_right());
-
-        for (std::size_t j = 0; j < 3; ++j) {
-            oscillators[j].first->ps.left_phase += oscillators[j].first->ps.left_phase_inc;
-            if (oscillators[j].first->ps.left_phase >= TABLE_SIZE) oscillators[j].first->ps.left_phase -= TABLE_SIZE;
-            oscillators[j].first->ps.right_phase += oscillators[j].first->ps.right_phase_inc;
-            if (oscillators[j].first->ps.right_phase >= TABLE_SIZE) oscillators[j].first->ps.right_phase -= TABLE_SIZE;
-        }
-    }
+    render(out, framesPerBuffer);
     return paContinue;
 }
 
@@ -1,36 +1,50 @@
 #pragma once
-#include <vector>
-#include "wavetable.h"
+#include "SynthEngine.h"
 #include "portaudio.h"
 
-constexpr auto SAMPLE_RATE = 48000;
+// buffer sizes the latency auto-tune steps down through, largest first
+constexpr unsigned long TUNE_BUFFER_SIZES[] = { 1024, 512, 256, 128, 64, 32, 16 };
+// how long each size has to run without an xrun before the next one down is tried
+constexpr double TUNE_SECONDS = 2.0;
 
-class Synth
+class Synth : public SynthEngine
 {
 private:
     PaStream* stream{ 0 };
     char message[20];
-    float a_amp;
-    float b_amp;
-    float c_amp;
     //static int callback_idx;
+    // what the stream was last opened with, so it can be reopened at another buffer size
+    PaDeviceIndex device{ paNoDevice };
+    double stream_rate{ DEFAULT_SAMPLE_RATE };
+    unsigned long stream_frames{ paFramesPerBufferUnspecified };
+    // latency auto-tune, gui thread only
+    bool tuning{ false };
+    std::size_t tune_step{ 0 };
+    double tune_started{ 0 };
+    unsigned tune_xruns{ 0 };
 public:
-    // GENERAL
-    Wavetable_t m_oscA;
-    Wavetable_t m_oscB;
-    Wavetable_t m_oscC;
-    LFO_t m_lfoA;
-    LFO_t m_lfoB;
-    LFO_t m_lfoC;
-    std::vector<std::pair<Wavetable_t*, LFO_t*>> oscillators {{ &m_oscA, & m_lfoA}, { &m_oscB, &m_lfoB }, { &m_oscC, &m_lfoC }};
-    std::atomic<float> amplitude{ 0.1f };
-
-public:
-    Synth();
-    bool open(PaDeviceIndex index);
+    explicit Synth(std::size_t max_voices = DEFAULT_VOICES);
+    // frames_per_buffer can be paFramesPerBufferUnspecified to let the host pick,
+    // the engine is rescaled to sample_rate before the stream is opened
+    bool open(PaDeviceIndex index, double sample_rate = DEFAULT_SAMPLE_RATE, unsigned long frames_per_buffer = paFramesPerBufferUnspecified);
     bool close();
     bool start();
     bool stop();
+    // closes and reopens the running stream with new settings, keeping the device
+    bool reopen(double sample_rate, unsigned long frames_per_buffer);
+    double stream_sample_rate() const { return stream_rate; }
+    unsigned long frames_per_buffer() const { return stream_frames; }
+    // output latency the host reports for the open stream, in seconds
+    double output_latency() const;
+    // fraction of the time between callbacks spent in them, as measured by PortAudio. gui thread
+    double cpu_load() const;
+
+    // steps the buffer size down from the largest until the stream xruns,
+    // then settles one step above. call update_autotune() regularly from the gui thread
+    bool begin_autotune();
+    // returns true while the tune is still running
+    bool update_autotune();
+    bool autotuning() const { return tuning; }
 private:
     int paCallbackMethod(const void*, void*, unsigned long, const PaStreamCallbackTimeInfo*, PaStreamCallbackFlags);
 
@@ -0,0 +1,1240 @@
+#include <algorithm>
+#include <chrono>
+#include "SynthEngine.h"
+#include "wavegen.h"
+
+SynthEngine::SynthEngine(std::size_t max_voices)
+    : remote_held(new TimedParam[REMOTE_QUEUE]),
+      voice_count(std::clamp<std::size_t>(max_voices, 1, MAX_VOICES)),
+      voices(new Voice[voice_count]{}),
+      active(new uint16_t[voice_count]),
+      free_voices(new uint16_t[voice_count]),
+      chunks(new VoiceChunk[(voice_count + CHUNK_VOICES - 1) / CHUNK_VOICES]),
+      pool(std::make_unique<RenderPool>(1)),
+      thread_scratch(new RenderScratch[1]),
+      envelopes(voice_count),
+      chunk_idle(new unsigned[(voice_count + CHUNK_VOICES - 1) / CHUNK_VOICES]{}),
+      filters(voice_count) {
+    a_amp = 0.2f;
+    b_amp = 0.2f;
+    c_amp = 0.2f;
+    for (std::size_t m = 0; m < INTERP_MODES; ++m)
+        osc_kernels[m] = select_osc_kernel((Interp)m);
+
+    // taken from the back of the free list, so voice 0 goes first
+    for (std::size_t v = 0; v < voice_count; ++v)
+        free_voices[v] = (uint16_t)(voice_count - 1 - v);
+    free_count = voice_count;
+
+    block_params.amplitude = amplitude.load();
+    for (std::size_t j = 0; j < 3; ++j) {
+        block_params.osc[j].amp = oscillators[j].first->ps.amp.load();
+        block_params.osc[j].interp = (Interp)oscillators[j].first->ps.interpolation.load();
+        block_params.osc[j].morph = oscillators[j].first->ps.morph_position.load();
+        LFO_t* lfo = oscillators[j].second;
+        lfo_settings[j].depth = lfo->lfo_amp;
+        lfo_settings[j].enabled = lfo->lfo_enable;
+    }
+    set_sample_rate(DEFAULT_SAMPLE_RATE);
+}
+
+void SynthEngine::set_sample_rate(double sample_rate) {
+    // a song carries on from the same point in time
+    const double old_rate = rate;
+    rate = sample_rate > 0 ? sample_rate : DEFAULT_SAMPLE_RATE;
+    sequence_frame = (uint64_t)std::llround(sequence_frame * rate / old_rate);
+    rate_scale = (float)(REFERENCE_RATE / rate);
+    history_period = std::max(1u, (unsigned)(rate / LFO_TICK_RATE));
+
+    // anything still queued was sent at the old rate, apply it before converting
+    drain_params(steady_now_ns());
+    // the atomics hold what the gui last sent, in gui units
+    for (std::size_t j = 0; j < 3; ++j) {
+        block_params.osc[j].left_inc = osc_inc_to_fixed(oscillators[j].first->ps.left_phase_inc.load());
+        block_params.osc[j].right_inc = osc_inc_to_fixed(oscillators[j].first->ps.right_phase_inc.load());
+        lfo_settings[j].inc = lfo_rate_to_fixed(oscillators[j].second->ps.left_phase_inc.load(), rate);
+    }
+    envelopes.set_shape(envelope_shape, rate);
+    filter_cutoff = (float)std::log2(filter_settings.cutoff / rate);
+    smoothing_samples = (uint32_t)std::lround(smoothing_time * rate);
+    fresh = true;
+}
+
+void SynthEngine::set_render_threads(unsigned threads) {
+    threads = std::max(threads, 1u);
+    pool.reset();
+    pool = std::make_unique<RenderPool>(threads);
+    thread_scratch.reset(new RenderScratch[threads]);
+}
+
+uint64_t SynthEngine::set_morph_table(std::size_t osc, MorphTable* table) {
+    morph_tables[osc].store(table);
+    // any block that starts after this sees the new table
+    return blocks_started.load();
+}
+
+bool SynthEngine::set_param(Param id, std::size_t osc, float value) {
+    if (!param_queue.push({ id, (unsigned char)std::min<std::size_t>(osc, 127), value }))
+        return false;
+    mirror_param(id, osc, value);
+    return true;
+}
+
+bool SynthEngine::push_remote(const ParamMsg& msg, int64_t time_ns) {
+    if (!remote_queue.push({ msg, time_ns }))
+        return false;
+    // only the atomics, the rest of the gui's state belongs to the gui thread
+    if (mirror_atomic(msg.id, msg.index, msg.value))
+        remote_mirrored.fetch_add(1);
+    return true;
+}
+
+bool SynthEngine::mirror_atomic(Param id, std::size_t osc, float value) {
+    switch (id) {
+    case Param::OscAmp:
+        oscillators[osc].first->ps.amp.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::LeftPhaseInc:
+        oscillators[osc].first->ps.left_phase_inc.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::RightPhaseInc:
+        oscillators[osc].first->ps.right_phase_inc.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::MasterAmp:
+        amplitude.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::LfoRate:
+        oscillators[osc].second->ps.left_phase_inc.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::LfoDepth:
+        oscillators[osc].second->lfo_amp.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::LfoEnable:
+        oscillators[osc].second->lfo_enable.store(value != 0, std::memory_order_relaxed);
+        return true;
+    case Param::Interpolation:
+        oscillators[osc].first->ps.interpolation.store((int)value, std::memory_order_relaxed);
+        return true;
+    case Param::MorphPosition:
+        oscillators[osc].first->ps.morph_position.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::ControlBlock:
+        control_samples.store((int)value, std::memory_order_relaxed);
+        return true;
+    case Param::StealPolicy:
+        voice_steal.store((int)value, std::memory_order_relaxed);
+        return true;
+    case Param::SmoothingTime:
+        smoothing.store(value, std::memory_order_relaxed);
+        return true;
+    case Param::FmAlgorithm:
+        operator_algorithm.store((int)value, std::memory_order_relaxed);
+        return true;
+    case Param::FmFeedback:
+        operator_feedback.store(value, std::memory_order_relaxed);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void SynthEngine::mirror_param(Param id, std::size_t osc, float value) {
+    if (mirror_atomic(id, osc, value))
+        return;
+    switch (id) {
+    case Param::ModRoutes:
+        mod_sent.count = (int32_t)value;
+        break;
+    case Param::ModSource:
+        if (osc < MOD_MAX_ROUTES)
+            mod_sent.route[osc].source = (uint8_t)value;
+        break;
+    case Param::ModController:
+        if (osc < MOD_MAX_ROUTES)
+            mod_sent.route[osc].controller = (uint8_t)value;
+        break;
+    case Param::ModDest:
+        if (osc < MOD_MAX_ROUTES)
+            mod_sent.route[osc].dest = (uint8_t)value;
+        break;
+    case Param::ModOsc:
+        if (osc < MOD_MAX_ROUTES)
+            mod_sent.route[osc].osc = (uint8_t)value;
+        break;
+    case Param::ModDepth:
+        if (osc < MOD_MAX_ROUTES)
+            mod_sent.route[osc].depth = value;
+        break;
+    case Param::EnvSegments:
+        envelope_sent.count = (int32_t)value;
+        break;
+    case Param::EnvSustain:
+        envelope_sent.sustain = (int32_t)value;
+        break;
+    case Param::EnvLevel:
+        if (osc < ENV_MAX_SEGMENTS)
+            envelope_sent.segment[osc].level = value;
+        break;
+    case Param::EnvTime:
+        (osc < ENV_MAX_SEGMENTS ? envelope_sent.segment[osc] : envelope_sent.release).seconds = value;
+        break;
+    case Param::EnvCurve:
+        (osc < ENV_MAX_SEGMENTS ? envelope_sent.segment[osc] : envelope_sent.release).curve = value;
+        break;
+    case Param::FilterType:
+        filter_sent.mode = (int32_t)value;
+        break;
+    case Param::FilterCutoff:
+        filter_sent.cutoff = value;
+        break;
+    case Param::FilterResonance:
+        filter_sent.resonance = value;
+        break;
+    case Param::FilterKeyTrack:
+        filter_sent.key_track = value;
+        break;
+    default:
+        break;
+    }
+}
+
+bool SynthEngine::set_sequence(const MidiSequence* seq, uint64_t& ticket) {
+    const MidiSequence* previous = sequence_set.exchange(seq);
+    if (!param_queue.push({ Param::SequenceStart, 0, 0.0f })) {
+        sequence_set.store(previous);
+        return false;
+    }
+    // any block that starts after this has let go of the old sequence
+    ticket = blocks_started.load();
+    return true;
+}
+
+// the messages that set every field of an envelope
+static std::size_t envelope_messages(const EnvelopeShape& shape, ParamMsg* out) {
+    const EnvelopeShape e = sanitise_envelope(shape);
+    std::size_t n = 0;
+    auto add = [&](Param id, std::size_t index, float value) { out[n++] = { id, (unsigned char)index, value }; };
+    add(Param::EnvSegments, 0, (float)e.count);
+    add(Param::EnvSustain, 0, (float)e.sustain);
+    for (std::size_t k = 0; k <= ENV_MAX_SEGMENTS; ++k) {
+        const EnvSegment& segment = k < ENV_MAX_SEGMENTS ? e.segment[k] : e.release;
+        add(Param::EnvLevel, k, segment.level);
+        add(Param::EnvTime, k, segment.seconds);
+        add(Param::EnvCurve, k, segment.curve);
+    }
+    return n;
+}
+
+bool SynthEngine::set_envelope(const EnvelopeShape& shape) {
+    ParamMsg msgs[ENV_PARAMS];
+    const std::size_t n = envelope_messages(shape, msgs);
+    if (param_queue.free_space() < n)
+        return false;
+    for (std::size_t i = 0; i < n; ++i)
+        mirror_param(msgs[i].id, msgs[i].index, msgs[i].value);
+    return param_queue.push_all(msgs, n);
+}
+
+// and every field of a filter
+static std::size_t filter_messages(const FilterSettings& settings, ParamMsg* out) {
+    const FilterSettings f = sanitise_filter(settings);
+    out[0] = { Param::FilterType, 0, (float)f.mode };
+    out[1] = { Param::FilterCutoff, 0, f.cutoff };
+    out[2] = { Param::FilterResonance, 0, f.resonance };
+    out[3] = { Param::FilterKeyTrack, 0, f.key_track };
+    return FILTER_PARAMS;
+}
+
+bool SynthEngine::set_filter(const FilterSettings& settings) {
+    ParamMsg msgs[FILTER_PARAMS];
+    const std::size_t n = filter_messages(settings, msgs);
+    if (param_queue.free_space() < n)
+        return false;
+    for (std::size_t i = 0; i < n; ++i)
+        mirror_param(msgs[i].id, msgs[i].index, msgs[i].value);
+    return param_queue.push_all(msgs, n);
+}
+
+// and every route of a matrix, only the ones in use go over
+static std::size_t matrix_messages(const ModMatrix& matrix, ParamMsg* out) {
+    const ModMatrix m = sanitise_matrix(matrix);
+    std::size_t n = 0;
+    auto add = [&](Param id, std::size_t index, float value) { out[n++] = { id, (unsigned char)index, value }; };
+    add(Param::ModRoutes, 0, (float)m.count);
+    for (std::size_t r = 0; r < (std::size_t)m.count; ++r) {
+        const ModRoute& route = m.route[r];
+        add(Param::ModSource, r, route.source);
+        add(Param::ModController, r, route.controller);
+        add(Param::ModDest, r, route.dest);
+        add(Param::ModOsc, r, route.osc);
+        add(Param::ModDepth, r, route.depth);
+    }
+    return n;
+}
+
+bool SynthEngine::set_modulation(const ModMatrix& matrix) {
+    ParamMsg msgs[MOD_PARAMS];
+    const std::size_t n = matrix_messages(matrix, msgs);
+    if (param_queue.free_space() < n)
+        return false;
+    // the routes past the count aren't sent, they are left as they were
+    mod_sent = empty_matrix();
+    for (std::size_t i = 0; i < n; ++i)
+        mirror_param(msgs[i].id, msgs[i].index, msgs[i].value);
+    return param_queue.push_all(msgs, n);
+}
+
+bool SynthEngine::apply_preset(const Preset& preset) {
+    ParamMsg msgs[6 + 3 * 8 + ENV_PARAMS + FILTER_PARAMS + MOD_PARAMS];
+    std::size_t n = 0;
+    auto add = [&](Param id, std::size_t osc, float value) { msgs[n++] = { id, (unsigned char)osc, value }; };
+    add(Param::MasterAmp, 0, preset.master_amp);
+    add(Param::ControlBlock, 0, (float)(preset.control_block > 0 ? preset.control_block : DEFAULT_CONTROL_BLOCK));
+    add(Param::StealPolicy, 0, (float)std::clamp(preset.steal_policy, 0, (int)VoiceSteal::SameNote));
+    // presets from before fm have zero here, which mixes the oscillators as they always were
+    add(Param::FmAlgorithm, 0, (float)std::clamp(preset.fm_algorithm, 0, (int)FM_ALGORITHMS - 1));
+    add(Param::FmFeedback, 0, std::clamp(preset.fm_feedback, 0.0f, 1.0f));
+    for (std::size_t j = 0; j < 3; ++j) {
+        const PresetOsc& o = preset.osc[j];
+        add(Param::OscAmp, j, o.amp);
+        add(Param::LeftPhaseInc, j, o.left_inc);
+        add(Param::RightPhaseInc, j, o.right_inc);
+        add(Param::Interpolation, j, (float)std::clamp(o.interp, 0, (int)INTERP_MODES - 1));
+        add(Param::MorphPosition, j, std::clamp(o.morph, 0.0f, 1.0f));
+        add(Param::LfoRate, j, o.lfo_rate);
+        add(Param::LfoDepth, j, o.lfo_depth);
+        add(Param::LfoEnable, j, o.lfo_enable ? 1.0f : 0.0f);
+    }
+    // presets from before envelopes play as they always did
+    n += envelope_messages(preset.version >= 2 ? preset.envelope : gate_envelope(), msgs + n);
+    n += filter_messages(preset.version >= 3 ? preset.filter : default_filter(), msgs + n);
+    n += matrix_messages(preset.version >= 4 ? preset.modulation : empty_matrix(), msgs + n);
+    add(Param::PresetLoaded, 0, 0.0f);
+    if (param_queue.free_space() < n)
+        return false;
+
+    // every table goes out tagged with the new preset, the audio thread takes them in the
+    // block that drains the PresetLoaded at the end of the messages
+    ++presets_sent;
+    for (std::size_t j = 0; j < 3; ++j) {
+        const PresetOsc& o = preset.osc[j];
+        Wavetable_t* osc = oscillators[j].first;
+        LFO_t* lfo = oscillators[j].second;
+        const int waveform = std::clamp(o.waveform, 0, (int)WAVE_TRIANGLE);
+        const int lfo_waveform = std::clamp(o.lfo_waveform, 0, (int)WAVE_TRIANGLE);
+        osc->ps.current_waveform = waveform;
+        osc->ps.pulse_width = o.pulse_width;
+        osc->ps.current_note_left = o.note_left;
+        osc->ps.current_note_right = o.note_right;
+        osc->shared.hold_until(presets_sent);
+        osc->update_shape(waveform, o.pulse_width);
+        lfo->ps.current_waveform = lfo_waveform;
+        lfo->ps.pulse_width = o.lfo_pulse_width;
+        lfo->shared.hold_until(presets_sent);
+        lfo->update_shape(lfo_waveform, o.lfo_pulse_width);
+    }
+    mod_sent = empty_matrix();
+    for (std::size_t i = 0; i + 1 < n; ++i)
+        mirror_param(msgs[i].id, msgs[i].index, msgs[i].value);
+    return param_queue.push_all(msgs, n);
+}
+
+Preset SynthEngine::capture_preset() const {
+    // the pulse width a table was last built from, the gui only stores the osc atomic now and then
+    auto built_pw = [](const Wavetable_t* table) { return table->shape_pw >= 0 ? table->shape_pw : table->ps.pulse_width.load(); };
+    Preset preset = blank_preset();
+    preset.master_amp = amplitude.load();
+    preset.control_block = control_samples.load();
+    preset.steal_policy = voice_steal.load();
+    preset.fm_algorithm = operator_algorithm.load();
+    preset.fm_feedback = operator_feedback.load();
+    for (std::size_t j = 0; j < 3; ++j) {
+        const Wavetable_t* osc = oscillators[j].first;
+        const LFO_t* lfo = oscillators[j].second;
+        PresetOsc& o = preset.osc[j];
+        o.waveform = osc->ps.current_waveform;
+        o.pulse_width = built_pw(osc);
+        o.amp = osc->ps.amp;
+        o.left_inc = osc->ps.left_phase_inc;
+        o.right_inc = osc->ps.right_phase_inc;
+        o.note_left = osc->ps.current_note_left;
+        o.note_right = osc->ps.current_note_right;
+        o.interp = osc->ps.interpolation;
+        o.morph = osc->ps.morph_position;
+        o.lfo_waveform = lfo->ps.current_waveform;
+        o.lfo_pulse_width = built_pw(lfo);
+        o.lfo_rate = lfo->ps.left_phase_inc;
+        o.lfo_depth = lfo->lfo_amp;
+        o.lfo_enable = lfo->lfo_enable;
+    }
+    preset.envelope = envelope_sent;
+    preset.filter = filter_sent;
+    preset.modulation = mod_sent;
+    return preset;
+}
+
+void SynthEngine::drain_params(int64_t now_ns) {
+    ParamMsg msg;
+    while (param_queue.pop(msg))
+        apply_param(msg);
+
+    // remote changes are sorted into the held ones by time, after any due at the same time so
+    // a bundle keeps its order, and every one that is due goes out from the front. only while
+    // the held ones are full does anything wait in the queue
+    uint64_t applied = 0;
+    int64_t peak_wait = 0;
+    for (;;) {
+        TimedParam remote;
+        while (remote_held_count < REMOTE_QUEUE && remote_queue.pop(remote)) {
+            TimedParam* const held = remote_held.get();
+            TimedParam* const at = std::upper_bound(held, held + remote_held_count, remote.time_ns,
+                [](int64_t time, const TimedParam& p) { return time < p.time_ns; });
+            std::move_backward(at, held + remote_held_count, held + remote_held_count + 1);
+            *at = remote;
+            ++remote_held_count;
+        }
+        std::size_t due = 0;
+        for (; due < remote_held_count && remote_held[due].time_ns <= now_ns; ++due) {
+            apply_param(remote_held[due].msg);
+            peak_wait = std::max(peak_wait, now_ns - remote_held[due].time_ns);
+        }
+        std::move(remote_held.get() + due, remote_held.get() + remote_held_count, remote_held.get());
+        remote_held_count -= due;
+        applied += due;
+        if (!due || !remote_queue.front())
+            break;
+    }
+    if (applied) {
+        remote_applied.fetch_add(applied, std::memory_order_relaxed);
+        if (peak_wait > remote_peak_wait_ns.load(std::memory_order_relaxed))
+            remote_peak_wait_ns.store(peak_wait, std::memory_order_relaxed);
+    }
+
+    // a whole envelope comes as a run of messages, it is only converted once they're all in
+    if (envelope_changed) {
+        envelopes.set_shape(envelope_shape, rate);
+        envelope_changed = false;
+    }
+    // and so does a matrix
+    if (mod_changed) {
+        mod_program.compile(mod_matrix);
+        mod_changed = false;
+    }
+}
+
+void SynthEngine::apply_param(const ParamMsg& msg) {
+    switch (msg.id) {
+    case Param::OscAmp:
+        block_params.osc[msg.index].amp = msg.value;
+        break;
+    case Param::LeftPhaseInc:
+        block_params.osc[msg.index].left_inc = osc_inc_to_fixed(msg.value);
+        break;
+    case Param::RightPhaseInc:
+        block_params.osc[msg.index].right_inc = osc_inc_to_fixed(msg.value);
+        break;
+    case Param::PhaseReset:
+        for (std::size_t a = 0; a < active_count; ++a) {
+            voices[active[a]].left_phase[msg.index] = 0;
+            voices[active[a]].right_phase[msg.index] = 0;
+        }
+        break;
+    case Param::MasterAmp:
+        block_params.amplitude = msg.value;
+        break;
+    case Param::LfoRate:
+        lfo_settings[msg.index].inc = lfo_rate_to_fixed(msg.value, rate);
+        break;
+    case Param::LfoDepth:
+        lfo_settings[msg.index].depth = msg.value;
+        break;
+    case Param::LfoEnable:
+        lfo_settings[msg.index].enabled = msg.value != 0;
+        break;
+    case Param::LfoSync:
+        for (std::size_t a = 0; a < active_count; ++a)
+            voices[active[a]].lfo[msg.index].phase = 0;
+        break;
+    case Param::ControlBlock:
+        control_block = (unsigned)std::clamp(msg.value, 1.0f, (float)MAX_BLOCK);
+        control_left = std::min(control_left, control_block);
+        break;
+    case Param::NoteOn:
+        start_voice(msg.index, std::clamp(msg.value, 0.0f, 1.0f));
+        break;
+    case Param::NoteOff:
+        release_note(msg.index);
+        break;
+    case Param::AllNotesOff:
+        for (std::size_t a = active_count; a-- > 0;)
+            release_voice(voices[active[a]]);
+        break;
+    case Param::StealPolicy:
+        steal_policy = (VoiceSteal)(int)std::clamp(msg.value, 0.0f, (float)VoiceSteal::SameNote);
+        break;
+    case Param::Interpolation:
+        block_params.osc[msg.index].interp = (Interp)(int)std::clamp(msg.value, 0.0f, (float)(INTERP_MODES - 1));
+        break;
+    case Param::MorphPosition:
+        block_params.osc[msg.index].morph = std::clamp(msg.value, 0.0f, 1.0f);
+        break;
+    case Param::PresetLoaded:
+        ++presets_reached;
+        break;
+    case Param::SequenceStart:
+        while (active_count)
+            stop_voice(voices[active[active_count - 1]]);
+        sequence = sequence_set.load(std::memory_order_acquire);
+        sequence_next = 0;
+        sequence_frame = 0;
+        bend = 1.0;
+        midi_volume = 1.0f;
+        sustain = false;
+        break;
+    case Param::EnvSegments:
+        envelope_shape.count = std::clamp((int)msg.value, 1, (int)ENV_MAX_SEGMENTS);
+        envelope_shape.sustain = std::min(envelope_shape.sustain, envelope_shape.count - 1);
+        envelope_changed = true;
+        break;
+    case Param::EnvSustain:
+        envelope_shape.sustain = std::clamp((int)msg.value, -1, envelope_shape.count - 1);
+        envelope_changed = true;
+        break;
+    case Param::EnvLevel:
+        if (msg.index < ENV_MAX_SEGMENTS)
+            envelope_shape.segment[msg.index].level = msg.value;
+        envelope_changed = true;
+        break;
+    case Param::EnvTime:
+        (msg.index < ENV_MAX_SEGMENTS ? envelope_shape.segment[msg.index] : envelope_shape.release).seconds = msg.value;
+        envelope_changed = true;
+        break;
+    case Param::EnvCurve:
+        (msg.index < ENV_MAX_SEGMENTS ? envelope_shape.segment[msg.index] : envelope_shape.release).curve = msg.value;
+        envelope_changed = true;
+        break;
+    case Param::FilterType:
+        filter_settings.mode = std::clamp((int)msg.value, 0, (int)FILTER_MODES - 1);
+        filters.set_mode((FilterMode)filter_settings.mode);
+        break;
+    case Param::FilterCutoff:
+        filter_settings.cutoff = std::clamp(msg.value, FILTER_MIN_CUTOFF, FILTER_MAX_CUTOFF);
+        filter_cutoff = (float)std::log2(filter_settings.cutoff / rate);
+        break;
+    case Param::FilterResonance:
+        filter_settings.resonance = std::clamp(msg.value, 0.0f, 1.0f);
+        filters.set_resonance(filter_settings.resonance);
+        break;
+    case Param::FilterKeyTrack:
+        filter_settings.key_track = std::clamp(msg.value, 0.0f, 1.0f);
+        break;
+    case Param::SmoothingTime:
+        smoothing_time = std::clamp(msg.value, 0.0f, MAX_SMOOTHING);
+        smoothing_samples = (uint32_t)std::lround(smoothing_time * rate);
+        break;
+    case Param::ModRoutes:
+        mod_matrix.count = std::clamp((int)msg.value, 0, (int)MOD_MAX_ROUTES);
+        mod_changed = true;
+        break;
+    case Param::ModSource:
+        if (msg.index < MOD_MAX_ROUTES)
+            mod_matrix.route[msg.index].source = (uint8_t)std::clamp((int)msg.value, 0, (int)ModSource::Controller);
+        mod_changed = true;
+        break;
+    case Param::ModController:
+        if (msg.index < MOD_MAX_ROUTES)
+            mod_matrix.route[msg.index].controller = (uint8_t)std::clamp((int)msg.value, 0, (int)MOD_CONTROLLERS - 1);
+        mod_changed = true;
+        break;
+    case Param::ModDest:
+        if (msg.index < MOD_MAX_ROUTES)
+            mod_matrix.route[msg.index].dest = (uint8_t)std::clamp((int)msg.value, 0, (int)ModDest::Cutoff);
+        mod_changed = true;
+        break;
+    case Param::ModOsc:
+        if (msg.index < MOD_MAX_ROUTES)
+            mod_matrix.route[msg.index].osc = (uint8_t)std::clamp((int)msg.value, 0, (int)MOD_ALL_OSCS);
+        mod_changed = true;
+        break;
+    case Param::ModDepth:
+        if (msg.index < MOD_MAX_ROUTES) {
+            const float limit = MOD_DEPTH_LIMIT[mod_matrix.route[msg.index].dest];
+            mod_matrix.route[msg.index].depth = std::clamp(msg.value, -limit, limit);
+        }
+        mod_changed = true;
+        break;
+    case Param::Controller:
+        controllers[msg.index] = std::clamp(msg.value, 0.0f, 1.0f);
+        break;
+    case Param::FmAlgorithm:
+        fm_algorithm = (FmAlgorithm)(int)std::clamp(msg.value, 0.0f, (float)(FM_ALGORITHMS - 1));
+        break;
+    case Param::FmFeedback:
+        fm_feedback = std::clamp(msg.value, 0.0f, 1.0f);
+        break;
+    }
+}
+
+Voice& SynthEngine::steal_voice() {
+    // a voice already on its way out goes before one that is still held
+    Voice* victim = &voices[active[0]];
+    for (std::size_t a = 1; a < active_count; ++a) {
+        Voice& v = voices[active[a]];
+        if (v.released != victim->released) {
+            if (v.released)
+                victim = &v;
+            continue;
+        }
+        const bool quieter = v.velocity * envelopes.level_of(v.slot) < victim->velocity * envelopes.level_of(victim->slot);
+        if (steal_policy == VoiceSteal::Quietest ? quieter : v.started < victim->started)
+            victim = &v;
+    }
+    return *victim;
+}
+
+void SynthEngine::start_voice(int note, float velocity) {
+    Voice* voice = nullptr;
+    if (steal_policy == VoiceSteal::SameNote) {
+        for (std::size_t a = 0; a < active_count && !voice; ++a)
+            if (voices[active[a]].note == note)
+                voice = &voices[active[a]];
+    }
+    if (!voice && free_count) {
+        // take a free voice and append it to the active list
+        voice = &voices[free_voices[--free_count]];
+        voice->slot = (unsigned)active_count;
+        active[active_count++] = (uint16_t)(voice - voices.get());
+    }
+    if (!voice)
+        voice = &steal_voice();
+
+    // a stolen or retriggered voice keeps its oscillator phases and its envelope starts from the
+    // level it had got to, so it doesn't click. a fresh one starts from the top of the table and silence
+    if (voice->started == 0) {
+        for (std::size_t j = 0; j < 3; ++j) {
+            voice->left_phase[j] = 0;
+            voice->right_phase[j] = 0;
+        }
+        std::fill(&voice->fm_history[0][0], &voice->fm_history[0][0] + 4, 0.0f);
+    }
+    envelopes.start(voice->slot, voice->started == 0);
+    voice->note = (unsigned char)note;
+    filters.start(voice->slot, voice_cutoff(*voice), voice->started == 0);
+    for (std::size_t j = 0; j < 3; ++j)
+        voice->lfo[j] = { 0, 1.0f, 1.0f, 0.0f };
+    std::fill(voice->mod, voice->mod + MOD_TARGETS, 0.0f);
+    voice->sustained = false;
+    voice->released = false;
+    voice->pitch = note_pitch(note);
+    voice->velocity = velocity;
+    voice->started = ++notes_started;
+    newest = voice;
+}
+
+void SynthEngine::release_note(int note) {
+    // walk backwards, stopping a voice moves the last active one into its slot
+    for (std::size_t a = active_count; a-- > 0;) {
+        Voice& v = voices[active[a]];
+        if (v.note != note || v.released)
+            continue;
+        if (sustain)
+            v.sustained = true;
+        else
+            release_voice(v);
+    }
+}
+
+void SynthEngine::release_voice(Voice& voice) {
+    if (voice.released)
+        return;
+    if (envelopes.release(voice.slot))
+        voice.released = true;
+    else
+        stop_voice(voice);
+}
+
+unsigned long SynthEngine::run_sequence(unsigned long frames) {
+    if (!sequence)
+        return frames;
+    const MidiEvent* events = sequence->data();
+    const std::size_t count = sequence->size();
+    for (; sequence_next < count; ++sequence_next) {
+        // worked out here rather than stored, so the same song plays at any sample rate
+        const uint64_t at = (uint64_t)std::llround(events[sequence_next].time * rate);
+        if (at > sequence_frame)
+            return (unsigned long)std::min<uint64_t>(frames, at - sequence_frame);
+        apply_midi(events[sequence_next]);
+    }
+    return frames;
+}
+
+void SynthEngine::apply_midi(const MidiEvent& event) {
+    // every channel plays the one patch
+    switch (event.type) {
+    case MidiEventType::NoteOn:
+        start_voice(event.data, event.value);
+        break;
+    case MidiEventType::NoteOff:
+        release_note(event.data);
+        break;
+    case MidiEventType::PitchBend:
+        bend = std::exp2(event.value * PITCH_BEND_RANGE / 12.0);
+        break;
+    case MidiEventType::Control:
+        if (event.data < MOD_CONTROLLERS)
+            controllers[event.data] = event.value;
+        switch (event.data) {
+        case 7: // channel volume, squared for the curve general midi asks for
+            midi_volume = event.value * event.value;
+            break;
+        case 64: // sustain pedal
+            sustain = event.value >= 0.5f;
+            for (std::size_t a = active_count; !sustain && a-- > 0;)
+                if (voices[active[a]].sustained)
+                    release_voice(voices[active[a]]);
+            break;
+        case 120: // all sound off, cut short
+            while (active_count)
+                stop_voice(voices[active[active_count - 1]]);
+            break;
+        case 123: // all notes off, through their release
+            for (std::size_t a = active_count; a-- > 0;)
+                release_voice(voices[active[a]]);
+            break;
+        }
+        break;
+    }
+}
+
+void SynthEngine::stop_voice(Voice& voice) {
+    // swap the last active voice into this one's slot to keep the list packed
+    const uint16_t last = active[--active_count];
+    active[voice.slot] = last;
+    voices[last].slot = voice.slot;
+    envelopes.move(active_count, voice.slot);
+    envelopes.clear(active_count);
+    filters.move(active_count, voice.slot);
+    filters.clear(active_count);
+    const uint16_t index = (uint16_t)(&voice - voices.get());
+    free_voices[free_count++] = index;
+    voice.started = 0;
+    if (newest == &voice)
+        newest = active_count ? &voices[active[active_count - 1]] : nullptr;
+}
+
+unsigned SynthEngine::fill_lfo_gains(Voice& voice, const float* const* lfo_tables, float (*lfo_gain)[MAX_BLOCK], const float* env, float level,
+    ModPiece* pieces, float* cutoff, std::size_t frames) {
+    const bool display = &voice == newest;
+    const bool routed = !mod_program.empty();
+    unsigned modulated = 0;
+    unsigned left = control_left;
+    for (std::size_t i = 0; i < frames;) {
+        if (left == 0) {
+            // evaluate every lfo where the next control point falls and ramp towards it
+            LfoFrame history{};
+            float sources[MOD_VOICE_SOURCES]{};
+            float target[3];
+            for (std::size_t j = 0; j < 3; ++j) {
+                const LfoSettings& settings = lfo_settings[j];
+                LfoState& lfo = voice.lfo[j];
+                target[j] = 1.0f;
+                if (settings.enabled || mod_program.follows_lfo(j)) {
+                    lfo.phase += settings.inc * control_block;
+                    const uint32_t idx = lfo.phase >> PHASE_FRAC_BITS;
+                    const float frac = (lfo.phase & PHASE_FRAC_MASK) * PHASE_FRAC_SCALE;
+                    const float v = lfo_tables[j][idx] + frac * (lfo_tables[j][idx + 1] - lfo_tables[j][idx]);
+                    sources[MOD_LFO + j] = v;
+                    if (settings.enabled) {
+                        target[j] = 1.0f + settings.depth * v;
+                        history.value[j] = settings.depth * v;
+                    }
+                }
+                else {
+                    // a disabled lfo sits at the start of its table, as it always has
+                    lfo.phase = 0;
+                }
+            }
+            // the routes are summed at the same points, an amplitude route on top of the lfo
+            if (routed) {
+                sources[MOD_ENVELOPE] = env ? env[i] : level;
+                mod_program.evaluate(sources, controllers, voice.mod);
+                for (std::size_t j = 0; j < 3; ++j)
+                    if (mod_program.moves(MOD_AMP + (unsigned)j))
+                        target[j] *= std::max(0.0f, 1.0f + voice.mod[MOD_AMP + j]);
+                if (cutoff)
+                    *cutoff++ = voice.mod[MOD_CUTOFF];
+            }
+            for (std::size_t j = 0; j < 3; ++j) {
+                LfoState& lfo = voice.lfo[j];
+                lfo.target = target[j];
+                lfo.step = (target[j] - lfo.gain) / control_block;
+            }
+            left = control_block;
+
+            if (display) {
+                history_left += control_block;
+                if (history_left >= history_period) {
+                    history_left = 0;
+                    lfo_feed.push(history);
+                }
+            }
+        }
+
+        const std::size_t n = std::min<std::size_t>(left, frames - i);
+        // the voice holds its pitch, pulse width and morph position until the next point
+        if (pieces) {
+            ModPiece& piece = *pieces++;
+            piece.first = (uint32_t)i;
+            piece.frames = (uint32_t)n;
+            std::copy(voice.mod, voice.mod + MOD_TARGETS, piece.value);
+        }
+        // counted from the last control point rather than from where the block starts, so a
+        // ramp comes out the same wherever blocks cut it
+        const std::size_t at = control_block - left;
+        for (std::size_t j = 0; j < 3; ++j) {
+            LfoState& lfo = voice.lfo[j];
+            // an lfo or route that could move the gain keeps its rows even while it is still 1,
+            // the same sample mixed in with a row or as a plain gain rounds differently
+            if (lfo.gain != 1.0f || lfo.step != 0.0f || lfo_settings[j].enabled || mod_program.moves(MOD_AMP + (unsigned)j))
+                modulated |= 1u << j;
+            float* g = lfo_gain[j] + i;
+            for (std::size_t k = 0; k < n; ++k)
+                g[k] = lfo.gain + lfo.step * (float)(at + k);
+            // land exactly on the target at control points so an lfo that is switched off gets back to exactly 1
+            if (n == left)
+                lfo.gain = lfo.target;
+        }
+        left -= (unsigned)n;
+        i += n;
+    }
+    return modulated;
+}
+
+uint32_t SynthEngine::render_channel(OscKernel kernel, const MipTable& mips, MipChoice mip, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    if (mip.weight <= 0.0f)
+        return kernel(mips.level[mip.level], phase, inc, gain, out, frames);
+    if (mip.weight >= 1.0f)
+        return kernel(mips.level[mip.level + 1], phase, inc, gain, out, frames);
+    kernel(mips.level[mip.level + 1], phase, inc, gain * mip.weight, out, frames);
+    return kernel(mips.level[mip.level], phase, inc, gain * (1.0f - mip.weight), out, frames);
+}
+
+void SynthEngine::pick_morph_frames(std::size_t osc) {
+    block_ctx.morph_weight[osc] = 0.0f;
+    MorphTable* table = morph_tables[osc].load();
+    if (table != morph_current[osc]) {
+        morph_current[osc] = table;
+        morph_last[osc] = nullptr;
+    }
+    if (!table)
+        return;
+
+    // frames that haven't been built yet are asked for and built on the gui thread. until then
+    // the last frame played carries on, or the osc's own table if there hasn't been one
+    const double pos = block_params.osc[osc].morph * (table->frames() - 1);
+    const std::size_t k = (std::size_t)pos;
+    const float w = (float)(pos - k);
+    const MipTable* frame = table->frame(k);
+    if (frame)
+        morph_last[osc] = frame;
+    if (!morph_last[osc])
+        return;
+    block_ctx.table[osc] = morph_last[osc];
+    if (frame && w > 0.0f) {
+        if (const MipTable* next = table->frame(k + 1)) {
+            block_ctx.morph_next[osc] = next;
+            block_ctx.morph_weight[osc] = w;
+        }
+    }
+}
+
+uint32_t SynthEngine::render_osc(std::size_t osc, MipChoice mip, uint32_t phase, uint32_t inc, float gain, float* out) const {
+    const BlockContext& b = block_ctx;
+    const float w = b.morph_weight[osc];
+    if (w > 0.0f)
+        render_channel(b.kernel[osc], *b.morph_next[osc], mip, phase, inc, gain * w, out, b.frames);
+    return render_channel(b.kernel[osc], *b.table[osc], mip, phase, inc, gain * (1.0f - w), out, b.frames);
+}
+
+void SynthEngine::modulated_frames(std::size_t osc, float offset, const MipTable*& table, const MipTable*& next, float& weight) const {
+    // a frame that isn't built yet is asked for, the block's own frames play until it is
+    MorphTable* morph = morph_current[osc];
+    const float pos = std::clamp(block_params.osc[osc].morph + offset, 0.0f, 1.0f) * (morph->frames() - 1);
+    const std::size_t k = (std::size_t)pos;
+    if (const MipTable* frame = morph->frame(k)) {
+        table = frame;
+        next = pos > k ? morph->frame(k + 1) : nullptr;
+        weight = next ? pos - k : 0.0f;
+    }
+}
+
+uint32_t SynthEngine::render_modulated(std::size_t osc, uint32_t phase, uint32_t inc, float gain, float* out, const ModPiece* pieces) const {
+    const BlockContext& b = block_ctx;
+    MorphTable* morph = morph_current[osc];
+    for (std::size_t done = 0; done < b.frames; ++pieces) {
+        const float* m = pieces->value;
+        const std::size_t n = pieces->frames;
+        float* o = out + pieces->first;
+        done += n;
+
+        uint32_t piece_inc = inc;
+        if (m[MOD_PITCH + osc] != 0.0f)
+            piece_inc = (uint32_t)std::min(inc * std::exp2(m[MOD_PITCH + osc] / 12.0), (double)UINT32_MAX);
+        const MipChoice mip = choose_mip_level(piece_inc);
+        const MipTable* table = b.table[osc];
+        const MipTable* next = b.morph_next[osc];
+        float w = b.morph_weight[osc];
+        if (morph && m[MOD_MORPH + osc] != 0.0f)
+            modulated_frames(osc, m[MOD_MORPH + osc], table, next, w);
+        else if (!morph && table->pulse_width > 0.0f && m[MOD_PW + osc] != 0.0f) {
+            // a pulse is a constant and two ramps, the width is how far apart the ramps are read
+            const float pw = std::clamp(table->pulse_width + m[MOD_PW + osc], MOD_MIN_PULSE_WIDTH, 1.0f - MOD_MIN_PULSE_WIDTH);
+            const uint32_t shift = (uint32_t)(int64_t)std::llround(pw * 4294967296.0);
+            render_channel(b.kernel[osc], ramp_levels(), mip, phase - shift, piece_inc, 2.0f * gain, o, n);
+            phase = render_channel(b.kernel[osc], ramp_levels(), mip, phase, piece_inc, -2.0f * gain, o, n);
+            const float dc = gain * (2.0f * pw - 1.0f);
+            for (std::size_t i = 0; i < n; ++i)
+                o[i] += dc;
+            continue;
+        }
+        if (w > 0.0f)
+            render_channel(b.kernel[osc], *next, mip, phase, piece_inc, gain * w, o, n);
+        phase = render_channel(b.kernel[osc], *table, mip, phase, piece_inc, gain * (1.0f - w), o, n);
+    }
+    return phase;
+}
+
+const float* SynthEngine::fm_table(std::size_t osc, uint32_t inc, const float* mod) const {
+    const BlockContext& b = block_ctx;
+    const MipTable* table = b.table[osc];
+    const MipTable* next = b.morph_next[osc];
+    float w = b.morph_weight[osc];
+    if (morph_current[osc] && mod[MOD_MORPH + osc] != 0.0f)
+        modulated_frames(osc, mod[MOD_MORPH + osc], table, next, w);
+    if (next && w >= 0.5f)
+        table = next;
+    const MipChoice mip = choose_mip_level(inc);
+    return table->level[mip.level + (mip.weight >= 0.5f ? 1 : 0)];
+}
+
+void SynthEngine::render_fm_voice(Voice& v, RenderScratch& tmp, const float* env, float level, unsigned modulated,
+    const ModPiece* pieces, float* left, float* right) const {
+    const BlockContext& b = block_ctx;
+    // every operator takes a per-sample gain, 1 where nothing moves it
+    const float* rows[3];
+    float scale[3];
+    for (std::size_t j = 0; j < 3; ++j) {
+        const bool carrier = b.fm_carriers >> j & 1;
+        float* g = tmp.lfo_gain[j];
+        if (modulated & (1u << j)) {
+            if (env)
+                for (std::size_t i = 0; i < b.frames; ++i)
+                    g[i] *= env[i];
+        }
+        else if (env)
+            std::copy(env, env + b.frames, g);
+        else
+            std::fill(g, g + b.frames, 1.0f);
+        if (carrier && (b.gain_ramping & (1u << j)))
+            for (std::size_t i = 0; i < b.frames; ++i)
+                g[i] *= b.gain_curve[j][i];
+        rows[j] = g;
+        scale[j] = (carrier ? b.gain[j] : b.fm_depth[j]) * v.velocity * level;
+    }
+
+    // a piece at a time when a route moves a pitch or a morph position, the operators read one
+    // level of one frame each and the pulse width has nothing to move
+    const ModPiece whole{ 0, (uint32_t)b.frames, {} };
+    uint32_t* phases[2] = { v.left_phase, v.right_phase };
+    const uint32_t* incs[2] = { v.left_inc, v.right_inc };
+    float* outs[2] = { left, right };
+    for (std::size_t ch = 0; ch < 2; ++ch) {
+        FmOperator ops[3];
+        for (std::size_t j = 0; j < 3; ++j) {
+            ops[j].phase = phases[ch][j];
+            ops[j].scale = scale[j];
+        }
+        const ModPiece* piece = pieces ? pieces : &whole;
+        for (std::size_t done = 0; done < b.frames; done += piece->frames, ++piece) {
+            const float* m = piece->value;
+            for (std::size_t j = 0; j < 3; ++j) {
+                uint32_t inc = incs[ch][j];
+                if (m[MOD_PITCH + j] != 0.0f)
+                    inc = (uint32_t)std::min(inc * std::exp2(m[MOD_PITCH + j] / 12.0), (double)UINT32_MAX);
+                ops[j].inc = inc;
+                ops[j].table = fm_table(j, inc, m);
+                ops[j].gain = rows[j] + piece->first;
+            }
+            b.fm_kernel(ops, b.fm_feedback, v.fm_history[ch], outs[ch] + piece->first, piece->frames);
+        }
+        for (std::size_t j = 0; j < 3; ++j)
+            phases[ch][j] = ops[j].phase;
+    }
+}
+
+void SynthEngine::render_chunk_job(void* engine, std::size_t chunk, unsigned worker) {
+    static_cast<SynthEngine*>(engine)->render_chunk(chunk, worker);
+}
+
+float SynthEngine::voice_cutoff(const Voice& voice) const {
+    return filter_cutoff + filter_settings.key_track * (voice.note - FILTER_KEY_CENTRE) / 12.0f;
+}
+
+void SynthEngine::render_chunk(std::size_t chunk, unsigned worker) {
+    const BlockContext& b = block_ctx;
+    RenderScratch& tmp = thread_scratch[worker];
+    float* chunk_left = chunks[chunk].left;
+    float* chunk_right = chunks[chunk].right;
+    std::fill(chunk_left, chunk_left + b.frames, 0.0f);
+    std::fill(chunk_right, chunk_right + b.frames, 0.0f);
+
+    // the chunk's envelopes all move on together, a voice whose level holds for the whole
+    // block just has it folded into its gain
+    const std::size_t first = chunk * CHUNK_VOICES;
+    float* env_rows[ENV_LANES];
+    for (std::size_t k = 0; k < ENV_LANES; ++k)
+        env_rows[k] = tmp.env_gain[k];
+    const unsigned moving = envelopes.advance(first, b.frames, env_rows, chunk_idle[chunk]);
+
+    // with a filter each voice goes into a row of its own first, and the rows are filtered and
+    // summed into the chunk together. without one the voices are mixed straight in
+    const bool filtered = filters.get_mode() != FilterMode::Off;
+    const float* filter_left[FILTER_LANES];
+    const float* filter_right[FILTER_LANES];
+    if (filtered) {
+        for (std::size_t k = 0; k < FILTER_LANES; ++k) {
+            std::fill(tmp.voice_left[k], tmp.voice_left[k] + b.frames, 0.0f);
+            std::fill(tmp.voice_right[k], tmp.voice_right[k] + b.frames, 0.0f);
+            filter_left[k] = tmp.voice_left[k];
+            filter_right[k] = tmp.voice_right[k];
+        }
+    }
+
+    // only the oscillators whose pitch, pulse width or morph position a route moves are cut up
+    // at the control points, and only a filter with a route to its cutoff keeps every point of it
+    const unsigned moved = mod_program.moved();
+    const unsigned piecewise = (moved >> MOD_PITCH | moved >> MOD_PW | moved >> MOD_MORPH) & 7u;
+    const bool cutoff_moved = filtered && mod_program.moves(MOD_CUTOFF);
+    unsigned cutoff_rows = 0;
+
+    const std::size_t end = std::min(active_count, first + CHUNK_VOICES);
+    for (std::size_t a = first; a < end; ++a) {
+        Voice& v = voices[active[a]];
+        const float* env = moving & (1u << (a - first)) ? env_rows[a - first] : nullptr;
+        const float level = env ? 1.0f : envelopes.level_of(a);
+        // silent for the whole block, nothing to add
+        if (level == 0.0f)
+            continue;
+        float* left = filtered ? tmp.voice_left[a - first] : chunk_left;
+        float* right = filtered ? tmp.voice_right[a - first] : chunk_right;
+        const unsigned modulated = fill_lfo_gains(v, b.lfo_table, tmp.lfo_gain, env, level,
+            piecewise ? tmp.mod_pieces : nullptr, cutoff_moved ? tmp.cutoff_mod[a - first] : nullptr, b.frames);
+        if (cutoff_moved)
+            cutoff_rows |= 1u << (a - first);
+        if (b.fm_kernel) {
+            render_fm_voice(v, tmp, env, level, modulated, piecewise ? tmp.mod_pieces : nullptr, left, right);
+            continue;
+        }
+        for (std::size_t j = 0; j < 3; ++j) {
+            const float voice_gain = b.gain[j] * v.velocity * level;
+            auto channel = [&](uint32_t phase, uint32_t inc, MipChoice mip, float* out) {
+                return piecewise >> j & 1 ? render_modulated(j, phase, inc, voice_gain, out, tmp.mod_pieces) : render_osc(j, mip, phase, inc, voice_gain, out);
+            };
+            const float* g = env;
+            if (modulated & (1u << j)) {
+                g = tmp.lfo_gain[j];
+                if (env)
+                    for (std::size_t i = 0; i < b.frames; ++i)
+                        tmp.lfo_gain[j][i] *= env[i];
+            }
+            if (b.gain_ramping & (1u << j)) {
+                const float* curve = b.gain_curve[j];
+                if (g == tmp.lfo_gain[j])
+                    for (std::size_t i = 0; i < b.frames; ++i)
+                        tmp.lfo_gain[j][i] *= curve[i];
+                else if (g)
+                    for (std::size_t i = 0; i < b.frames; ++i)
+                        tmp.lfo_gain[j][i] = g[i] * curve[i];
+                g = g ? tmp.lfo_gain[j] : curve;
+            }
+            if (!g) {
+                v.left_phase[j] = channel(v.left_phase[j], v.left_inc[j], v.left_mip[j], left);
+                v.right_phase[j] = channel(v.right_phase[j], v.right_inc[j], v.right_mip[j], right);
+                continue;
+            }
+            // amplitude modulated, render each channel on its own and apply the per-sample gain while mixing it in
+            std::fill(tmp.osc_tmp, tmp.osc_tmp + b.frames, 0.0f);
+            v.left_phase[j] = channel(v.left_phase[j], v.left_inc[j], v.left_mip[j], tmp.osc_tmp);
+            for (std::size_t i = 0; i < b.frames; ++i)
+                left[i] += g[i] * tmp.osc_tmp[i];
+            std::fill(tmp.osc_tmp, tmp.osc_tmp + b.frames, 0.0f);
+            v.right_phase[j] = channel(v.right_phase[j], v.right_inc[j], v.right_mip[j], tmp.osc_tmp);
+            for (std::size_t i = 0; i < b.frames; ++i)
+                right[i] += g[i] * tmp.osc_tmp[i];
+        }
+    }
+    if (!filtered)
+        return;
+
+    // the coefficients are aimed at each voice's cutoff on the lfos' control grid and ramped
+    // between, the kernel only ever adds its steps
+    for (std::size_t i = 0, left = control_left, point = 0; i < b.frames;) {
+        if (left == 0) {
+            float cutoff[FILTER_LANES];
+            for (std::size_t a = first; a < end; ++a) {
+                const Voice& v = voices[active[a]];
+                cutoff[a - first] = voice_cutoff(v);
+                // a voice that was silent all block holds where its routes last had it
+                if (cutoff_moved)
+                    cutoff[a - first] += cutoff_rows >> (a - first) & 1 ? tmp.cutoff_mod[a - first][point] : v.mod[MOD_CUTOFF];
+            }
+            ++point;
+            filters.aim(chunk, cutoff, end - first, control_block);
+            left = control_block;
+        }
+        const std::size_t n = std::min(left, b.frames - i);
+        filters.run(chunk, filter_left, filter_right, chunk_left, chunk_right, i, n);
+        left -= n;
+        i += n;
+    }
+}
+
+void SynthEngine::render(float* out, unsigned long framesPerBuffer) {
+    const auto started = std::chrono::steady_clock::now();
+    blocks_started.fetch_add(1);
+    drain_params(std::chrono::duration_cast<std::chrono::nanoseconds>(started.time_since_epoch()).count());
+
+    // everything below only touches plain locals, the voices and the scratch buffers
+    Wavetable_t* osc[3] = { &m_oscA, &m_oscB, &m_oscC };
+    for (std::size_t j = 0; j < 3; ++j) {
+        block_ctx.table[j] = osc[j]->shared.acquire(presets_reached);
+        block_ctx.lfo_table[j] = oscillators[j].second->shared.acquire(presets_reached)->level[0];
+        block_ctx.kernel[j] = osc_kernels[(std::size_t)block_params.osc[j].interp];
+        pick_morph_frames(j);
+    }
+    // half the feedback, it is applied to the sum of two outputs
+    block_ctx.fm_kernel = select_fm_kernel(fm_algorithm, fm_feedback > 0.0f);
+    block_ctx.fm_carriers = FM_CARRIERS[(std::size_t)fm_algorithm];
+    block_ctx.fm_feedback = (float)(0.5 * fm_feedback * FM_MAX_FEEDBACK * 4294967296.0);
+
+    // a song splits the block at each of its events, so they land on their exact frame
+    for (unsigned long done = 0; done < framesPerBuffer;) {
+        const unsigned long frames = run_sequence(framesPerBuffer - done);
+        render_segment(out + 2 * done, frames);
+        done += frames;
+        sequence_frame += frames;
+    }
+    fresh = false;
+
+    // publish the newest voice's phases once per block, the gui only reads them for display
+    sounding_voices.store((unsigned)active_count, std::memory_order_relaxed);
+    sequence_position.store(sequence ? sequence_frame / rate : 0.0, std::memory_order_relaxed);
+    for (std::size_t j = 0; newest && j < 3; ++j) {
+        osc[j]->ps.left_phase.store(phase_to_index(newest->left_phase[j]), std::memory_order_relaxed);
+        osc[j]->ps.right_phase.store(phase_to_index(newest->right_phase[j]), std::memory_order_relaxed);
+        oscillators[j].second->ps.left_phase.store(phase_to_index(newest->lfo[j].phase), std::memory_order_relaxed);
+    }
+    capture.write(out, framesPerBuffer);
+
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    perf.record_block(ns, 1e9 * framesPerBuffer / rate);
+}
+
+void SynthEngine::set_voice_increments() {
+    // every voice plays the oscillators transposed by its note, which also decides its table levels
+    for (std::size_t a = 0; a < active_count; ++a) {
+        Voice& v = voices[active[a]];
+        const double pitch = v.pitch * bend;
+        for (std::size_t j = 0; j < 3; ++j) {
+            v.left_inc[j] = (uint32_t)std::min(left_inc_ramp[j].value() * pitch, (double)UINT32_MAX);
+            v.right_inc[j] = (uint32_t)std::min(right_inc_ramp[j].value() * pitch, (double)UINT32_MAX);
+            v.left_mip[j] = choose_mip_level(v.left_inc[j]);
+            v.right_mip[j] = choose_mip_level(v.right_inc[j]);
+        }
+    }
+}
+
+void SynthEngine::render_segment(float* out, std::size_t frames_total) {
+    // gains and increments head for whatever was last set, over the smoothing time
+    const uint32_t ramp = fresh ? 0 : smoothing_samples;
+    const float mix[3] = { a_amp, b_amp, c_amp };
+    for (std::size_t j = 0; j < 3; ++j) {
+        gain_ramp[j].aim(block_params.amplitude * mix[j] * block_params.osc[j].amp * midi_volume, ramp);
+        left_inc_ramp[j].aim(block_params.osc[j].left_inc, ramp);
+        right_inc_ramp[j].aim(block_params.osc[j].right_inc, ramp);
+        depth_ramp[j].aim(block_params.osc[j].amp * FM_DEPTH, ramp);
+    }
+
+    bool stale = true;
+    for (std::size_t done = 0, frames = 0; done < frames_total; done += frames) {
+        // a gliding increment can't change inside a kernel, so it moves on once per control
+        // block with every voice's increments worked out again. settled, once per segment
+        // and so does a modulator's depth, the operators take one depth per call
+        bool gliding = false;
+        for (std::size_t j = 0; j < 3; ++j) {
+            gliding |= left_inc_ramp[j].moving() || right_inc_ramp[j].moving();
+            gliding |= block_ctx.fm_kernel && depth_ramp[j].moving();
+        }
+        frames = std::min<std::size_t>(gliding ? control_block : MAX_BLOCK, frames_total - done);
+        // a release running out ends the stretch, so its voice is let go of on that very sample
+        // and the voices after it are summed in the same order whatever blocks a song is cut into
+        for (std::size_t a = 0; a < active_count; ++a)
+            frames = std::min<std::size_t>(frames, envelopes.release_left(a));
+        if (stale || gliding)
+            set_voice_increments();
+        stale = gliding;
+
+        // a gliding gain becomes a per-sample curve shared by every voice, settled it's one number
+        block_ctx.gain_ramping = 0;
+        for (std::size_t j = 0; j < 3; ++j) {
+            block_ctx.gain[j] = (float)gain_ramp[j].value();
+            block_ctx.fm_depth[j] = (float)(depth_ramp[j].value() * 4294967296.0);
+            if (gain_ramp[j].moving()) {
+                gain_ramp[j].fill(block_ctx.gain_curve[j], frames);
+                block_ctx.gain[j] = 1.0f;
+                block_ctx.gain_ramping |= 1u << j;
+            }
+        }
+        // each chunk of voices is mixed into its own planar buffers by whichever render thread takes it,
+        // the chunks are summed in order and the channels only interleaved once at the very end
+        const std::size_t chunk_count = (active_count + CHUNK_VOICES - 1) / CHUNK_VOICES;
+        block_ctx.frames = frames;
+        pool->run(chunk_count, &SynthEngine::render_chunk_job, this);
+        for (std::size_t j = 0; j < 3; ++j) {
+            gain_ramp[j].advance(frames);
+            depth_ramp[j].advance(frames);
+            left_inc_ramp[j].advance(frames);
+            right_inc_ramp[j].advance(frames);
+        }
+
+        std::fill(scratch_left, scratch_left + frames, 0.0f);
+        std::fill(scratch_right, scratch_right + frames, 0.0f);
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            for (std::size_t i = 0; i < frames; ++i) {
+                scratch_left[i] += chunks[c].left[i];
+                scratch_right[i] += chunks[c].right[i];
+            }
+        }
+
+        // every voice ticked its lfos on the same grid, move it along once for all of them
+        for (std::size_t i = 0; i < frames;) {
+            if (control_left == 0)
+                control_left = control_block;
+            const std::size_t n = std::min<std::size_t>(control_left, frames - i);
+            control_left -= (unsigned)n;
+            i += n;
+        }
+
+        float* o = out + 2 * done;
+        for (std::size_t i = 0; i < frames; ++i) {
+            o[2 * i] = scratch_left[i];
+            o[2 * i + 1] = scratch_right[i];
+        }
+
+        // voices whose release has run out are let go of now their last samples are out. from the
+        // top down, so the voice moved into a freed slot has already been looked at
+        for (std::size_t slot = chunk_count * CHUNK_VOICES; slot-- > 0;)
+            if (slot < active_count && (chunk_idle[slot / CHUNK_VOICES] >> (slot % CHUNK_VOICES) & 1))
+                stop_voice(voices[active[slot]]);
+    }
+}
@@ -0,0 +1,491 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "wavetable.h"
+#include "bandlimit.h"
+#include "spsc_queue.h"
+#include "osc_kernel.h"
+#include "fm_kernel.h"
+#include "render_pool.h"
+#include "perf_stats.h"
+#include "capture_ring.h"
+#include "morph_table.h"
+#include "preset.h"
+#include "midi_file.h"
+#include "envelope.h"
+#include "filter.h"
+#include "modulation.h"
+#include "ramp.h"
+
+// the rate the stream runs at unless told otherwise
+constexpr unsigned DEFAULT_SAMPLE_RATE = 48000;
+// gui phase increments and lfo rates mean what they did at this rate, whatever the stream runs at
+constexpr double REFERENCE_RATE = 48000.0;
+// longer callbacks are rendered in pieces of at most this many frames
+constexpr auto MAX_BLOCK = 512;
+// lfos are evaluated once every this many samples unless told otherwise,
+// with their output ramped linearly in between
+constexpr auto DEFAULT_CONTROL_BLOCK = 32;
+// gain and pitch changes glide over this many seconds unless told otherwise, and at most this long
+constexpr float DEFAULT_SMOOTHING = 0.01f;
+constexpr float MAX_SMOOTHING = 1.0f;
+// lfo rates keep the meaning they had when the gui stepped lfos 600 times a second
+constexpr float LFO_TICK_RATE = 600.0f;
+// size of the voice pool when none is given, fixed for the life of the engine
+constexpr std::size_t DEFAULT_VOICES = 64;
+constexpr std::size_t MAX_VOICES = 1024;
+// the midi note that plays the oscillators at exactly their gui increments (A1, 55 Hz at increment 1)
+constexpr int BASE_NOTE = 33;
+// semitones a full pitch bend moves every voice either way, the general midi default
+constexpr double PITCH_BEND_RANGE = 2.0;
+// voices are rendered in chunks of this many, each chunk is one task for the render threads
+constexpr std::size_t CHUNK_VOICES = 8;
+// frames of finished output kept for the oscilloscope, about 0.7 s at 48 kHz
+constexpr std::size_t CAPTURE_FRAMES = 1 << 15;
+// remote changes queued for the audio thread, and as many again it holds on to until they are
+// due. only past that many waiting does a change that is due wait behind them in the queue
+constexpr std::size_t REMOTE_QUEUE = 4096;
+
+// parameters the gui can change while the stream is running
+enum class Param : unsigned char {
+    OscAmp,
+    LeftPhaseInc,
+    RightPhaseInc,
+    PhaseReset,
+    MasterAmp,
+    LfoRate,
+    LfoDepth,
+    LfoEnable,    // value is 0 or 1
+    LfoSync,      // restarts the lfo of osc, value is ignored
+    ControlBlock, // samples between lfo evaluations, global
+    NoteOn,       // index is the note, value the velocity 0-1
+    NoteOff,      // index is the note, value is ignored
+    AllNotesOff,
+    StealPolicy,  // value is a VoiceSteal, global
+    Interpolation, // value is an Interp
+    MorphPosition, // 0-1 through the frames of the osc's morph table
+    PresetLoaded,  // ends the messages of a preset, only sent by apply_preset
+    SequenceStart, // (re)starts the sequence given to set_sequence, only sent by it
+    EnvSegments,   // how many segments the envelope has before its release, global
+    EnvSustain,    // the segment it holds at while the note is down, -1 for none, global
+    EnvLevel,      // index is the segment, level 0-1
+    EnvTime,       // index is the segment or ENV_MAX_SEGMENTS for the release, seconds
+    EnvCurve,      // the same, 0 straight to 1 most curved
+    FilterType,    // value is a FilterMode, global
+    FilterCutoff,  // Hz at FILTER_KEY_CENTRE, global
+    FilterResonance, // 0-1, global
+    FilterKeyTrack,  // 0-1, global
+    SmoothingTime,   // seconds gain and increment changes glide over, 0 steps straight there, global
+    ModRoutes,     // how many routes the modulation matrix has, global
+    ModSource,     // index is the route, value a ModSource
+    ModController, // the cc a route follows, for ModSource::Controller
+    ModDest,       // a ModDest
+    ModOsc,        // the oscillator it moves, 0-2 or MOD_ALL_OSCS
+    ModDepth,      // in the destination's units
+    Controller,    // index is the cc, value 0-1, what the mod wheel and friends send
+    FmAlgorithm,   // value is an FmAlgorithm, global
+    FmFeedback,    // 0-1, how far A modulates itself, global
+};
+
+// which voice a note-on takes over when every voice in the pool is sounding
+enum class VoiceSteal : unsigned char {
+    Oldest,   // the voice that started longest ago
+    Quietest, // the voice with the lowest level
+    SameNote, // retrigger a voice already playing the note, otherwise the oldest
+};
+
+// a single parameter change on its way to the audio thread
+struct ParamMsg {
+    Param id;
+    unsigned char index; // into oscillators, or the note for note events, ignored for global params
+    float value;
+};
+
+// a parameter change from a thread other than the gui, held back until the block that starts
+// at or after time_ns on the steady clock
+struct TimedParam {
+    ParamMsg msg;
+    int64_t time_ns;
+};
+
+// the steady clock in ns, what remote parameter changes are timed with
+inline int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// plain, non-atomic copy of everything the callback needs for one block
+struct OscBlockParams {
+    float amp;
+    uint32_t left_inc;  // fixed point, see phase_inc_to_fixed
+    uint32_t right_inc;
+    Interp interp;
+    float morph;
+};
+
+struct BlockParams {
+    float amplitude;
+    OscBlockParams osc[3];
+};
+
+// lfo settings shared by every voice
+struct LfoSettings {
+    uint32_t inc;   // fixed point per sample
+    float depth;
+    bool enabled;
+};
+
+// the running state of one lfo in one voice, its output is a gain ramped between control points
+struct LfoState {
+    uint32_t phase;
+    float gain;     // gain at the last control point
+    float target;   // gain at the next control point
+    float step;     // gain added every sample since the last control point
+};
+
+// one note being played through all three oscillators, owned by the audio thread
+struct Voice {
+    uint32_t left_phase[3];
+    uint32_t right_phase[3];
+    LfoState lfo[3];
+    float mod[MOD_TARGETS]; // every modulation route summed, as of the last control point
+    float fm_history[2][2]; // A's last two outputs in each channel, for its feedback
+    double pitch;        // ratio applied to the oscillator increments
+    float velocity;
+    uint64_t started;    // note-on order, for stealing the oldest
+    unsigned slot;       // position in the active list, and its lane of the envelope and filter banks
+    unsigned char note;
+    bool sustained;      // let go of while the sustain pedal was down, stops when it comes up
+    bool released;       // in its envelope's release, stopped once that runs out
+    // worked out at the start of every block from pitch and the block parameters
+    uint32_t left_inc[3];
+    uint32_t right_inc[3];
+    MipChoice left_mip[3];
+    MipChoice right_mip[3];
+};
+
+// one chunk of voices mixed down, the chunks are summed into the output in a fixed order
+// so the result is the same whichever thread rendered which chunk
+struct alignas(64) VoiceChunk {
+    float left[MAX_BLOCK];
+    float right[MAX_BLOCK];
+};
+
+// a stretch of a voice's block between two control points, and its modulation over it
+struct ModPiece {
+    uint32_t first;
+    uint32_t frames;
+    float value[MOD_TARGETS];
+};
+
+// working space for one render thread
+struct alignas(64) RenderScratch {
+    // per-sample lfo gain for each oscillator, and one unmodulated oscillator channel
+    float lfo_gain[3][MAX_BLOCK];
+    float osc_tmp[MAX_BLOCK];
+    // per-sample envelope of each voice of the chunk whose level moves in the block
+    float env_gain[ENV_LANES][MAX_BLOCK];
+    // each voice of the chunk on its own, on its way through the filters
+    float voice_left[FILTER_LANES][MAX_BLOCK];
+    float voice_right[FILTER_LANES][MAX_BLOCK];
+    // the voice being rendered cut up at its control points, when its pitch, pulse width or
+    // morph position is modulated, and each voice's cutoff offset at every control point
+    ModPiece mod_pieces[MAX_BLOCK];
+    float cutoff_mod[FILTER_LANES][MAX_BLOCK];
+};
+
+static_assert(CHUNK_VOICES == ENV_LANES, "a chunk's envelopes are advanced together");
+static_assert(CHUNK_VOICES == FILTER_LANES, "a chunk's voices are filtered together");
+
+// messages that set a whole envelope, see SynthEngine::set_envelope
+constexpr std::size_t ENV_PARAMS = 2 + 3 * (ENV_MAX_SEGMENTS + 1);
+// and a whole filter, see SynthEngine::set_filter
+constexpr std::size_t FILTER_PARAMS = 4;
+// and a whole modulation matrix at most, see SynthEngine::set_modulation
+constexpr std::size_t MOD_PARAMS = 1 + 5 * MOD_MAX_ROUTES;
+
+// what every chunk needs to know about the block being rendered, set up before the chunks run
+struct BlockContext {
+    // the osc's own table, or the morph frame at or before its position
+    const MipTable* table[3];
+    // the morph frame after that one and how much of it to mix in, weight 0 if there isn't one
+    const MipTable* morph_next[3];
+    float morph_weight[3];
+    const float* lfo_table[3];
+    float gain[3];
+    // the oscillators whose gain is gliding in this piece, with gain 1 and the glide per sample here
+    unsigned gain_ramping;
+    float gain_curve[3][MAX_BLOCK];
+    OscKernel kernel[3];
+    // the operator kernel, nullptr to mix the oscillators. which oscillators are heard, each
+    // modulator's depth and A's feedback, in fixed point phase
+    FmKernel fm_kernel;
+    unsigned fm_carriers;
+    float fm_depth[3];
+    float fm_feedback;
+    std::size_t frames;
+};
+
+// frequency ratio of a note relative to BASE_NOTE
+inline double note_pitch(int note) {
+    return std::exp2((note - BASE_NOTE) / 12.0);
+}
+
+// one point of lfo history for the gui, depth * lfo value for each oscillator
+struct LfoFrame {
+    float value[3];
+};
+
+// gui lfo rate to a fixed point increment per sample at the given sample rate
+inline uint32_t lfo_rate_to_fixed(float rate, double sample_rate) {
+    return phase_inc_to_fixed((float)(rate * LFO_TICK_RATE / sample_rate));
+}
+
+// all of the dsp state and the block renderer, with no dependency on an audio device
+// Synth wraps this in a PortAudio stream, the offline tools drive render() directly
+class SynthEngine
+{
+private:
+    float a_amp;
+    float b_amp;
+    float c_amp;
+    // changes from the gui, drained once per block into block_params
+    SpscQueue<ParamMsg, 256> param_queue;
+    // changes from the one remote control thread, e.g. the osc server, drained after the gui's
+    SpscQueue<TimedParam, REMOTE_QUEUE> remote_queue;
+    // remote changes taken off the queue before they were due, in time order. one bundled for
+    // later waits here rather than at the front of the queue, so the ones behind it aren't held up
+    std::unique_ptr<TimedParam[]> remote_held;
+    std::size_t remote_held_count{ 0 };
+    BlockParams block_params;
+    // the voice pool, allocated once at construction and only touched by the audio thread.
+    // active holds the indices of the sounding voices packed at the front, free the rest
+    std::size_t voice_count;
+    std::unique_ptr<Voice[]> voices;
+    std::unique_ptr<uint16_t[]> active;
+    std::unique_ptr<uint16_t[]> free_voices;
+    std::size_t active_count{ 0 };
+    std::size_t free_count{ 0 };
+    uint64_t notes_started{ 0 };
+    Voice* newest{ nullptr }; // the voice the gui displays phases and lfo history for
+    VoiceSteal steal_policy{ VoiceSteal::Oldest };
+    // lfo settings and the control rate grid they are evaluated on, audio thread only
+    LfoSettings lfo_settings[3]{};
+    unsigned control_block{ DEFAULT_CONTROL_BLOCK };
+    unsigned control_left{ 0 };
+    unsigned history_left{ 0 };
+    unsigned history_period{ (unsigned)(DEFAULT_SAMPLE_RATE / LFO_TICK_RATE) };
+    // the stream's rate, and what gui increments are multiplied by to keep their pitch at it
+    double rate{ DEFAULT_SAMPLE_RATE };
+    float rate_scale{ 1.0f };
+    // lfo history on its way to the gui
+    SpscQueue<LfoFrame, 1024> lfo_feed;
+    // planar per-channel buffers the chunks are summed into before interleaving
+    float scratch_left[MAX_BLOCK];
+    float scratch_right[MAX_BLOCK];
+    // one mixdown per possible chunk of the pool, and the threads that render them
+    std::unique_ptr<VoiceChunk[]> chunks;
+    std::unique_ptr<RenderPool> pool;
+    std::unique_ptr<RenderScratch[]> thread_scratch;
+    BlockContext block_ctx{};
+    // one kernel per interpolation mode
+    OscKernel osc_kernels[INTERP_MODES];
+    // morph tables set by the gui, and the audio thread's view of them. render() counts blocks
+    // before it reads the tables, so the gui can tell when a replaced table is finished with
+    std::atomic<MorphTable*> morph_tables[3]{};
+    std::atomic<uint64_t> blocks_started{ 0 };
+    MorphTable* morph_current[3]{};
+    const MipTable* morph_last[3]{}; // the last frame played, for when the next isn't built yet
+    // presets applied by the gui and presets whose messages the audio thread has drained,
+    // tables published for a preset are only taken once the two match
+    uint32_t presets_sent{ 0 };
+    uint32_t presets_reached{ 0 };
+    // the song set by the gui, and the audio thread's place in it. the block is split at every
+    // event so each one lands on its exact frame, whatever the buffer size
+    std::atomic<const MidiSequence*> sequence_set{ nullptr };
+    const MidiSequence* sequence{ nullptr };
+    std::size_t sequence_next{ 0 };
+    uint64_t sequence_frame{ 0 };
+    // midi controller state, audio thread only
+    double bend{ 1.0 };       // pitch ratio
+    float midi_volume{ 1.0f };
+    bool sustain{ false };
+    // every voice's envelope by active slot, the shape they follow as the messages built it,
+    // and which lanes of each chunk finished their release in the last block rendered
+    EnvelopeBank envelopes;
+    EnvelopeShape envelope_shape{ gate_envelope() };
+    bool envelope_changed{ false };
+    std::unique_ptr<unsigned[]> chunk_idle;
+    // what the oscillators' gains and increments are gliding towards, the target of each is set
+    // once per segment and they only cost anything while they move. the first block after a
+    // start jumps straight to them so a patch doesn't fade in
+    LinearRamp gain_ramp[3];
+    LinearRamp left_inc_ramp[3];
+    LinearRamp right_inc_ramp[3];
+    float smoothing_time{ DEFAULT_SMOOTHING };
+    uint32_t smoothing_samples{ 0 };
+    bool fresh{ true };
+    // every voice's filter by active slot, and the settings they follow. filter_cutoff is
+    // log2 of the cutoff over the rate, what key tracking and the filters work in
+    FilterBank filters;
+    FilterSettings filter_settings{ default_filter() };
+    float filter_cutoff{ 0.0f };
+    // the routes as the messages built them, flattened into mod_program once they're all in,
+    // and the midi controllers they can follow
+    ModMatrix mod_matrix{ empty_matrix() };
+    bool mod_changed{ false };
+    ModProgram mod_program;
+    float controllers[MOD_CONTROLLERS]{};
+    // how the oscillators are wired, and the modulators' depths in cycles gliding like the gains
+    FmAlgorithm fm_algorithm{ FmAlgorithm::Additive };
+    float fm_feedback{ 0.0f };
+    LinearRamp depth_ramp[3];
+public:
+    // GENERAL
+    Wavetable_t m_oscA;
+    Wavetable_t m_oscB;
+    Wavetable_t m_oscC;
+    LFO_t m_lfoA;
+    LFO_t m_lfoB;
+    LFO_t m_lfoC;
+    std::vector<std::pair<Wavetable_t*, LFO_t*>> oscillators {{ &m_oscA, & m_lfoA}, { &m_oscB, &m_lfoB }, { &m_oscC, &m_lfoC }};
+    std::atomic<float> amplitude{ 0.1f };
+    // the last control block and steal policy sent, so presets can be saved with them
+    std::atomic<int> control_samples{ DEFAULT_CONTROL_BLOCK };
+    std::atomic<int> voice_steal{ (int)VoiceSteal::Oldest };
+    // the last smoothing time sent, for display
+    std::atomic<float> smoothing{ DEFAULT_SMOOTHING };
+    // the last fm algorithm and feedback sent, so presets can be saved with them
+    std::atomic<int> operator_algorithm{ (int)FmAlgorithm::Additive };
+    std::atomic<float> operator_feedback{ 0.0f };
+    // the envelope, filter and modulation as last sent, gui thread only
+    EnvelopeShape envelope_sent{ gate_envelope() };
+    FilterSettings filter_sent{ default_filter() };
+    ModMatrix mod_sent{ empty_matrix() };
+    // how many voices were sounding at the end of the last block, for display
+    std::atomic<unsigned> sounding_voices{ 0 };
+    // seconds of the sequence played so far, for display
+    std::atomic<double> sequence_position{ 0.0 };
+    // remote changes applied, and the longest any of them waited past its time for a block
+    std::atomic<uint64_t> remote_applied{ 0 };
+    std::atomic<int64_t> remote_peak_wait_ns{ 0 };
+    // remote changes mirrored into the atomics above, the gui catches its controls up when it moves
+    std::atomic<uint64_t> remote_mirrored{ 0 };
+    // render time of every block against its budget, plus xruns when there is a stream
+    PerfStats perf;
+    // every block exactly as it was handed to the device, for the oscilloscope
+    CaptureRing<CAPTURE_FRAMES> capture;
+
+public:
+    explicit SynthEngine(std::size_t max_voices = DEFAULT_VOICES);
+    // gui thread only, updates the atomic mirror in OscSettings and queues the change
+    // returns false if the queue is full, in which case nothing was changed
+    bool set_param(Param id, std::size_t osc, float value);
+    // same thread as set_param, the note starts or stops at the next block
+    bool note_on(int note, float velocity) { return set_param(Param::NoteOn, (std::size_t)note, velocity); }
+    bool note_off(int note) { return set_param(Param::NoteOff, (std::size_t)note, 0.0f); }
+    bool all_notes_off() { return set_param(Param::AllNotesOff, 0, 0.0f); }
+    // the remote control thread only, queues a change for the first block starting at or after
+    // time_ns and mirrors it into the gui's atomics straight away. returns false if the queue is full
+    bool push_remote(const ParamMsg& msg, int64_t time_ns);
+    std::size_t max_voices() const { return voice_count; }
+    // same thread as set_param, switches every voice to shape at the start of one block. notes
+    // in a segment finish it first, held notes glide to the new sustain. returns false without
+    // changing anything if the queue is too full
+    bool set_envelope(const EnvelopeShape& shape);
+    // same thread as set_param, every field of the filter in one block. notes carry on through
+    // it, except that a change of mode starts every filter again from silence
+    bool set_filter(const FilterSettings& settings);
+    // same thread as set_param, every route in one block. returns false without changing
+    // anything if the queue is too full
+    bool set_modulation(const ModMatrix& matrix);
+    // same thread as set_param, a midi controller the routes can follow, value 0-1
+    bool set_controller(int cc, float value) { return set_param(Param::Controller, (std::size_t)cc, value); }
+    // gui thread, switches the whole patch at the start of one block. the tables are rebuilt here
+    // but held back until the block that drains the preset's parameters, which all go in the queue
+    // at once. notes keep playing. returns false without changing anything if the queue is too full
+    bool apply_preset(const Preset& preset);
+    // gui thread, the patch as last sent, with no name or tags
+    Preset capture_preset() const;
+    // renders one block of interleaved stereo, this is what the stream callback runs
+    void render(float* out, unsigned long framesPerBuffer);
+    // how many threads render the voices, counting the audio thread itself. starts at 1,
+    // only change it while nothing is calling render()
+    void set_render_threads(unsigned threads);
+    unsigned render_threads() const { return pool->size(); }
+    // rescales every increment and lfo rate so the patch sounds the same at the new rate, the
+    // next block starts like the first. only change it while nothing is calling render()
+    void set_sample_rate(double sample_rate);
+    double sample_rate() const { return rate; }
+    // picked from the cpu features at construction, can be overridden for benchmarking
+    void set_osc_kernel(OscKernel kernel, Interp mode = Interp::Linear) { osc_kernels[(std::size_t)mode] = kernel; }
+    void set_env_kernel(EnvKernel kernel) { envelopes.set_kernel(kernel); }
+    void set_filter_kernels(const FilterKernels& kernels) { filters.set_kernels(kernels); }
+    // gui thread, from the next block on osc plays the frames of table, morphing through them
+    // with Param::MorphPosition, or its own table again if table is nullptr. the engine doesn't
+    // own the table: the one it replaced may be read until block_passed() is true for the ticket returned
+    uint64_t set_morph_table(std::size_t osc, MorphTable* table);
+    bool block_passed(uint64_t ticket) const { return blocks_started.load() > ticket; }
+    // gui thread, stops every note and plays sequence from its start at the next block, or just
+    // stops if sequence is nullptr. the engine doesn't own it: the one it replaced may be read
+    // until block_passed() is true for ticket. returns false if the queue is full
+    bool set_sequence(const MidiSequence* sequence, uint64_t& ticket);
+    // gui thread, the next point of lfo history published by the audio thread
+    bool pop_lfo_frame(LfoFrame& frame) { return lfo_feed.pop(frame); }
+private:
+    // keeps the atomics the gui reads in step with a change that was queued
+    void mirror_param(Param id, std::size_t osc, float value);
+    // the part of mirror_param any thread may do, false if id isn't kept in an atomic
+    bool mirror_atomic(Param id, std::size_t osc, float value);
+    // applies every gui change, and the remote changes that are due by now_ns
+    void drain_params(int64_t now_ns);
+    void apply_param(const ParamMsg& msg);
+    // points block_ctx at the morph frames either side of osc's position, if it has a morph table
+    void pick_morph_frames(std::size_t osc);
+    // gui phase increment to a fixed point one at the current sample rate
+    uint32_t osc_inc_to_fixed(float inc) const { return phase_inc_to_fixed(inc * rate_scale); }
+    // applies every sequence event due at the current frame, then returns how many of the
+    // next frames can be rendered before the one after, at most frames
+    unsigned long run_sequence(unsigned long frames);
+    void apply_midi(const MidiEvent& event);
+    // renders frames with no events in them
+    void render_segment(float* out, std::size_t frames);
+    // every voice's increments and table levels from the ramps, its note and the pitch bend
+    void set_voice_increments();
+    void start_voice(int note, float velocity);
+    // releases every voice playing note, or holds it if the sustain pedal is down
+    void release_note(int note);
+    // starts the voice's release, or stops it there and then if the release takes no time
+    void release_voice(Voice& voice);
+    void stop_voice(Voice& voice);
+    Voice& steal_voice();
+    // fills lfo_gain with the next frames samples of one voice's lfos, ticking them at each
+    // control point of the grid starting control_left samples away. the modulation routes are
+    // summed at the same points, from the lfos, the envelope (env, or level where it holds) and
+    // the controllers. pieces gets the voice's modulation over each stretch between the points
+    // and cutoff its cutoff offset at each point, unless they are nullptr. the newest voice also
+    // feeds the gui history. returns which oscillators have a gain other than 1 in the block
+    unsigned fill_lfo_gains(Voice& voice, const float* const* lfo_tables, float (*lfo_gain)[MAX_BLOCK], const float* env, float level,
+        ModPiece* pieces, float* cutoff, std::size_t frames);
+    // log2 of the voice's cutoff over the rate, key tracked from filter_cutoff
+    float voice_cutoff(const Voice& voice) const;
+    // mixes one chunk of the active voices into chunks[chunk], run by the render threads
+    void render_chunk(std::size_t chunk, unsigned worker);
+    static void render_chunk_job(void* engine, std::size_t chunk, unsigned worker);
+    // one oscillator channel of the block, crossfaded into the next morph frame if there is one
+    uint32_t render_osc(std::size_t osc, MipChoice mip, uint32_t phase, uint32_t inc, float gain, float* out) const;
+    // the same for a voice whose pitch, pulse width or morph position is modulated, a piece at a
+    // time with the increment, table levels and frames of each
+    uint32_t render_modulated(std::size_t osc, uint32_t phase, uint32_t inc, float gain, float* out, const ModPiece* pieces) const;
+    // the morph frames osc plays with a route moving its position by offset, the block's own if
+    // that frame isn't built yet
+    void modulated_frames(std::size_t osc, float offset, const MipTable*& table, const MipTable*& next, float& weight) const;
+    // all three oscillators of one voice as operators, through block_ctx.fm_kernel. a carrier's
+    // gain is worked out as it is for the mix, a modulator's depth follows the same lfo, routes,
+    // envelope and velocity but not the volumes. pieces is nullptr unless routes cut it up
+    void render_fm_voice(Voice& voice, RenderScratch& tmp, const float* env, float level, unsigned modulated,
+        const ModPiece* pieces, float* left, float* right) const;
+    // the level an operator reads, the nearest of the ones a crossfade would mix
+    const float* fm_table(std::size_t osc, uint32_t inc, const float* mod) const;
+    static uint32_t render_channel(OscKernel kernel, const MipTable& mips, MipChoice mip, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+};
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <complex>
+#include <vector>
+#include "bandlimit.h"
+
+// in place iterative radix-2 fft, n must be a power of two
+static void fft(std::complex<double>* a, int n, bool inverse) {
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(a[i], a[j]);
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        const double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+        const std::complex<double> wlen(std::cos(angle), std::sin(angle));
+        for (int i = 0; i < n; i += len) {
+            std::complex<double> w(1);
+            for (int j = 0; j < len / 2; ++j) {
+                const std::complex<double> u = a[i + j];
+                const std::complex<double> v = a[i + j + len / 2] * w;
+                a[i + j] = u + v;
+                a[i + j + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+void build_mip_levels(const float* table, MipTable& out) {
+    std::vector<std::complex<double>> spectrum(TABLE_SIZE), level(TABLE_SIZE);
+    for (int i = 0; i < TABLE_SIZE; ++i)
+        spectrum[i] = table[i];
+    fft(spectrum.data(), TABLE_SIZE, false);
+
+    // level 0 already holds every harmonic a table this size can
+    std::copy(table, table + TABLE_SIZE, out.level[0]);
+    out.pulse_width = 0.0f;
+    out.level[0][TABLE_SIZE] = table[0];
+
+    for (int n = 1; n < MIP_LEVELS; ++n) {
+        const int harmonics = (TABLE_SIZE / 2) >> n;
+        level = spectrum;
+        // keep dc and the first harmonics, plus their mirror images at the top of the spectrum
+        for (int k = harmonics + 1; k < TABLE_SIZE - harmonics; ++k)
+            level[k] = 0;
+        fft(level.data(), TABLE_SIZE, true);
+        for (int i = 0; i < TABLE_SIZE; ++i)
+            out.level[n][i] = (float)(level[i].real() / TABLE_SIZE);
+        out.level[n][TABLE_SIZE] = out.level[n][0];
+    }
+}
+
+void build_mip_levels_from(const float* cycle, std::size_t size, MipTable& out) {
+    if (size == TABLE_SIZE) {
+        build_mip_levels(cycle, out);
+        return;
+    }
+    const int n_in = (int)size;
+    std::vector<std::complex<double>> spectrum(n_in), level(TABLE_SIZE);
+    for (int i = 0; i < n_in; ++i)
+        spectrum[i] = cycle[i];
+    fft(spectrum.data(), n_in, false);
+
+    out.pulse_width = 0.0f;
+    for (int n = 0; n < MIP_LEVELS; ++n) {
+        // the table's own nyquist is left out, its phase can't survive the change of size
+        const int harmonics = std::min((TABLE_SIZE / 2) >> n, n_in / 2);
+        std::fill(level.begin(), level.end(), 0.0);
+        level[0] = spectrum[0];
+        for (int k = 1; k <= harmonics && k < TABLE_SIZE / 2; ++k) {
+            // the cycle's nyquist is a single bin, split it between the two halves
+            const double share = k == n_in / 2 ? 0.5 : 1.0;
+            level[k] = spectrum[k] * share;
+            level[TABLE_SIZE - k] = spectrum[n_in - k] * share;
+        }
+        fft(level.data(), TABLE_SIZE, true);
+        for (int i = 0; i < TABLE_SIZE; ++i)
+            out.level[n][i] = (float)(level[i].real() / n_in);
+        out.level[n][TABLE_SIZE] = out.level[n][0];
+    }
+}
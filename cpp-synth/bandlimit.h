@@ -0,0 +1,30 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "wavetable.h"
+
+// fills every level of out from a single naive cycle by FFT truncation
+void build_mip_levels(const float* table, MipTable& out);
+// the same from a cycle of any power of two length, resampled to TABLE_SIZE on the way
+void build_mip_levels_from(const float* cycle, std::size_t size, MipTable& out);
+
+// which two levels to read for a phase increment, and how much of the duller one to mix in.
+// both levels are always free of aliasing, the crossfade just keeps the timbre from
+// jumping as a note sweeps across an octave boundary
+struct MipChoice {
+    int level;
+    float weight; // of level + 1
+};
+
+inline MipChoice choose_mip_level(uint32_t inc) {
+    // table entries stepped per output sample, the highest harmonic left at level n
+    // reaches nyquist when this is 2^n
+    const float step = (float)inc * PHASE_FRAC_SCALE;
+    if (step <= 0.5f)
+        return { 0, 0.0f };
+    const float x = std::log2(step);
+    const int level = (int)std::ceil(x);
+    if (level >= MIP_LEVELS - 1)
+        return { MIP_LEVELS - 1, 0.0f };
+    return { level, std::min(1.0f, x - (level - 1)) };
+}
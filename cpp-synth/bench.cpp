@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "bench.h"
+#include "SynthEngine.h"
+
+// cpp-synth-bench, repeatable micro-benchmarks for the dsp code
+// results can be written as JSON and compared against a saved baseline,
+// in which case any case slower than the tolerance makes the run fail
+
+void BenchSuite::add(const std::string& name, std::function<void()> fn, double items) {
+    cases.push_back({ name, std::move(fn), items });
+}
+
+std::vector<BenchResult> BenchSuite::run(const std::string& filter, double seconds_per_case) const {
+    using clock = std::chrono::steady_clock;
+    const int batches = 31;
+    std::vector<BenchResult> results;
+
+    for (const auto& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos)
+            continue;
+
+        // warm up, and find how many calls make a batch long enough to time reliably
+        long long calls = 1;
+        for (;;) {
+            auto t0 = clock::now();
+            for (long long i = 0; i < calls; ++i)
+                c.fn();
+            const double s = std::chrono::duration<double>(clock::now() - t0).count();
+            if (s >= seconds_per_case / batches || calls >= (1ll << 30))
+                break;
+            calls *= 2;
+        }
+
+        std::vector<double> samples;
+        for (int b = 0; b < batches; ++b) {
+            auto t0 = clock::now();
+            for (long long i = 0; i < calls; ++i)
+                c.fn();
+            samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - t0).count() / calls);
+        }
+        std::sort(samples.begin(), samples.end());
+        const double median = samples[samples.size() / 2];
+        results.push_back({ c.name, median, median / c.items, calls * batches });
+        printf("%-40s %14.1f ns/call %10.3f ns/item\n", c.name.c_str(), median, median / c.items);
+        fflush(stdout);
+    }
+    return results;
+}
+
+static void write_json(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream f(path);
+    f << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        f << "    { \"name\": \"" << r.name << "\", \"ns_per_call\": " << r.ns_per_call
+          << ", \"ns_per_item\": " << r.ns_per_item << ", \"calls\": " << r.calls << " }"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+}
+
+// reads back what write_json wrote, name -> ns_per_call
+static bool read_json(const std::string& path, std::map<std::string, double>& out) {
+    std::ifstream f(path);
+    if (!f)
+        return false;
+    std::stringstream ss;
+    ss << f.rdbuf();
+    const std::string text = ss.str();
+
+    std::size_t pos = 0;
+    while ((pos = text.find("\"name\": \"", pos)) != std::string::npos) {
+        pos += 9;
+        const std::size_t end = text.find('"', pos);
+        const std::string name = text.substr(pos, end - pos);
+        const std::size_t ns = text.find("\"ns_per_call\": ", end);
+        if (ns == std::string::npos)
+            return false;
+        out[name] = std::atof(text.c_str() + ns + 15);
+        pos = ns;
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: cpp-synth-bench [options]\n"
+        "  -f, --filter TEXT     only run cases whose name contains TEXT\n"
+        "  -t, --time SECONDS    time spent measuring each case (default 0.25)\n"
+        "  -j, --json FILE       write the results as JSON\n"
+        "  -c, --baseline FILE   compare against a JSON file from an earlier run\n"
+        "  --tolerance PERCENT   how much slower than the baseline a case may be (default 10)\n");
+}
+
+int main(int argc, char** argv) {
+    std::string filter, json_path, baseline_path;
+    double seconds = 0.25;
+    double tolerance = 10.0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if ((arg == "-f" || arg == "--filter") && has_value)
+            filter = argv[++i];
+        else if ((arg == "-t" || arg == "--time") && has_value)
+            seconds = std::atof(argv[++i]);
+        else if ((arg == "-j" || arg == "--json") && has_value)
+            json_path = argv[++i];
+        else if ((arg == "-c" || arg == "--baseline") && has_value)
+            baseline_path = argv[++i];
+        else if (arg == "--tolerance" && has_value)
+            tolerance = std::atof(argv[++i]);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !read_json(baseline_path, baseline)) {
+        fprintf(stderr, "could not read baseline %s\n", baseline_path.c_str());
+        return 1;
+    }
+
+    BenchSuite suite;
+    add_wavetable_benchmarks(suite);
+    add_callback_benchmarks(suite);
+    add_voice_benchmarks(suite);
+    add_interp_benchmarks(suite);
+    const auto results = suite.run(filter, seconds);
+
+    // the voice cases time one 128 frame block per voice, turn that into voices one core can run
+    const double block_budget_ns = 1e9 * 128 / DEFAULT_SAMPLE_RATE;
+    for (const auto& r : results) {
+        if (r.name.rfind("voices/128", 0) == 0)
+            printf("%-40s %10.0f voices/core at %u Hz\n", r.name.c_str(), block_budget_ns / r.ns_per_item, DEFAULT_SAMPLE_RATE);
+    }
+
+    // and the filter cases one 128 frame block per voice filtered
+    for (const auto& r : results) {
+        if (r.name.rfind("filter/", 0) == 0)
+            printf("%-40s %10.0f filters/core at %u Hz\n", r.name.c_str(), block_budget_ns / r.ns_per_item, DEFAULT_SAMPLE_RATE);
+    }
+
+    // the scaling cases are one 256 voice block on 1 to N threads, as a speedup over the first
+    const BenchResult* single = nullptr;
+    for (const auto& r : results) {
+        if (r.name.rfind("voices/scaling/", 0) != 0)
+            continue;
+        if (!single)
+            single = &r;
+        printf("%-40s %10.2fx speedup, %6.0f voices per block budget\n", r.name.c_str(), single->ns_per_call / r.ns_per_call, block_budget_ns / r.ns_per_item);
+    }
+
+    report_interp_quality(results);
+
+    if (!json_path.empty())
+        write_json(json_path, results);
+
+    if (baseline_path.empty())
+        return 0;
+
+    int regressions = 0;
+    printf("\n%-40s %12s %12s %9s\n", "compared to baseline", "baseline", "now", "change");
+    for (const auto& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            printf("%-40s %12s %12.1f %9s\n", r.name.c_str(), "-", r.ns_per_call, "new");
+            continue;
+        }
+        const double change = 100.0 * (r.ns_per_call - it->second) / it->second;
+        const bool slower = change > tolerance;
+        regressions += slower;
+        printf("%-40s %12.1f %12.1f %+8.1f%%%s\n", r.name.c_str(), it->second, r.ns_per_call, change, slower ? "  REGRESSION" : "");
+    }
+    if (regressions) {
+        printf("\n%d case(s) more than %.0f%% slower than the baseline\n", regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
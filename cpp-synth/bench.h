@@ -0,0 +1,45 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+// tiny micro-benchmark harness for cpp-synth-bench
+// each case is a function that does one unit of work, e.g. render one block.
+// it is called in batches sized to run for a fixed time, and the median batch is reported
+
+struct BenchResult {
+    std::string name;
+    double ns_per_call;
+    double ns_per_item;  // ns_per_call divided by items, e.g. per frame or per table entry
+    long long calls;
+};
+
+class BenchSuite
+{
+private:
+    struct Case {
+        std::string name;
+        std::function<void()> fn;
+        double items;
+    };
+    std::vector<Case> cases;
+public:
+    // items is how many samples, entries etc. one call processes, used for ns_per_item
+    void add(const std::string& name, std::function<void()> fn, double items = 1);
+    // runs every case whose name contains filter (all of them if it is empty)
+    std::vector<BenchResult> run(const std::string& filter, double seconds_per_case) const;
+};
+
+// every source file of cases registers them through one of these
+void add_wavetable_benchmarks(BenchSuite& suite);
+void add_callback_benchmarks(BenchSuite& suite);
+void add_voice_benchmarks(BenchSuite& suite);
+void add_interp_benchmarks(BenchSuite& suite);
+// prints the signal to noise ratio of every interpolation tier that was timed
+void report_interp_quality(const std::vector<BenchResult>& results);
+
+// stops the optimiser from throwing away a result that is otherwise unused
+inline volatile float bench_sink;
+inline void do_not_optimise(float value) {
+    bench_sink = value;
+}
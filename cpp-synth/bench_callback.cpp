@@ -0,0 +1,141 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "SynthEngine.h"
+
+// the full block render, plus the loops it replaced so they can be compared on one machine
+
+// the per-sample loop as it was before parameters were snapshotted per block
+static void render_atomic(SynthEngine& st, float* out, unsigned long frames) {
+    const float a_amp = 0.2f, b_amp = 0.2f, c_amp = 0.2f;
+    for (std::size_t i = 0; i < frames; i++) {
+        *out++ = st.amplitude.load(std::memory_order_relaxed) * (
+            a_amp * st.m_oscA.ps.amp * st.m_oscA.interpolate_left() +
+            b_amp * st.m_oscB.ps.amp * st.m_oscB.interpolate_left() +
+            c_amp * st.m_oscC.ps.amp * st.m_oscC.interpolate_left());
+        *out++ = st.amplitude.load(std::memory_order_relaxed) * (
+            a_amp * st.m_oscA.ps.amp * st.m_oscA.interpolate_right() +
+            b_amp * st.m_oscB.ps.amp * st.m_oscB.interpolate_right() +
+            c_amp * st.m_oscC.ps.amp * st.m_oscC.interpolate_right());
+
+        for (std::size_t j = 0; j < 3; ++j) {
+            st.oscillators[j].first->ps.left_phase += st.oscillators[j].first->ps.left_phase_inc;
+            if (st.oscillators[j].first->ps.left_phase >= TABLE_SIZE) st.oscillators[j].first->ps.left_phase -= TABLE_SIZE;
+            st.oscillators[j].first->ps.right_phase += st.oscillators[j].first->ps.right_phase_inc;
+            if (st.oscillators[j].first->ps.right_phase >= TABLE_SIZE) st.oscillators[j].first->ps.right_phase -= TABLE_SIZE;
+        }
+    }
+}
+
+// the per-sample interleaved loop over a per-block parameter snapshot,
+// which is what the callback ran before the block kernels
+static void render_per_sample(SynthEngine& st, float* out, unsigned long frames) {
+    static float left_phase[3], right_phase[3];
+    const float gain = 0.1f * 0.2f * 0.33f;
+    for (std::size_t i = 0; i < frames; i++) {
+        float left = 0, right = 0;
+        for (std::size_t j = 0; j < 3; ++j) {
+            Wavetable_t* osc = st.oscillators[j].first;
+            left += gain * interpolate(osc->table, left_phase[j]);
+            right += gain * interpolate(osc->table, right_phase[j]);
+
+            left_phase[j] += osc->ps.left_phase_inc.load(std::memory_order_relaxed);
+            if (left_phase[j] >= TABLE_SIZE) left_phase[j] -= TABLE_SIZE;
+            right_phase[j] += osc->ps.right_phase_inc.load(std::memory_order_relaxed);
+            if (right_phase[j] >= TABLE_SIZE) right_phase[j] -= TABLE_SIZE;
+        }
+        *out++ = left;
+        *out++ = right;
+    }
+}
+
+// the default three oscillator patch playing one voice, with phases that actually wander through the table
+static std::shared_ptr<SynthEngine> make_patch(OscKernel kernel) {
+    auto st = std::make_shared<SynthEngine>();
+    st->m_oscA.update_shape(0, 0.5f);
+    st->m_oscB.update_shape(2, 0.5f);
+    st->m_oscC.update_shape(3, 0.5f);
+    const float incs[3][2] = { { 1.0f, 1.0f }, { 1.4983f, 1.5021f }, { 2.0f, 2.0119f } };
+    for (std::size_t j = 0; j < 3; ++j) {
+        st->set_param(Param::LeftPhaseInc, j, incs[j][0]);
+        st->set_param(Param::RightPhaseInc, j, incs[j][1]);
+    }
+    st->set_osc_kernel(kernel);
+    st->note_on(BASE_NOTE, 1.0f);
+    return st;
+}
+
+void add_callback_benchmarks(BenchSuite& suite) {
+    auto out = std::make_shared<std::vector<float>>(2 * 1024);
+
+    std::vector<std::pair<std::string, OscKernel>> kernels{ { "portable", render_osc_portable } };
+#if SYNTH_HAVE_AVX2
+    if (cpu_has_avx2())
+        kernels.push_back({ "avx2", render_osc_avx2 });
+#endif
+
+    // full callback blocks at the usual buffer sizes, with the kernel picked at startup
+    // and then with each kernel forced
+    for (unsigned long frames : { 64ul, 128ul, 256ul, 512ul, 1024ul }) {
+        auto st = make_patch(select_osc_kernel());
+        suite.add("callback/3osc/" + std::to_string(frames), [=] {
+            st->render(out->data(), frames);
+            do_not_optimise((*out)[0]);
+        }, (double)frames);
+        for (const auto& kernel : kernels) {
+            auto forced = make_patch(kernel.second);
+            suite.add("callback/3osc_" + kernel.first + "/" + std::to_string(frames), [=] {
+                forced->render(out->data(), frames);
+                do_not_optimise((*out)[0]);
+            }, (double)frames);
+        }
+    }
+
+    // the same patch with every lfo modulating its oscillator, at a few control rates
+    for (unsigned control : { 16u, 32u, 64u }) {
+        auto st = make_patch(select_osc_kernel());
+        for (std::size_t j = 0; j < 3; ++j) {
+            st->oscillators[j].second->update_shape(1, 0.5f);
+            st->set_param(Param::LfoRate, j, 2.0f + j);
+            st->set_param(Param::LfoDepth, j, 0.5f);
+            st->set_param(Param::LfoEnable, j, 1.0f);
+        }
+        st->set_param(Param::ControlBlock, 0, (float)control);
+        suite.add("callback/3osc_lfo/256/control=" + std::to_string(control), [=] {
+            st->render(out->data(), 256);
+            do_not_optimise((*out)[0]);
+        }, 256.0);
+    }
+
+    // scaling with the number of oscillator channels, one 256 frame block each
+    auto table = std::make_shared<std::vector<float>>(TABLE_SIZE + 1);
+    for (int i = 0; i <= TABLE_SIZE; ++i)
+        (*table)[i] = (float)std::sin((i % TABLE_SIZE) / (double)TABLE_SIZE * M_PI * 2.);
+    for (const auto& kernel : kernels) {
+        for (int oscs : { 1, 3, 8, 16, 32 }) {
+            const std::size_t frames = 256;
+            auto phases = std::make_shared<std::vector<uint32_t>>(oscs, 0u);
+            OscKernel fn = kernel.second;
+            suite.add("osc_kernel/" + kernel.first + "/oscs=" + std::to_string(oscs), [=] {
+                std::fill(out->begin(), out->begin() + frames, 0.0f);
+                for (int j = 0; j < oscs; ++j)
+                    (*phases)[j] = fn(table->data(), (*phases)[j], phase_inc_to_fixed(1.0f + 0.37f * j), 0.1f, out->data(), frames);
+                do_not_optimise((*out)[0]);
+            }, (double)frames * oscs);
+        }
+    }
+
+    // the loops the block renderer replaced
+    for (unsigned long frames : { 64ul, 256ul, 512ul }) {
+        auto st = make_patch(select_osc_kernel());
+        suite.add("legacy/atomic/" + std::to_string(frames), [=] {
+            render_atomic(*st, out->data(), frames);
+            do_not_optimise((*out)[0]);
+        }, (double)frames);
+        suite.add("legacy/per_sample/" + std::to_string(frames), [=] {
+            render_per_sample(*st, out->data(), frames);
+            do_not_optimise((*out)[0]);
+        }, (double)frames);
+    }
+}
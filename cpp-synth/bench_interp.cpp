@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bench.h"
+#include "osc_kernel.h"
+#include "wavetable.h"
+
+// every interpolation tier on its own, timed and measured for how far it is from the ideal
+
+static std::vector<std::pair<std::string, OscKernel>> interp_kernels() {
+    std::vector<std::pair<std::string, OscKernel>> kernels;
+    for (std::size_t m = 0; m < INTERP_MODES; ++m) {
+        kernels.push_back({ std::string(INTERP_NAMES[m]) + "/portable", portable_osc_kernel((Interp)m) });
+#if SYNTH_HAVE_AVX2
+        if (cpu_has_avx2())
+            kernels.push_back({ std::string(INTERP_NAMES[m]) + "/avx2", select_osc_kernel((Interp)m) });
+#endif
+    }
+    return kernels;
+}
+
+// a table holding cycles whole cycles of a sine, with its guard sample
+static std::vector<float> sine_table(int cycles) {
+    std::vector<float> table(TABLE_SIZE + 1);
+    for (int i = 0; i <= TABLE_SIZE; ++i)
+        table[i] = (float)std::sin(2 * M_PI * cycles * (i % TABLE_SIZE) / TABLE_SIZE);
+    return table;
+}
+
+// signal to noise ratio of a kernel reading a sine at an increment that lands all over the
+// fractions, against the sine itself at the exact phase. everything that isn't the sine is noise
+static double interp_snr_db(OscKernel kernel, int cycles) {
+    const std::vector<float> table = sine_table(cycles);
+    const std::size_t frames = 1 << 14;
+    const uint32_t inc = phase_inc_to_fixed(1.37f);
+    std::vector<float> out(frames, 0.0f);
+    kernel(table.data(), 0, inc, 1.0f, out.data(), frames);
+
+    double signal = 0, noise = 0;
+    uint32_t phase = 0;
+    for (std::size_t i = 0; i < frames; ++i) {
+        const double ideal = std::sin(2 * M_PI * cycles * (phase / 4294967296.0));
+        signal += ideal * ideal;
+        noise += (out[i] - ideal) * (out[i] - ideal);
+        phase += inc;
+    }
+    return 10 * std::log10(signal / std::max(noise, 1e-30));
+}
+
+void add_interp_benchmarks(BenchSuite& suite) {
+    auto table = std::make_shared<std::vector<float>>(sine_table(1));
+    auto out = std::make_shared<std::vector<float>>(256);
+    for (const auto& kernel : interp_kernels()) {
+        OscKernel fn = kernel.second;
+        auto phase = std::make_shared<uint32_t>(0);
+        suite.add("interp/" + kernel.first, [=] {
+            std::fill(out->begin(), out->end(), 0.0f);
+            *phase = fn(table->data(), *phase, phase_inc_to_fixed(1.37f), 0.1f, out->data(), out->size());
+            do_not_optimise((*out)[0]);
+        }, (double)out->size());
+    }
+}
+
+void report_interp_quality(const std::vector<BenchResult>& results) {
+    for (const auto& kernel : interp_kernels()) {
+        for (const auto& r : results) {
+            if (r.name != "interp/" + kernel.first)
+                continue;
+            // a low harmonic, and one with only 8 table entries per cycle like the top of a bright table
+            printf("%-40s %10.3f ns/sample  snr %6.1f dB at 64 entries/cycle, %6.1f dB at 8\n", r.name.c_str(), r.ns_per_item,
+                interp_snr_db(kernel.second, TABLE_SIZE / 64), interp_snr_db(kernel.second, TABLE_SIZE / 8));
+        }
+    }
+}
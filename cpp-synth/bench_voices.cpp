@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "osc_server.h"
+#include "SynthEngine.h"
+
+// the polyphonic engine at 48 kHz with 128 frame blocks, how many voices one core can keep up with
+
+constexpr unsigned long VOICE_BLOCK = 128;
+
+// the default three oscillator patch with every voice of the pool sounding, spread over a few octaves,
+// optionally with a short adsr envelope on every note and through a filter
+static std::shared_ptr<SynthEngine> make_voices(std::size_t voices, bool lfo, unsigned threads = 1, bool envelope = false, FilterMode filter = FilterMode::Off) {
+    auto st = std::make_shared<SynthEngine>(voices);
+    st->set_render_threads(threads);
+    if (envelope)
+        st->set_envelope(adsr_envelope(0.005f, 0.1f, 0.7f, 0.05f, 0.5f));
+    if (filter != FilterMode::Off)
+        st->set_filter({ (int32_t)filter, 1200.0f, 0.6f, 0.5f });
+    st->m_oscA.update_shape(0, 0.5f);
+    st->m_oscB.update_shape(2, 0.5f);
+    st->m_oscC.update_shape(3, 0.5f);
+    const float incs[3][2] = { { 1.0f, 1.0f }, { 1.4983f, 1.5021f }, { 2.0f, 2.0119f } };
+    for (std::size_t j = 0; j < 3; ++j) {
+        st->set_param(Param::LeftPhaseInc, j, incs[j][0]);
+        st->set_param(Param::RightPhaseInc, j, incs[j][1]);
+        if (lfo) {
+            st->oscillators[j].second->update_shape(1, 0.5f);
+            st->set_param(Param::LfoRate, j, 2.0f + j);
+            st->set_param(Param::LfoDepth, j, 0.5f);
+            st->set_param(Param::LfoEnable, j, 1.0f);
+        }
+    }
+    // the queue only takes so many notes per block, so start them a batch at a time
+    std::vector<float> out(2 * VOICE_BLOCK);
+    for (std::size_t v = 0; v < voices; ++v) {
+        st->note_on(BASE_NOTE + (int)(v % 48), 1.0f);
+        if (v % 128 == 127)
+            st->render(out.data(), VOICE_BLOCK);
+    }
+    st->render(out.data(), VOICE_BLOCK);
+    return st;
+}
+
+// a type 0 song at 120 bpm (960 ticks a second) of four note chords moving steps_per_second
+// times a second, each with a pitch bend, and a volume change every fourth step
+static std::vector<unsigned char> make_song(double seconds, unsigned steps_per_second) {
+    std::vector<unsigned char> track;
+    auto varlen = [&](uint32_t v) {
+        unsigned char bytes[4];
+        int n = 0;
+        do {
+            bytes[n++] = v & 0x7F;
+            v >>= 7;
+        } while (v);
+        while (n-- > 0)
+            track.push_back(bytes[n] | (n ? 0x80 : 0));
+    };
+    auto event = [&](uint32_t delta, std::initializer_list<unsigned char> bytes) {
+        varlen(delta);
+        track.insert(track.end(), bytes);
+    };
+    event(0, { 0xFF, 0x51, 3, 0x07, 0xA1, 0x20 }); // 500000 us per quarter
+    const uint32_t step_ticks = 960 / steps_per_second;
+    const unsigned steps = (unsigned)(seconds * steps_per_second);
+    const int chord[4] = { 0, 4, 7, 11 };
+    for (unsigned k = 0; k < steps; ++k) {
+        const int root = BASE_NOTE + 12 + (int)(k * 5 % 24);
+        for (int n : chord)
+            event(0, { 0x90, (unsigned char)(root + n), 100 });
+        const unsigned bend = 8192 + (k % 16) * 256;
+        event(step_ticks / 2, { 0xE0, (unsigned char)(bend & 0x7F), (unsigned char)(bend >> 7) });
+        if (k % 4 == 0)
+            event(0, { 0xB0, 7, (unsigned char)(80 + k % 40) });
+        for (std::size_t i = 0; i < 4; ++i)
+            event(i == 0 ? step_ticks - step_ticks / 2 : 0, { 0x80, (unsigned char)(root + chord[i]), 0 });
+    }
+    event(0, { 0xFF, 0x2F, 0 });
+
+    std::vector<unsigned char> file = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x01, 0xE0, 'M', 'T', 'r', 'k' };
+    const uint32_t len = (uint32_t)track.size();
+    for (int shift = 24; shift >= 0; shift -= 8)
+        file.push_back((unsigned char)(len >> shift));
+    file.insert(file.end(), track.begin(), track.end());
+    return file;
+}
+
+void add_voice_benchmarks(BenchSuite& suite) {
+    auto out = std::make_shared<std::vector<float>>(2 * VOICE_BLOCK);
+
+    // items are voices, so ns/item is the cost of one voice for one block
+    for (std::size_t voices : { 1, 8, 32, 64, 128, 256 }) {
+        auto st = make_voices(voices, false);
+        suite.add("voices/128/voices=" + std::to_string(voices), [=] {
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, (double)voices);
+        auto modulated = make_voices(voices, true);
+        suite.add("voices/128_lfo/voices=" + std::to_string(voices), [=] {
+            modulated->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, (double)voices);
+    }
+
+    // envelopes: eight lanes moving through long curved segments, items are voice-samples, then the
+    // pool with a note let go of and struck again every block, so voices are always in their attack,
+    // decay or release and the finished ones are culled
+    auto long_env = sanitise_envelope(adsr_envelope(30.0f, 30.0f, 0.5f, 30.0f, 0.5f));
+    const std::pair<std::string, EnvKernel> env_kernels[] = {
+        { "portable", advance_env_portable },
+#if SYNTH_HAVE_AVX2
+        { "avx2", advance_env_avx2 },
+#endif
+    };
+    for (const auto& kernel : env_kernels) {
+#if SYNTH_HAVE_AVX2
+        if (kernel.second == advance_env_avx2 && !cpu_has_avx2())
+            continue;
+#endif
+        auto bank = std::make_shared<EnvelopeBank>(ENV_LANES);
+        bank->set_kernel(kernel.second);
+        bank->set_shape(long_env, DEFAULT_SAMPLE_RATE);
+        auto rows = std::make_shared<std::vector<float>>(ENV_LANES * VOICE_BLOCK);
+        suite.add("env/" + kernel.first + "/lanes=8", [=] {
+            float* out[ENV_LANES];
+            for (std::size_t k = 0; k < ENV_LANES; ++k)
+                out[k] = rows->data() + k * VOICE_BLOCK;
+            unsigned idle;
+            if (!bank->advance(0, VOICE_BLOCK, out, idle))
+                for (std::size_t k = 0; k < ENV_LANES; ++k)
+                    bank->start(k, true);
+            do_not_optimise((*rows)[VOICE_BLOCK - 1]);
+        }, (double)(ENV_LANES * VOICE_BLOCK));
+    }
+    for (std::size_t voices : { 8, 64 }) {
+        auto st = make_voices(voices, false, 1, true);
+        auto note = std::make_shared<int>(0);
+        suite.add("voices/128_env/voices=" + std::to_string(voices), [=] {
+            st->note_off(BASE_NOTE + *note);
+            st->note_on(BASE_NOTE + *note, 1.0f);
+            *note = (*note + 1) % 48;
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, (double)voices);
+    }
+
+    // filters: one chunk of eight voices through each mode and kernel, a 128 frame block with the
+    // cutoff moving at every control point. items are voices, so it reads as filters per core
+    const std::pair<std::string, FilterKernels> filter_kernels[] = {
+        { "portable", portable_filter_kernels() },
+#if SYNTH_HAVE_AVX2
+        { "avx2", avx2_filter_kernels() },
+#endif
+    };
+    for (const auto& kernel : filter_kernels) {
+#if SYNTH_HAVE_AVX2
+        if (kernel.first == "avx2" && !cpu_has_avx2())
+            continue;
+#endif
+        for (std::size_t m = 1; m < FILTER_MODES; ++m) {
+            auto bank = std::make_shared<FilterBank>(FILTER_LANES);
+            bank->set_kernels(kernel.second);
+            bank->set_resonance(0.6f);
+            bank->set_mode((FilterMode)m);
+            auto rows = std::make_shared<std::vector<float>>(2 * FILTER_LANES * VOICE_BLOCK);
+            for (std::size_t i = 0; i < rows->size(); ++i)
+                (*rows)[i] = (float)((i * 2654435761u) >> 16 & 0xFFFF) / 32768.0f - 1.0f;
+            auto mixed = std::make_shared<std::vector<float>>(2 * VOICE_BLOCK);
+            auto sweep = std::make_shared<unsigned>(0);
+            suite.add("filter/" + std::string(FILTER_NAMES[m]) + "/" + kernel.first + "/128", [=] {
+                const float* left[FILTER_LANES];
+                const float* right[FILTER_LANES];
+                for (std::size_t k = 0; k < FILTER_LANES; ++k) {
+                    left[k] = rows->data() + k * VOICE_BLOCK;
+                    right[k] = rows->data() + (FILTER_LANES + k) * VOICE_BLOCK;
+                }
+                for (std::size_t i = 0; i < VOICE_BLOCK; i += DEFAULT_CONTROL_BLOCK) {
+                    float cutoff[FILTER_LANES];
+                    for (std::size_t k = 0; k < FILTER_LANES; ++k)
+                        cutoff[k] = -6.0f + 0.25f * k + 0.01f * (*sweep = (*sweep + 1) % 256);
+                    bank->aim(0, cutoff, FILTER_LANES, DEFAULT_CONTROL_BLOCK);
+                    bank->run(0, left, right, mixed->data(), mixed->data() + VOICE_BLOCK, i, DEFAULT_CONTROL_BLOCK);
+                }
+                do_not_optimise((*mixed)[0]);
+            }, (double)FILTER_LANES);
+        }
+    }
+    for (FilterMode mode : { FilterMode::LowPass, FilterMode::Ladder }) {
+        auto st = make_voices(64, false, 1, false, mode);
+        suite.add("voices/128_" + std::string(FILTER_NAMES[(std::size_t)mode]) + "/voices=64", [=] {
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, 64.0);
+    }
+
+    // the master volume and an oscillator's pitch changed every block, so both are always
+    // gliding, against voices/128/voices=64 where they hold still
+    {
+        auto st = make_voices(64, false);
+        auto flip = std::make_shared<bool>(false);
+        suite.add("voices/128_ramp/voices=64", [=] {
+            *flip = !*flip;
+            st->set_param(Param::MasterAmp, 0, *flip ? 0.08f : 0.12f);
+            st->set_param(Param::LeftPhaseInc, 1, *flip ? 1.4983f : 1.5121f);
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, 64.0);
+    }
+
+    // the modulation matrix with more and more routes, on voices with lfos, an envelope and a
+    // lowpass already running so routes=0 is the same patch with nothing routed. the routes move
+    // pitch, the cutoff, amplitude, pulse width and the morph position in turn
+    {
+        const ModRoute routes[MOD_MAX_ROUTES] = {
+            { (uint8_t)ModSource::LfoA, 0, (uint8_t)ModDest::Pitch, 0, 0.5f },
+            { (uint8_t)ModSource::Envelope, 0, (uint8_t)ModDest::Cutoff, 0, 3.0f },
+            { (uint8_t)ModSource::LfoB, 0, (uint8_t)ModDest::Amp, 1, 0.5f },
+            { (uint8_t)ModSource::Controller, 1, (uint8_t)ModDest::PulseWidth, 2, 0.25f },
+            { (uint8_t)ModSource::LfoC, 0, (uint8_t)ModDest::Pitch, MOD_ALL_OSCS, 0.1f },
+            { (uint8_t)ModSource::LfoB, 0, (uint8_t)ModDest::Morph, MOD_ALL_OSCS, 0.5f },
+        };
+        for (std::size_t n : { 0, 1, 2, 4, 6 }) {
+            auto st = make_voices(64, true, 1, true, FilterMode::LowPass);
+            ModMatrix matrix = empty_matrix();
+            matrix.count = (int32_t)n;
+            std::copy(routes, routes + n, matrix.route);
+            st->set_modulation(matrix);
+            st->set_controller(1, 0.5f);
+            suite.add("mod/128/routes=" + std::to_string(n) + "/voices=64", [=] {
+                st->render(out->data(), VOICE_BLOCK);
+                do_not_optimise((*out)[0]);
+            }, 64.0);
+        }
+    }
+
+    // the oscillators as fm operators in every algorithm, with and without A's feedback,
+    // against fm/128/add which is the same pool mixed as usual
+    for (std::size_t alg = 0; alg < FM_ALGORITHMS; ++alg) {
+        for (bool feedback : { false, true }) {
+            if (alg == (std::size_t)FmAlgorithm::Additive && feedback)
+                continue;
+            auto st = make_voices(64, false);
+            st->set_param(Param::FmAlgorithm, 0, (float)alg);
+            st->set_param(Param::FmFeedback, 0, feedback ? 0.5f : 0.0f);
+            suite.add("fm/128/" + std::string(FM_ALGORITHM_NAMES[alg]) + (feedback ? "+feedback" : "") + "/voices=64", [=] {
+                st->render(out->data(), VOICE_BLOCK);
+                do_not_optimise((*out)[0]);
+            }, 64.0);
+        }
+    }
+
+    // a full pool of 256 voices split over more and more render threads
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2) {
+        auto st = make_voices(256, false, threads);
+        suite.add("voices/scaling/threads=" + std::to_string(threads), [=] {
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, 256.0);
+    }
+
+    // a full pool taking a new note every block, so every note-on steals
+    for (VoiceSteal policy : { VoiceSteal::Oldest, VoiceSteal::Quietest, VoiceSteal::SameNote }) {
+        auto st = make_voices(64, false);
+        st->set_param(Param::StealPolicy, 0, (float)policy);
+        auto note = std::make_shared<int>(0);
+        suite.add("voices/steal/policy=" + std::to_string((int)policy), [=] {
+            st->note_on(BASE_NOTE + *note, 0.5f);
+            *note = (*note + 1) % 48;
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        }, 64.0);
+    }
+
+    // midi files: reading one into its event array, and playing songs with every block split at
+    // each event, from a few events a second to a couple of thousand. items are blocks
+    for (unsigned steps : { 8u, 240u }) {
+        auto song_bytes = std::make_shared<std::vector<unsigned char>>(make_song(30.0, steps));
+        auto song = std::shared_ptr<MidiSequence>(MidiSequence::parse(song_bytes->data(), song_bytes->size()));
+        const std::string events = std::to_string((std::size_t)(song->size() / song->seconds()));
+        suite.add("midi/parse/events=" + std::to_string(song->size()), [=] {
+            auto parsed = MidiSequence::parse(song_bytes->data(), song_bytes->size());
+            do_not_optimise((float)parsed->size());
+        }, (double)song->size());
+        auto st = make_voices(64, false);
+        suite.add("midi/128/events_per_s=" + events, [=] {
+            // starts the song again when it ends, the restart is a queued message like any other
+            uint64_t ticket;
+            if (st->sequence_position.load() == 0.0 || st->sequence_position.load() > song->seconds())
+                st->set_sequence(song.get(), ticket);
+            st->render(out->data(), VOICE_BLOCK);
+            do_not_optimise((*out)[0]);
+        });
+    }
+
+    // osc: parsing a lone message and a full bundle on the server thread, items are messages,
+    // then a block of 64 voices that applies a burst of remote changes first, to compare with
+    // voices/128/voices=64
+    auto single = std::make_shared<OscWriter>();
+    single->message("/osc/B/amp", 0.25f);
+    auto bundle = std::make_shared<OscWriter>();
+    bundle->begin_bundle();
+    const char* addresses[] = { "/osc/A/amp", "/osc/B/note", "/osc/C/morph", "/osc/A/lfo/rate" };
+    std::size_t bundled = 0;
+    while (bundle->message(addresses[bundled % 4], 1.0f))
+        ++bundled;
+    auto actions = std::make_shared<std::vector<OscAction>>(OSC_MAX_ACTIONS);
+    suite.add("osc/parse/message", [=] {
+        uint64_t unknown = 0;
+        const std::size_t n = parse_osc_packet(single->data(), single->size(), 0, actions->data(), actions->size(), unknown);
+        do_not_optimise((float)n);
+    });
+    suite.add("osc/parse/bundle=" + std::to_string(bundled), [=] {
+        uint64_t unknown = 0;
+        const std::size_t n = parse_osc_packet(bundle->data(), bundle->size(), 0, actions->data(), actions->size(), unknown);
+        do_not_optimise((float)n);
+    }, (double)bundled);
+    auto remote = make_voices(64, false);
+    suite.add("osc/remote+block/128/voices=64/changes=256", [=] {
+        for (std::size_t k = 0; k < 256; ++k)
+            remote->push_remote({ Param::OscAmp, (unsigned char)(k % 3), 0.2f + (k % 8) * 0.01f }, 0);
+        remote->render(out->data(), VOICE_BLOCK);
+        do_not_optimise((*out)[0]);
+    });
+}
@@ -0,0 +1,232 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include "bench.h"
+#include "wavetable.h"
+#include "bandlimit.h"
+#include "SynthEngine.h"
+#include "viewer_cache.h"
+#include "wavegen.h"
+#include "morph_table.h"
+#include "preset.h"
+
+// lookups from wavetable.cpp and table generators from wavegen.cpp
+
+// a 32-bit float wav of frames cycles of frame_size samples, sine morphing into saw
+static std::string write_morph_file(std::size_t frames, std::size_t frame_size) {
+    const std::string path = (std::filesystem::temp_directory_path() / "cpp-synth-bench-morph.wav").string();
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return path;
+    const uint32_t data_bytes = (uint32_t)(frames * frame_size * sizeof(float));
+    const uint32_t riff_bytes = 36 + data_bytes, fmt_bytes = 16, rate = 48000, byte_rate = rate * 4;
+    const uint16_t format = 3, channels = 1, align = 4, bits = 32;
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&riff_bytes, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    fwrite(&fmt_bytes, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);
+    fwrite(&byte_rate, 4, 1, f);
+    fwrite(&align, 2, 1, f);
+    fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    fwrite(&data_bytes, 4, 1, f);
+    std::vector<float> cycle(frame_size);
+    for (std::size_t k = 0; k < frames; ++k) {
+        const float m = k / (float)(frames - 1);
+        for (std::size_t i = 0; i < frame_size; ++i) {
+            const double x = i / (double)frame_size;
+            cycle[i] = (float)((1 - m) * std::sin(2 * M_PI * x) + m * (2 * x - 1));
+        }
+        fwrite(cycle.data(), sizeof(float), frame_size, f);
+    }
+    fclose(f);
+    return path;
+}
+
+// a bank of count presets that differ in their shapes and levels
+static std::string write_preset_bank(std::size_t count) {
+    const std::string path = (std::filesystem::temp_directory_path() / "cpp-synth-bench.bank").string();
+    std::vector<Preset> presets(count, blank_preset());
+    for (std::size_t i = 0; i < count; ++i) {
+        Preset& p = presets[i];
+        set_preset_text(p.name, PRESET_NAME_LEN, "preset " + std::to_string(i));
+        set_preset_text(p.tags, PRESET_TAGS_LEN, i % 3 ? "lead,bright" : "pad,dark");
+        p.master_amp = 0.1f;
+        p.control_block = DEFAULT_CONTROL_BLOCK;
+        for (std::size_t j = 0; j < 3; ++j) {
+            PresetOsc& o = p.osc[j] = PresetOsc{};
+            o.waveform = (int32_t)((i + j) % 4);
+            o.pulse_width = 0.2f + 0.6f * (i % 7) / 7.0f;
+            o.amp = 0.33f;
+            o.left_inc = 1.0f + j;
+            o.right_inc = 1.0f + j;
+            o.interp = (int32_t)Interp::Linear;
+            o.lfo_waveform = WAVE_SINE;
+            o.lfo_rate = 1.0f;
+        }
+    }
+    PresetBank::write(path, presets);
+    return path;
+}
+
+void add_wavetable_benchmarks(BenchSuite& suite) {
+    auto wt = std::make_shared<Wavetable_t>();
+    generate_table(WAVE_SAW, 0.5f, wt->table);
+
+    // lookups are cheap enough that a single call is mostly timer overhead,
+    // so each case walks the table in one pass
+    suite.add("wavetable/interpolate_at", [=] {
+        float sum = 0;
+        for (int i = 0; i < TABLE_SIZE; ++i)
+            sum += wt->interpolate_at(i + 0.5f);
+        do_not_optimise(sum);
+    }, TABLE_SIZE);
+    suite.add("wavetable/interpolate_left", [=] {
+        float sum = 0;
+        for (int i = 0; i < TABLE_SIZE; ++i) {
+            wt->ps.left_phase.store(i + 0.25f, std::memory_order_relaxed);
+            sum += wt->interpolate_left();
+        }
+        do_not_optimise(sum);
+    }, TABLE_SIZE);
+    suite.add("wavetable/interpolate_right", [=] {
+        float sum = 0;
+        for (int i = 0; i < TABLE_SIZE; ++i) {
+            wt->ps.right_phase.store(i + 0.75f, std::memory_order_relaxed);
+            sum += wt->interpolate_right();
+        }
+        do_not_optimise(sum);
+    }, TABLE_SIZE);
+
+    // the per-sample std::sin loop the sine table used to be generated with, for comparison
+    suite.add("gen/sin_legacy", [=] {
+        for (int i = 0; i < TABLE_SIZE; i++)
+            wt->table[i] = (float)std::sin((i / (double)TABLE_SIZE) * M_PI * 2.);
+        do_not_optimise(wt->table[1]);
+    }, TABLE_SIZE);
+
+    // every shape, one drawn table per call and then every band-limited level of it
+    const std::pair<const char*, int> shapes[] = { { "saw", WAVE_SAW }, { "sine", WAVE_SINE }, { "pulse", WAVE_PULSE }, { "triangle", WAVE_TRIANGLE } };
+    auto levels = std::make_shared<MipTable>();
+    for (const auto& [name, waveform] : shapes) {
+        suite.add(std::string("gen/table/") + name, [=] {
+            generate_table(waveform, 0.3f, wt->table);
+            do_not_optimise(wt->table[1]);
+        }, TABLE_SIZE);
+    }
+    for (const auto& [name, waveform] : shapes) {
+        if (waveform != WAVE_PULSE && waveform != WAVE_TRIANGLE)
+            continue; // the fixed shapes are cached and never regenerated
+        suite.add(std::string("gen/levels/") + name, [=] {
+            generate_levels(waveform, 0.3f, *levels);
+            do_not_optimise(levels->level[MIP_LEVELS - 1][1]);
+        }, TABLE_SIZE * MIP_LEVELS);
+    }
+
+    // what the gui pays when a shape changes: regenerate and hand to the audio thread
+    suite.add("gen/update_shape", [=] {
+        wt->shape_pw = -1.0f;
+        wt->update_shape(2, 0.3f);
+        do_not_optimise(wt->table[1]);
+    }, TABLE_SIZE);
+
+    // every band-limited level from one drawn table
+    auto mips = std::make_shared<MipTable>();
+    suite.add("mip/build_levels", [=] {
+        build_mip_levels(wt->table, *mips);
+        do_not_optimise(mips->level[MIP_LEVELS - 1][1]);
+    }, TABLE_SIZE * MIP_LEVELS);
+
+    // the wavetable viewer, as it was recomputed every gui frame and with the cache
+    auto st = std::make_shared<SynthEngine>();
+    auto viewer = std::make_shared<ViewerCache>();
+    const std::size_t view_samples = TABLE_SIZE * 3;
+    suite.add("viewer/per_frame_legacy", [=] {
+        float sum = 0;
+        for (std::size_t i = 0; i < view_samples; ++i) {
+            float l = 0, r = 0;
+            for (const auto& osc : st->oscillators) {
+                l += osc.first->interpolate_at(i * osc.first->ps.left_phase_inc) * osc.first->ps.amp;
+                r += osc.first->interpolate_at(i * osc.first->ps.right_phase_inc) * osc.first->ps.amp;
+            }
+            sum += l + r;
+        }
+        do_not_optimise(sum);
+    }, (double)view_samples);
+    suite.add("viewer/rebuild", [=] {
+        // a new generation forces a full rebuild, as if a table had just changed
+        ++st->m_oscA.generation;
+        viewer->update(st->oscillators, view_samples, 300);
+        do_not_optimise(viewer->left()[0]);
+    }, (double)view_samples);
+    suite.add("viewer/unchanged", [=] {
+        viewer->update(st->oscillators, view_samples, 300);
+        do_not_optimise(viewer->left()[0]);
+    }, (double)view_samples);
+
+    // morph tables: opening a 256 frame file, which only maps it, then building one frame
+    // the first time it is played, and a voice morphing between two built frames
+    const std::string morph_path = write_morph_file(256, 2048);
+    suite.add("morph/open/256x2048", [=] {
+        auto table = MorphTable::open(morph_path);
+        do_not_optimise(table ? (float)table->frames() : 0.0f);
+    });
+    auto morph = std::shared_ptr<MorphTable>(MorphTable::open(morph_path));
+    auto frame = std::make_shared<MipTable>();
+    auto cycle = std::make_shared<std::vector<float>>(2048);
+    suite.add("morph/build_frame/2048", [=] {
+        morph->read_frame(100, cycle->data());
+        build_mip_levels_from(cycle->data(), cycle->size(), *frame);
+        do_not_optimise(frame->level[0][1]);
+    }, TABLE_SIZE * MIP_LEVELS);
+    auto voice = std::make_shared<SynthEngine>();
+    voice->set_morph_table(0, morph.get());
+    voice->set_param(Param::MorphPosition, 0, 0.5f);
+    morph->prepare(127);
+    morph->prepare(128);
+    voice->note_on(BASE_NOTE, 1.0f);
+    auto out = std::make_shared<std::vector<float>>(2 * 256);
+    suite.add("morph/render/256", [=] {
+        voice->render(out->data(), 256);
+        do_not_optimise((*out)[0]);
+    }, 256.0);
+
+    // preset banks: opening one only maps it, browsing reads the index, loading copies one record
+    const std::size_t bank_size = 4096;
+    const std::string bank_path = write_preset_bank(bank_size);
+    suite.add("preset/bank/open/4096", [=] {
+        auto bank = PresetBank::open(bank_path);
+        do_not_optimise(bank ? (float)bank->size() : 0.0f);
+    });
+    auto bank = std::shared_ptr<PresetBank>(PresetBank::open(bank_path));
+    auto next = std::make_shared<std::size_t>(0);
+    suite.add("preset/bank/load", [=] {
+        // strides across the bank so every load is a different page
+        Preset preset;
+        *next = (*next + 977) % bank_size;
+        bank->load(*next, preset);
+        do_not_optimise(preset.osc[0].pulse_width);
+    });
+    suite.add("preset/bank/filter/4096", [=] {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < bank->size(); ++i)
+            found += preset_matches(bank->entry(i), "dark");
+        do_not_optimise((float)found);
+    }, (double)bank_size);
+    // applying a preset rebuilds the tables that changed, the block after it drains the queue
+    auto patch = std::make_shared<SynthEngine>();
+    auto presets = std::make_shared<std::vector<Preset>>(bank->load_all());
+    patch->note_on(BASE_NOTE, 1.0f);
+    suite.add("preset/apply+block/64", [=] {
+        *next = (*next + 1) % bank_size;
+        patch->apply_preset((*presets)[*next]);
+        patch->render(out->data(), 64);
+        do_not_optimise((*out)[0]);
+    });
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ring of interleaved stereo frames that the audio thread copies every finished block into.
+// the writer never waits and simply overwrites the oldest frames, the reader copies out
+// the most recent ones whenever it likes and finds out afterwards if the writer lapped it.
+// capacity must be a power of two so positions can be masked instead of wrapped
+template <std::size_t FRAMES>
+class CaptureRing
+{
+    static_assert(FRAMES >= 2 && (FRAMES & (FRAMES - 1)) == 0, "CaptureRing capacity must be a power of two");
+private:
+    float buffer[2 * FRAMES]{};
+    // total frames ever written, only the writer stores to it
+    alignas(64) std::atomic<uint64_t> written{ 0 };
+
+    // copies frames [from, from + n) of the stream, which must still be in the buffer
+    void copy_out(uint64_t from, float* out, std::size_t n) const {
+        const std::size_t start = (std::size_t)(from & (FRAMES - 1));
+        const std::size_t first = std::min(n, FRAMES - start);
+        std::memcpy(out, buffer + 2 * start, 2 * first * sizeof(float));
+        std::memcpy(out + 2 * first, buffer, 2 * (n - first) * sizeof(float));
+    }
+public:
+    // writer only, one block of interleaved frames. it goes in pieces of at most a quarter of
+    // the ring, so a frame is never overwritten without a reader being able to tell
+    void write(const float* frames, std::size_t n) {
+        uint64_t w = written.load(std::memory_order_relaxed);
+        if (n > FRAMES) {
+            frames += 2 * (n - FRAMES);
+            w += n - FRAMES;
+            n = FRAMES;
+        }
+        while (n) {
+            const std::size_t start = (std::size_t)(w & (FRAMES - 1));
+            const std::size_t count = std::min({ n, FRAMES / 4, FRAMES - start });
+            std::memcpy(buffer + 2 * start, frames, 2 * count * sizeof(float));
+            w += count;
+            frames += 2 * count;
+            n -= count;
+            written.store(w, std::memory_order_release);
+        }
+    }
+
+    // reader only, the n most recent frames, oldest first. at most half the capacity can be
+    // read so the writer has room to carry on while the copy runs. returns false if there
+    // aren't n frames yet or the writer may have got round to them before the copy finished
+    bool read_latest(float* out, std::size_t n) const {
+        if (n > FRAMES / 2)
+            return false;
+        const uint64_t end = written.load(std::memory_order_acquire);
+        if (end < n)
+            return false;
+        copy_out(end - n, out, n);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // the writer can be up to a quarter of the ring past what it has published
+        return written.load(std::memory_order_relaxed) + FRAMES / 4 - (end - n) <= FRAMES;
+    }
+
+    uint64_t frames_written() const { return written.load(std::memory_order_acquire); }
+    static constexpr std::size_t capacity() { return FRAMES; }
+};
@@ -0,0 +1,29 @@
+#include "cpu_features.h"
+#if SYNTH_HAVE_AVX2 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool cpu_has_avx2() {
+#if SYNTH_HAVE_AVX2 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif SYNTH_HAVE_AVX2 && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    __cpuid(regs, 1);
+    const bool fma = (regs[2] & (1 << 12)) != 0;
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave)
+        return false;
+    // the os has to save the upper halves of the ymm registers too
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// x86 builds get hand-written AVX2 kernels next to the portable ones,
+// which one runs is decided at startup from what the cpu actually supports
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SYNTH_HAVE_AVX2 1
+#else
+#define SYNTH_HAVE_AVX2 0
+#endif
+
+// lets a single function use AVX2/FMA intrinsics without building the whole program for them
+// msvc doesn't need this, it will emit any intrinsic regardless of /arch
+#if SYNTH_HAVE_AVX2 && (defined(__GNUC__) || defined(__clang__))
+#define SYNTH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SYNTH_TARGET_AVX2
+#endif
+
+// true if the cpu and os both support AVX2 and FMA
+bool cpu_has_avx2();
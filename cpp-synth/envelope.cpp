@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cmath>
+#include "envelope.h"
+#include "simd_transpose.h"
+
+// how far a curve of 1 bends: it covers all but 2^-CURVE_OCTAVES of the way to an overshoot
+// target in its time, and lands on the real target on the way
+constexpr double CURVE_OCTAVES = 10.0;
+
+EnvelopeShape gate_envelope() {
+    EnvelopeShape shape{};
+    shape.segment[0] = { 1.0f, 0.0f, 0.0f };
+    shape.count = 1;
+    shape.sustain = 0;
+    return shape;
+}
+
+EnvelopeShape adsr_envelope(float attack, float decay, float sustain, float release, float curve) {
+    EnvelopeShape shape{};
+    shape.segment[0] = { 1.0f, attack, curve };
+    shape.segment[1] = { sustain, decay, curve };
+    shape.count = 2;
+    shape.sustain = 1;
+    shape.release = { 0.0f, release, curve };
+    return shape;
+}
+
+static EnvSegment sanitise_segment(EnvSegment s) {
+    // written to catch nan as well
+    s.level = s.level >= 0.0f ? std::min(s.level, 1.0f) : 0.0f;
+    s.seconds = s.seconds >= 0.0f ? std::min(s.seconds, 60.0f) : 0.0f;
+    s.curve = s.curve >= 0.0f ? std::min(s.curve, 1.0f) : 0.0f;
+    return s;
+}
+
+EnvelopeShape sanitise_envelope(const EnvelopeShape& shape) {
+    EnvelopeShape s = shape;
+    s.count = std::clamp(s.count, 1, (int)ENV_MAX_SEGMENTS);
+    s.sustain = std::clamp(s.sustain, -1, s.count - 1);
+    for (auto& segment : s.segment)
+        segment = sanitise_segment(segment);
+    s.release = sanitise_segment(s.release);
+    s.release.level = 0.0f;
+    return s;
+}
+
+// the level x of the way through a segment from start, the same curve the recurrence follows
+static double segment_level(double start, const EnvSegment& s, double x) {
+    if (s.curve <= 0.0f || start == s.level)
+        return start + (s.level - start) * x;
+    const double r = 1.0 / (std::exp2(CURVE_OCTAVES * s.curve) - 1.0);
+    const double overshoot = s.level + (s.level - start) * r;
+    return overshoot + (start - overshoot) * std::exp2(-CURVE_OCTAVES * s.curve * x);
+}
+
+float envelope_level_at(const EnvelopeShape& shape, double seconds, double release_at) {
+    const EnvelopeShape s = sanitise_envelope(shape);
+    double level = 0.0, t = 0.0;
+    const double stop = release_at >= 0.0 ? std::min(seconds, release_at) : seconds;
+    bool ended = false;
+    for (int k = 0; k < s.count && !ended; ++k) {
+        const EnvSegment& seg = s.segment[k];
+        if (t + seg.seconds > stop) {
+            level = segment_level(level, seg, (stop - t) / seg.seconds);
+            ended = true;
+            break;
+        }
+        t += seg.seconds;
+        level = seg.level;
+        if (k == s.sustain)
+            break;
+    }
+    // a one-shot releases on its own once its segments run out
+    if (!ended && s.sustain < 0)
+        release_at = release_at >= 0.0 ? std::min(release_at, t) : t;
+    if (release_at < 0.0 || seconds < release_at)
+        return (float)level;
+    if (seconds - release_at >= s.release.seconds)
+        return 0.0f;
+    return (float)segment_level(level, s.release, (seconds - release_at) / s.release.seconds);
+}
+
+void advance_env_portable(float* level, const float* mul, const float* add, float* const* out, std::size_t first, std::size_t frames) {
+    float l[ENV_LANES];
+    std::copy(level, level + ENV_LANES, l);
+    // lanes inside, so the independent recurrences can share vector instructions
+    for (std::size_t i = 0; i < frames; ++i) {
+        for (std::size_t k = 0; k < ENV_LANES; ++k) {
+            out[k][first + i] = l[k];
+            l[k] = l[k] * mul[k] + add[k];
+        }
+    }
+    std::copy(l, l + ENV_LANES, level);
+}
+
+#if SYNTH_HAVE_AVX2
+SYNTH_TARGET_AVX2
+void advance_env_avx2(float* level, const float* mul, const float* add, float* const* out, std::size_t first, std::size_t frames) {
+    static_assert(ENV_LANES == 8, "one lane per float of an avx register");
+    __m256 l = _mm256_loadu_ps(level);
+    const __m256 m = _mm256_loadu_ps(mul);
+    const __m256 a = _mm256_loadu_ps(add);
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 r[8];
+        for (int t = 0; t < 8; ++t) {
+            r[t] = l;
+            l = _mm256_fmadd_ps(l, m, a);
+        }
+        transpose8(r);
+        for (std::size_t k = 0; k < ENV_LANES; ++k)
+            _mm256_storeu_ps(out[k] + first + i, r[k]);
+    }
+    // whatever doesn't fill a full vector
+    alignas(32) float tail[8][ENV_LANES];
+    const std::size_t n = frames - i;
+    for (std::size_t t = 0; t < n; ++t) {
+        _mm256_store_ps(tail[t], l);
+        l = _mm256_fmadd_ps(l, m, a);
+    }
+    for (std::size_t k = 0; k < ENV_LANES; ++k)
+        for (std::size_t t = 0; t < n; ++t)
+            out[k][first + i + t] = tail[t][k];
+    _mm256_storeu_ps(level, l);
+}
+#endif
+
+EnvKernel select_env_kernel() {
+#if SYNTH_HAVE_AVX2
+    if (cpu_has_avx2())
+        return advance_env_avx2;
+#endif
+    return advance_env_portable;
+}
+
+EnvelopeBank::EnvelopeBank(std::size_t voices)
+    : lanes((voices + ENV_LANES - 1) / ENV_LANES * ENV_LANES),
+      level(new float[lanes]),
+      mul(new float[lanes]),
+      add(new float[lanes]),
+      target(new float[lanes]),
+      left(new uint32_t[lanes]),
+      stage(new int8_t[lanes]),
+      kernel(select_env_kernel()) {
+    for (std::size_t k = 0; k < lanes; ++k)
+        clear(k);
+    set_shape(gate_envelope(), 48000.0);
+}
+
+void EnvelopeBank::set_shape(const EnvelopeShape& shape, double rate) {
+    const EnvelopeShape s = sanitise_envelope(shape);
+    auto to_stage = [rate](const EnvSegment& seg) {
+        return Stage{ seg.level, (uint32_t)std::min(std::llround(seg.seconds * rate), (long long)INT32_MAX), seg.curve };
+    };
+    for (int k = 0; k < s.count; ++k)
+        stages[k] = to_stage(s.segment[k]);
+    stages[RELEASE] = to_stage(s.release);
+    count = s.count;
+    sustain = s.sustain;
+    timed = stages[RELEASE].samples > 0;
+    for (int k = 0; k < count; ++k)
+        timed |= stages[k].samples > 0;
+    // held notes glide to the new sustain level with its segment, or let go if there isn't one
+    for (std::size_t k = 0; k < lanes; ++k)
+        if (left[k] == HOLD && stage[k] < RELEASE)
+            begin(k, sustain >= 0 ? sustain : RELEASE);
+}
+
+void EnvelopeBank::begin(std::size_t lane, int s) {
+    // bounded, every segment that takes no time moves on to a later one
+    for (;;) {
+        stage[lane] = (int8_t)s;
+        if (s == IDLE) {
+            level[lane] = target[lane] = 0.0f;
+            mul[lane] = 1.0f;
+            add[lane] = 0.0f;
+            left[lane] = HOLD;
+            return;
+        }
+        const Stage& st = stages[s];
+        const float end = s == RELEASE ? 0.0f : st.level;
+        target[lane] = end;
+        if (st.samples > 0)
+            break;
+        level[lane] = end;
+        if (s == sustain) {
+            mul[lane] = 1.0f;
+            add[lane] = 0.0f;
+            left[lane] = HOLD;
+            return;
+        }
+        s = s == RELEASE ? IDLE : s + 1 < count ? s + 1 : RELEASE;
+    }
+
+    // straight lines add the same step every sample. curves head for a target past the end
+    // that they'd only reach after forever, and get 1 - 2^-CURVE_OCTAVES * curve of the way
+    // there in the segment's time, which is exactly where the segment ends
+    const Stage& st = stages[s];
+    const double from = level[lane], to = target[lane];
+    if (st.curve <= 0.0f || from == to) {
+        mul[lane] = 1.0f;
+        add[lane] = (float)((to - from) / st.samples);
+    }
+    else {
+        const double r = 1.0 / (std::exp2(CURVE_OCTAVES * st.curve) - 1.0);
+        const double c = std::exp2(-CURVE_OCTAVES * st.curve / st.samples);
+        mul[lane] = (float)c;
+        add[lane] = (float)((to + (to - from) * r) * (1.0 - c));
+    }
+    left[lane] = st.samples;
+}
+
+void EnvelopeBank::finish(std::size_t lane) {
+    level[lane] = target[lane];
+    const int s = stage[lane];
+    if (s == RELEASE)
+        begin(lane, IDLE);
+    else if (s == sustain) {
+        mul[lane] = 1.0f;
+        add[lane] = 0.0f;
+        left[lane] = HOLD;
+    }
+    else
+        begin(lane, s + 1 < count ? s + 1 : RELEASE);
+}
+
+void EnvelopeBank::start(std::size_t lane, bool from_silence) {
+    if (from_silence)
+        level[lane] = 0.0f;
+    begin(lane, 0);
+}
+
+bool EnvelopeBank::release(std::size_t lane) {
+    if (stages[RELEASE].samples == 0) {
+        begin(lane, IDLE);
+        return false;
+    }
+    if (stage[lane] < RELEASE)
+        begin(lane, RELEASE);
+    return true;
+}
+
+void EnvelopeBank::move(std::size_t from, std::size_t to) {
+    level[to] = level[from];
+    mul[to] = mul[from];
+    add[to] = add[from];
+    target[to] = target[from];
+    left[to] = left[from];
+    stage[to] = stage[from];
+}
+
+void EnvelopeBank::clear(std::size_t lane) {
+    begin(lane, IDLE);
+}
+
+unsigned EnvelopeBank::advance(std::size_t first, std::size_t frames, float* const* out, unsigned& idle) {
+    // a lane holding still for the whole block costs nothing, its level is just a gain. but
+    // folded into the gain it rounds differently from a row of it, so while any segment takes
+    // time a lane that could have settled partway through this block or an earlier one is
+    // written out too, and a song renders the same whatever blocks it is cut into
+    unsigned moving = 0;
+    for (std::size_t k = 0; k < ENV_LANES; ++k) {
+        const std::size_t l = first + k;
+        if (mul[l] != 1.0f || add[l] != 0.0f || left[l] <= frames || (timed && level[l] != 0.0f))
+            moving |= 1u << k;
+    }
+    if (!moving) {
+        for (std::size_t l = first; l < first + ENV_LANES; ++l)
+            if (left[l] != HOLD)
+                left[l] -= (uint32_t)frames;
+    }
+    else {
+        // every lane runs until the first of them reaches the end of its segment
+        for (std::size_t i = 0; i < frames;) {
+            std::size_t n = frames - i;
+            for (std::size_t l = first; l < first + ENV_LANES; ++l)
+                n = std::min<std::size_t>(n, left[l]);
+            kernel(&level[first], &mul[first], &add[first], out, i, n);
+            i += n;
+            for (std::size_t l = first; l < first + ENV_LANES; ++l) {
+                if (left[l] != HOLD)
+                    left[l] -= (uint32_t)n;
+                if (left[l] == 0)
+                    finish(l);
+            }
+        }
+    }
+    idle = 0;
+    for (std::size_t k = 0; k < ENV_LANES; ++k)
+        if (stage[first + k] == IDLE)
+            idle |= 1u << k;
+    return moving;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "cpu_features.h"
+
+// most segments an envelope can have before its release
+constexpr std::size_t ENV_MAX_SEGMENTS = 8;
+// envelopes are advanced this many voices at a time, one render chunk in one avx register
+constexpr std::size_t ENV_LANES = 8;
+
+// one stage of an envelope, from wherever the last one ended to level over seconds. curve 0 is a
+// straight line, towards 1 it bends into an exponential that moves quickly at first and eases in
+struct EnvSegment {
+    float level;
+    float seconds;
+    float curve;
+};
+
+// the amplitude envelope every voice follows: from 0 through up to ENV_MAX_SEGMENTS segments,
+// holding at the end of segment sustain while the note is down, then released to 0 from wherever
+// it got to. with sustain -1 the release follows the last segment on its own, for one-shots
+struct EnvelopeShape {
+    EnvSegment segment[ENV_MAX_SEGMENTS];
+    int32_t count;
+    int32_t sustain;
+    EnvSegment release; // level is ignored, a release always ends at 0
+};
+
+// full level from the first sample of a note to the last, how voices sounded before envelopes
+EnvelopeShape gate_envelope();
+// attack to 1, decay to sustain and hold there until the release
+EnvelopeShape adsr_envelope(float attack, float decay, float sustain, float release, float curve = 0.0f);
+// at least one segment, sustain one of them or -1, levels 0-1, no negative times or curves
+EnvelopeShape sanitise_envelope(const EnvelopeShape& shape);
+// the level of shape seconds after note on, for drawing it. released at release_at if it's >= 0
+float envelope_level_at(const EnvelopeShape& shape, double seconds, double release_at = -1.0);
+
+// runs ENV_LANES envelopes frames samples on, each sample one multiply and one add:
+// level = level * mul + add. the level before each step goes to out[lane][first + i]
+using EnvKernel = void (*)(float* level, const float* mul, const float* add, float* const* out, std::size_t first, std::size_t frames);
+void advance_env_portable(float* level, const float* mul, const float* add, float* const* out, std::size_t first, std::size_t frames);
+#if SYNTH_HAVE_AVX2
+// all the lanes in one register, transposed eight samples at a time into the lanes' rows
+void advance_env_avx2(float* level, const float* mul, const float* add, float* const* out, std::size_t first, std::size_t frames);
+#endif
+EnvKernel select_env_kernel();
+
+// the envelope state of a whole voice pool, struct of arrays by active slot so the voices of one
+// render chunk are ENV_LANES neighbouring lanes. each lane is only ever in a straight or curved
+// segment with a sample count, a hold, or idle, so advancing it never needs a pow or exp.
+// owned by the audio thread, the render threads each only advance the lanes of their own chunk
+class EnvelopeBank
+{
+private:
+    // a segment in samples at the current rate, the release last
+    struct Stage {
+        float level;
+        uint32_t samples;
+        float curve;
+    };
+    Stage stages[ENV_MAX_SEGMENTS + 1]{};
+    int count{ 1 };
+    int sustain{ 0 };
+    bool timed{ false };  // some segment takes time, so a lane can move in one block and hold in the next
+    std::size_t lanes;
+    std::unique_ptr<float[]> level;
+    std::unique_ptr<float[]> mul;
+    std::unique_ptr<float[]> add;
+    std::unique_ptr<float[]> target;   // where the current segment ends
+    std::unique_ptr<uint32_t[]> left;  // samples to the end of it, HOLD for a hold or idle
+    std::unique_ptr<int8_t[]> stage;
+    EnvKernel kernel;
+    // starts stage s of lane from wherever the lane is, going straight on through any that take no time
+    void begin(std::size_t lane, int s);
+    // lands lane exactly on the end of its segment and starts whatever comes next
+    void finish(std::size_t lane);
+public:
+    static constexpr int RELEASE = (int)ENV_MAX_SEGMENTS;
+    static constexpr int IDLE = RELEASE + 1;
+    static constexpr uint32_t HOLD = UINT32_MAX;
+
+    // room for voices lanes, rounded up to whole chunks
+    explicit EnvelopeBank(std::size_t voices);
+    // lanes holding their sustain go on to the new one, running segments finish as they were
+    void set_shape(const EnvelopeShape& shape, double rate);
+    void set_kernel(EnvKernel k) { kernel = k; }
+    // note on, from silence for a fresh voice or from wherever a stolen one had got to
+    void start(std::size_t lane, bool from_silence);
+    // note off, false if the release takes no time so the voice can stop straight away
+    bool release(std::size_t lane);
+    // a voice moved to another slot, and a slot left empty
+    void move(std::size_t from, std::size_t to);
+    void clear(std::size_t lane);
+    float level_of(std::size_t lane) const { return level[lane]; }
+    // samples until lane's release runs out, HOLD if it isn't releasing
+    uint32_t release_left(std::size_t lane) const { return stage[lane] == RELEASE ? left[lane] : HOLD; }
+    // advances the ENV_LANES lanes from first by frames samples. returns the lanes whose every
+    // sample is written to out[lane]: the ones that change level in that time and, if any segment
+    // takes time, every one that isn't silent. the rest hold level_of() for all of it. idle is
+    // set to the lanes that have finished their release
+    unsigned advance(std::size_t first, std::size_t frames, float* const* out, unsigned& idle);
+};
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include "filter.h"
+#include "simd_transpose.h"
+
+// the cutoff gain table covers log2(cutoff / rate) from GAIN_LOWEST up to -1 (nyquist) in
+// steps of 1/GAIN_STEPS of an octave, close enough for linear interpolation to be within 2e-5
+constexpr float GAIN_LOWEST = -16.0f;
+constexpr int GAIN_STEPS = 64;
+constexpr std::size_t GAIN_ENTRIES = (std::size_t)(-1.0f - GAIN_LOWEST) * GAIN_STEPS + 1;
+// the highest cutoff a filter is run at, as a fraction of the rate, tan() goes to infinity at 0.5
+constexpr float GAIN_HIGHEST = -1.0291463f; // log2(0.49)
+
+// the state variable filter's damping from no resonance (2, a Q of 0.5) to a Q of 25,
+// and the ladder's feedback from none to just under the 4 where it would oscillate
+constexpr float SVF_DAMPING = 2.0f;
+constexpr float SVF_DAMPING_RANGE = 1.96f;
+constexpr float LADDER_FEEDBACK = 3.9f;
+// states smaller than this are flushed to 0 at every control point, before they can become
+// denormal. the control grid runs on across blocks, so where a block ends doesn't change when
+constexpr float STATE_FLOOR = 1e-15f;
+
+static const std::array<float, GAIN_ENTRIES> gain_table = [] {
+    std::array<float, GAIN_ENTRIES> t{};
+    for (std::size_t i = 0; i < GAIN_ENTRIES; ++i) {
+        const double ratio = std::exp2(GAIN_LOWEST + (double)i / GAIN_STEPS);
+        t[i] = (float)std::tan(3.14159265358979323846 * std::min(ratio, 0.499));
+    }
+    return t;
+}();
+
+FilterSettings default_filter() {
+    return { (int32_t)FilterMode::Off, 2000.0f, 0.3f, 0.0f };
+}
+
+FilterSettings sanitise_filter(const FilterSettings& settings) {
+    FilterSettings s = settings;
+    if (s.mode < 0 || s.mode >= (int32_t)FILTER_MODES)
+        s.mode = (int32_t)FilterMode::Off;
+    // written to catch nan as well
+    s.cutoff = s.cutoff >= FILTER_MIN_CUTOFF ? std::min(s.cutoff, FILTER_MAX_CUTOFF) : FILTER_MIN_CUTOFF;
+    s.resonance = s.resonance >= 0.0f ? std::min(s.resonance, 1.0f) : 0.0f;
+    s.key_track = s.key_track >= 0.0f ? std::min(s.key_track, 1.0f) : 0.0f;
+    return s;
+}
+
+float filter_gain(float log2_ratio) {
+    const float x = log2_ratio >= GAIN_LOWEST ? std::min(log2_ratio, GAIN_HIGHEST) : GAIN_LOWEST;
+    const float pos = (x - GAIN_LOWEST) * GAIN_STEPS;
+    const std::size_t i = (std::size_t)pos;
+    const float frac = pos - (float)i;
+    return gain_table[i] + frac * (gain_table[i + 1] - gain_table[i]);
+}
+
+// the topology-preserving transform state variable filter and ladder, one lane one sample at a time.
+// s holds the channel's state, the coefficients are worked out from g and k by the caller
+template <FilterMode M>
+static inline float svf_tick(float* s, float x, float a1, float a2, float a3, float k) {
+    const float v3 = x - s[1];
+    const float v1 = a1 * s[0] + a2 * v3;
+    const float v2 = s[1] + a2 * s[0] + a3 * v3;
+    s[0] = 2.0f * v1 - s[0];
+    s[1] = 2.0f * v2 - s[1];
+    if constexpr (M == FilterMode::LowPass)
+        return v2;
+    else if constexpr (M == FilterMode::BandPass)
+        return v1;
+    else if constexpr (M == FilterMode::HighPass)
+        return x - k * v1 - v2;
+    else
+        return x - k * v1;
+}
+
+// four one pole low passes in a row with the last one's output fed back into the first. the
+// feedback is solved for exactly: u = (x - k * S) / (1 + k * G^4), with S what the four poles'
+// states alone would put out
+static inline float ladder_tick(float* s, float x, float G, float k, float inv) {
+    const float S = (1.0f - G) * (s[3] + G * (s[2] + G * (s[1] + G * s[0])));
+    float y = (x - k * S) * inv;
+    for (int p = 0; p < 4; ++p) {
+        const float v = (y - s[p]) * G;
+        y = v + s[p];
+        s[p] = y + v;
+    }
+    return y;
+}
+
+template <FilterMode M>
+static void filter_portable(FilterLanes& f, const float* const* left_in, const float* const* right_in, float* left, float* right, std::size_t first, std::size_t frames) {
+    for (std::size_t i = first; i < first + frames; ++i) {
+        float sum_left = 0.0f, sum_right = 0.0f;
+        for (std::size_t k = 0; k < FILTER_LANES; ++k) {
+            float s_left[4], s_right[4];
+            for (int p = 0; p < 4; ++p) {
+                s_left[p] = f.state[0][p][k];
+                s_right[p] = f.state[1][p][k];
+            }
+            const float g = f.g[k], kk = f.k[k];
+            if constexpr (M == FilterMode::Ladder) {
+                const float g2 = g * g;
+                const float inv = 1.0f / (1.0f + kk * g2 * g2);
+                sum_left += ladder_tick(s_left, left_in[k][i], g, kk, inv);
+                sum_right += ladder_tick(s_right, right_in[k][i], g, kk, inv);
+            }
+            else {
+                const float a1 = 1.0f / (1.0f + g * (g + kk));
+                const float a2 = g * a1;
+                const float a3 = g * a2;
+                sum_left += svf_tick<M>(s_left, left_in[k][i], a1, a2, a3, kk);
+                sum_right += svf_tick<M>(s_right, right_in[k][i], a1, a2, a3, kk);
+            }
+            for (int p = 0; p < 4; ++p) {
+                f.state[0][p][k] = s_left[p];
+                f.state[1][p][k] = s_right[p];
+            }
+            f.g[k] += f.g_step[k];
+            f.k[k] += f.k_step[k];
+        }
+        left[i] += sum_left;
+        right[i] += sum_right;
+    }
+}
+
+FilterKernels portable_filter_kernels() {
+    return { { nullptr, filter_portable<FilterMode::LowPass>, filter_portable<FilterMode::BandPass>,
+        filter_portable<FilterMode::HighPass>, filter_portable<FilterMode::Notch>, filter_portable<FilterMode::Ladder> } };
+}
+
+#if SYNTH_HAVE_AVX2
+// the coefficients of one sample for every lane, shared by both channels
+struct FilterCoeffs {
+    __m256 a1, a2, a3, k, inv;
+};
+
+template <FilterMode M>
+SYNTH_TARGET_AVX2
+static inline FilterCoeffs coeffs_avx2(__m256 g, __m256 k) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    FilterCoeffs c;
+    c.k = k;
+    if constexpr (M == FilterMode::Ladder) {
+        const __m256 g2 = _mm256_mul_ps(g, g);
+        c.inv = _mm256_div_ps(one, _mm256_fmadd_ps(k, _mm256_mul_ps(g2, g2), one));
+    }
+    else {
+        c.a1 = _mm256_div_ps(one, _mm256_fmadd_ps(g, _mm256_add_ps(g, k), one));
+        c.a2 = _mm256_mul_ps(g, c.a1);
+        c.a3 = _mm256_mul_ps(g, c.a2);
+    }
+    return c;
+}
+
+template <FilterMode M>
+SYNTH_TARGET_AVX2
+static inline __m256 tick_avx2(__m256* s, __m256 x, __m256 g, const FilterCoeffs& c) {
+    if constexpr (M == FilterMode::Ladder) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 S = _mm256_fmadd_ps(g, s[0], s[1]);
+        S = _mm256_fmadd_ps(g, S, s[2]);
+        S = _mm256_fmadd_ps(g, S, s[3]);
+        S = _mm256_mul_ps(_mm256_sub_ps(one, g), S);
+        __m256 y = _mm256_mul_ps(_mm256_fnmadd_ps(c.k, S, x), c.inv);
+        for (int p = 0; p < 4; ++p) {
+            const __m256 v = _mm256_mul_ps(_mm256_sub_ps(y, s[p]), g);
+            y = _mm256_add_ps(v, s[p]);
+            s[p] = _mm256_add_ps(y, v);
+        }
+        return y;
+    }
+    else {
+        const __m256 two = _mm256_set1_ps(2.0f);
+        const __m256 v3 = _mm256_sub_ps(x, s[1]);
+        const __m256 v1 = _mm256_fmadd_ps(c.a1, s[0], _mm256_mul_ps(c.a2, v3));
+        const __m256 v2 = _mm256_add_ps(s[1], _mm256_fmadd_ps(c.a2, s[0], _mm256_mul_ps(c.a3, v3)));
+        s[0] = _mm256_fmsub_ps(two, v1, s[0]);
+        s[1] = _mm256_fmsub_ps(two, v2, s[1]);
+        if constexpr (M == FilterMode::LowPass)
+            return v2;
+        else if constexpr (M == FilterMode::BandPass)
+            return v1;
+        else if constexpr (M == FilterMode::HighPass)
+            return _mm256_sub_ps(_mm256_fnmadd_ps(c.k, v1, x), v2);
+        else
+            return _mm256_fnmadd_ps(c.k, v1, x);
+    }
+}
+
+// every lane in one register: eight samples of each lane's rows are transposed into eight
+// samples of all lanes, filtered, transposed back and the lanes summed
+template <FilterMode M>
+SYNTH_TARGET_AVX2
+static void filter_avx2(FilterLanes& f, const float* const* left_in, const float* const* right_in, float* left, float* right, std::size_t first, std::size_t frames) {
+    static_assert(FILTER_LANES == 8, "one lane per float of an avx register");
+    constexpr int STATES = M == FilterMode::Ladder ? 4 : 2;
+    const float* const* in[2] = { left_in, right_in };
+    float* out[2] = { left, right };
+    __m256 s[2][4];
+    for (int c = 0; c < 2; ++c)
+        for (int p = 0; p < STATES; ++p)
+            s[c][p] = _mm256_load_ps(f.state[c][p]);
+    __m256 g = _mm256_load_ps(f.g), k = _mm256_load_ps(f.k);
+    const __m256 g_step = _mm256_load_ps(f.g_step), k_step = _mm256_load_ps(f.k_step);
+
+    std::size_t i = first;
+    for (; i + 8 <= first + frames; i += 8) {
+        __m256 x[2][8];
+        for (int c = 0; c < 2; ++c) {
+            for (std::size_t lane = 0; lane < FILTER_LANES; ++lane)
+                x[c][lane] = _mm256_loadu_ps(in[c][lane] + i);
+            transpose8(x[c]);
+        }
+        for (int t = 0; t < 8; ++t) {
+            const FilterCoeffs co = coeffs_avx2<M>(g, k);
+            x[0][t] = tick_avx2<M>(s[0], x[0][t], g, co);
+            x[1][t] = tick_avx2<M>(s[1], x[1][t], g, co);
+            g = _mm256_add_ps(g, g_step);
+            k = _mm256_add_ps(k, k_step);
+        }
+        for (int c = 0; c < 2; ++c) {
+            transpose8(x[c]);
+            const __m256 sum = _mm256_add_ps(
+                _mm256_add_ps(_mm256_add_ps(x[c][0], x[c][1]), _mm256_add_ps(x[c][2], x[c][3])),
+                _mm256_add_ps(_mm256_add_ps(x[c][4], x[c][5]), _mm256_add_ps(x[c][6], x[c][7])));
+            _mm256_storeu_ps(out[c] + i, _mm256_add_ps(_mm256_loadu_ps(out[c] + i), sum));
+        }
+    }
+    // whatever doesn't fill a full vector, a sample of every lane at a time
+    for (; i < first + frames; ++i) {
+        const FilterCoeffs co = coeffs_avx2<M>(g, k);
+        for (int c = 0; c < 2; ++c) {
+            alignas(32) float x[FILTER_LANES];
+            for (std::size_t lane = 0; lane < FILTER_LANES; ++lane)
+                x[lane] = in[c][lane][i];
+            _mm256_store_ps(x, tick_avx2<M>(s[c], _mm256_load_ps(x), g, co));
+            // the lanes added in the same pairs as above, so a sample comes out the same
+            // wherever a block ends
+            out[c][i] += ((x[0] + x[1]) + (x[2] + x[3])) + ((x[4] + x[5]) + (x[6] + x[7]));
+        }
+        g = _mm256_add_ps(g, g_step);
+        k = _mm256_add_ps(k, k_step);
+    }
+
+    for (int c = 0; c < 2; ++c)
+        for (int p = 0; p < STATES; ++p)
+            _mm256_store_ps(f.state[c][p], s[c][p]);
+    _mm256_store_ps(f.g, g);
+    _mm256_store_ps(f.k, k);
+}
+
+FilterKernels avx2_filter_kernels() {
+    return { { nullptr, filter_avx2<FilterMode::LowPass>, filter_avx2<FilterMode::BandPass>,
+        filter_avx2<FilterMode::HighPass>, filter_avx2<FilterMode::Notch>, filter_avx2<FilterMode::Ladder> } };
+}
+#endif
+
+FilterKernels select_filter_kernels() {
+#if SYNTH_HAVE_AVX2
+    if (cpu_has_avx2())
+        return avx2_filter_kernels();
+#endif
+    return portable_filter_kernels();
+}
+
+FilterBank::FilterBank(std::size_t voices)
+    : chunk_count((voices + FILTER_LANES - 1) / FILTER_LANES),
+      chunks(new FilterLanes[chunk_count]),
+      kernels(select_filter_kernels()) {
+    for (std::size_t lane = 0; lane < chunk_count * FILTER_LANES; ++lane)
+        clear(lane);
+}
+
+void FilterBank::coefficients(float cutoff, float& g, float& k) const {
+    const float t = filter_gain(cutoff);
+    if (mode == FilterMode::Ladder) {
+        g = t / (1.0f + t);
+        k = LADDER_FEEDBACK * resonance;
+    }
+    else {
+        g = t;
+        k = SVF_DAMPING - SVF_DAMPING_RANGE * resonance;
+    }
+}
+
+void FilterBank::set_mode(FilterMode m) {
+    mode = m;
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        FilterLanes& f = chunks[c];
+        std::memset(f.state, 0, sizeof f.state);
+        for (std::size_t k = 0; k < FILTER_LANES; ++k) {
+            coefficients(f.cutoff[k], f.g[k], f.k[k]);
+            f.g_step[k] = f.k_step[k] = 0.0f;
+        }
+    }
+}
+
+void FilterBank::start(std::size_t lane, float cutoff, bool from_silence) {
+    FilterLanes& f = chunks[lane / FILTER_LANES];
+    const std::size_t k = lane % FILTER_LANES;
+    for (auto& channel : f.state)
+        for (auto& s : channel)
+            if (from_silence)
+                s[k] = 0.0f;
+    f.cutoff[k] = cutoff;
+    coefficients(cutoff, f.g[k], f.k[k]);
+    f.g_step[k] = f.k_step[k] = 0.0f;
+}
+
+void FilterBank::move(std::size_t from, std::size_t to) {
+    const FilterLanes& a = chunks[from / FILTER_LANES];
+    FilterLanes& b = chunks[to / FILTER_LANES];
+    const std::size_t i = from % FILTER_LANES, j = to % FILTER_LANES;
+    for (int c = 0; c < 2; ++c)
+        for (int p = 0; p < 4; ++p)
+            b.state[c][p][j] = a.state[c][p][i];
+    b.g[j] = a.g[i];
+    b.k[j] = a.k[i];
+    b.g_step[j] = a.g_step[i];
+    b.k_step[j] = a.k_step[i];
+    b.cutoff[j] = a.cutoff[i];
+}
+
+void FilterBank::clear(std::size_t lane) {
+    start(lane, GAIN_LOWEST, true);
+}
+
+void FilterBank::aim(std::size_t chunk, const float* cutoff, std::size_t used, unsigned ramp) {
+    FilterLanes& f = chunks[chunk];
+    for (auto& channel : f.state)
+        for (auto& s : channel)
+            for (float& v : s)
+                if (std::fabs(v) < STATE_FLOOR)
+                    v = 0.0f;
+    const float scale = 1.0f / (float)ramp;
+    // empty lanes stay where they were cleared to, however long until the chunk is next aimed
+    for (std::size_t k = used; k < FILTER_LANES; ++k)
+        f.g_step[k] = f.k_step[k] = 0.0f;
+    for (std::size_t k = 0; k < used; ++k) {
+        float g, kk;
+        f.cutoff[k] = cutoff[k];
+        coefficients(cutoff[k], g, kk);
+        f.g_step[k] = (g - f.g[k]) * scale;
+        f.k_step[k] = (kk - f.k[k]) * scale;
+    }
+}
+
+void FilterBank::run(std::size_t chunk, const float* const* left_in, const float* const* right_in, float* left, float* right, std::size_t first, std::size_t frames) {
+    FilterLanes& f = chunks[chunk];
+    kernels.mode[(std::size_t)mode](f, left_in, right_in, left, right, first, frames);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "cpu_features.h"
+
+// filters are run this many voices at a time, one render chunk in one avx register
+constexpr std::size_t FILTER_LANES = 8;
+
+// what every voice goes through before it is mixed in
+enum class FilterMode : unsigned char {
+    Off,      // straight through, the voices are mixed as they always were
+    LowPass,  // 2-pole state variable filter, 12 dB an octave
+    BandPass, // the same filter's band pass, high pass and notch outputs
+    HighPass,
+    Notch,
+    Ladder,   // 4-pole low pass, 24 dB an octave, with the last pole fed back for resonance
+};
+constexpr std::size_t FILTER_MODES = 6;
+inline constexpr const char* FILTER_NAMES[FILTER_MODES] = { "off", "lowpass", "bandpass", "highpass", "notch", "ladder" };
+
+constexpr float FILTER_MIN_CUTOFF = 20.0f;
+constexpr float FILTER_MAX_CUTOFF = 20000.0f;
+// the note whose cutoff is the one set, key tracking moves the others away from it
+constexpr int FILTER_KEY_CENTRE = 60;
+
+// the filter of a patch, in the units the gui sends it in
+struct FilterSettings {
+    int32_t mode;      // a FilterMode
+    float cutoff;      // Hz, at FILTER_KEY_CENTRE
+    float resonance;   // 0-1, at 1 it rings on the edge of oscillating
+    float key_track;   // 0-1, at 1 the cutoff moves a semitone with every semitone of the note
+};
+
+// off, with a cutoff and resonance that sound like something once it's switched on
+FilterSettings default_filter();
+// a known mode and everything else in range
+FilterSettings sanitise_filter(const FilterSettings& settings);
+// tan(pi * cutoff / rate), the prewarped gain of a filter at cutoff, from log2(cutoff / rate).
+// looked up in a table, cutoffs too close to nyquist are held just under it
+float filter_gain(float log2_ratio);
+
+// the filters of one render chunk, each member one value per lane so a lane's voice moves
+// in one register. coefficients are ramped from one control point to the next
+struct alignas(32) FilterLanes {
+    float state[2][4][FILTER_LANES]; // per channel, the state variable filter uses the first two
+    float g[FILTER_LANES];           // the cutoff's gain, for the ladder that of each pole g / (1 + g)
+    float k[FILTER_LANES];           // damping for the state variable filter, feedback for the ladder
+    float g_step[FILTER_LANES];      // added to them every sample until the next control point
+    float k_step[FILTER_LANES];
+    float cutoff[FILTER_LANES];      // log2 of the cutoff last aimed at over the rate
+};
+
+// filters frames samples of every lane's two channels, from in[lane][first] on, and adds the
+// lanes together into left and right from first. the coefficients move on by their steps
+using FilterKernel = void (*)(FilterLanes& lanes, const float* const* left_in, const float* const* right_in, float* left, float* right, std::size_t first, std::size_t frames);
+// a kernel for each mode, with the mode's output picked at compile time. Off has none
+struct FilterKernels {
+    FilterKernel mode[FILTER_MODES];
+};
+FilterKernels portable_filter_kernels();
+#if SYNTH_HAVE_AVX2
+FilterKernels avx2_filter_kernels();
+#endif
+FilterKernels select_filter_kernels();
+
+// the filter of every voice in a pool, by active slot like the envelopes, so a render chunk's
+// voices are the lanes of one FilterLanes. owned by the audio thread, the render threads each
+// only aim and run their own chunk
+class FilterBank
+{
+private:
+    std::size_t chunk_count;
+    std::unique_ptr<FilterLanes[]> chunks;
+    FilterMode mode{ FilterMode::Off };
+    float resonance{ 0.0f };
+    FilterKernels kernels;
+    // the mode's coefficients for a cutoff at the current resonance
+    void coefficients(float cutoff, float& g, float& k) const;
+public:
+    // room for voices lanes, rounded up to whole chunks
+    explicit FilterBank(std::size_t voices);
+    // every lane starts again from silence, so no filter runs on another mode's state
+    void set_mode(FilterMode m);
+    FilterMode get_mode() const { return mode; }
+    // taken up from each chunk's next control point
+    void set_resonance(float r) { resonance = r; }
+    void set_kernels(const FilterKernels& k) { kernels = k; }
+    // note on, with the coefficients straight at cutoff, log2 of it over the rate. a fresh voice
+    // starts from silence, a stolen one keeps ringing from where it was so it doesn't click
+    void start(std::size_t lane, float cutoff, bool from_silence);
+    // a voice moved to another slot, and a slot left empty
+    void move(std::size_t from, std::size_t to);
+    void clear(std::size_t lane);
+    // a control point, the first used lanes of chunk ramp from where they are to cutoff[lane]
+    // over ramp samples, the rest stay put
+    void aim(std::size_t chunk, const float* cutoff, std::size_t used, unsigned ramp);
+    // filters frames samples of chunk's voices from first on and adds them into left and right
+    void run(std::size_t chunk, const float* const* left_in, const float* const* right_in, float* left, float* right, std::size_t first, std::size_t frames);
+};
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include "fm_kernel.h"
+#include "wavetable.h"
+
+// one linear read, at a phase that already has its modulation added
+static inline float fm_read(const float* table, uint32_t phase) {
+    const uint32_t idx = phase >> PHASE_FRAC_BITS;
+    const float frac = (phase & PHASE_FRAC_MASK) * PHASE_FRAC_SCALE;
+    const float a = table[idx];
+    return a + frac * (table[idx + 1] - a);
+}
+
+// a modulator's output in fixed point phase, several cycles wrap round like the phase does
+static inline uint32_t fm_offset(float x) {
+    return (uint32_t)(int64_t)x;
+}
+
+template <FmAlgorithm ALG, bool FEEDBACK>
+static void render_fm(FmOperator* ops, float feedback, float* history, float* out, std::size_t frames) {
+    const FmOperator& a = ops[0];
+    const FmOperator& b = ops[1];
+    const FmOperator& c = ops[2];
+    uint32_t pa = a.phase, pb = b.phase, pc = c.phase;
+    float h0 = history[0], h1 = history[1];
+    for (std::size_t i = 0; i < frames; ++i) {
+        uint32_t fa = pa;
+        if constexpr (FEEDBACK)
+            fa += fm_offset(feedback * (h0 + h1));
+        const float ya = fm_read(a.table, fa);
+        if constexpr (FEEDBACK) {
+            h1 = h0;
+            h0 = ya;
+        }
+        if constexpr (ALG == FmAlgorithm::Stack) {
+            const float yb = fm_read(b.table, pb + fm_offset(ya * a.scale * a.gain[i]));
+            const float yc = fm_read(c.table, pc + fm_offset(yb * b.scale * b.gain[i]));
+            out[i] += yc * c.scale * c.gain[i];
+        }
+        else if constexpr (ALG == FmAlgorithm::Branch) {
+            const float yb = fm_read(b.table, pb);
+            const float yc = fm_read(c.table, pc + fm_offset(ya * a.scale * a.gain[i] + yb * b.scale * b.gain[i]));
+            out[i] += yc * c.scale * c.gain[i];
+        }
+        else if constexpr (ALG == FmAlgorithm::Fan) {
+            const uint32_t m = fm_offset(ya * a.scale * a.gain[i]);
+            const float yb = fm_read(b.table, pb + m);
+            const float yc = fm_read(c.table, pc + m);
+            out[i] += yb * b.scale * b.gain[i] + yc * c.scale * c.gain[i];
+        }
+        else if constexpr (ALG == FmAlgorithm::Pair) {
+            const float yb = fm_read(b.table, pb + fm_offset(ya * a.scale * a.gain[i]));
+            const float yc = fm_read(c.table, pc);
+            out[i] += yb * b.scale * b.gain[i] + yc * c.scale * c.gain[i];
+        }
+        else {
+            const float yb = fm_read(b.table, pb);
+            const float yc = fm_read(c.table, pc);
+            out[i] += ya * a.scale * a.gain[i] + yb * b.scale * b.gain[i] + yc * c.scale * c.gain[i];
+        }
+        pa += a.inc;
+        pb += b.inc;
+        pc += c.inc;
+    }
+    ops[0].phase = pa;
+    ops[1].phase = pb;
+    ops[2].phase = pc;
+    history[0] = h0;
+    history[1] = h1;
+}
+
+FmKernel select_fm_kernel(FmAlgorithm algorithm, bool feedback) {
+    static const FmKernel kernels[FM_ALGORITHMS][2] = {
+        { nullptr, nullptr },
+        { render_fm<FmAlgorithm::Stack, false>, render_fm<FmAlgorithm::Stack, true> },
+        { render_fm<FmAlgorithm::Branch, false>, render_fm<FmAlgorithm::Branch, true> },
+        { render_fm<FmAlgorithm::Fan, false>, render_fm<FmAlgorithm::Fan, true> },
+        { render_fm<FmAlgorithm::Pair, false>, render_fm<FmAlgorithm::Pair, true> },
+        { render_fm<FmAlgorithm::Parallel, false>, render_fm<FmAlgorithm::Parallel, true> },
+    };
+    return kernels[std::min((std::size_t)algorithm, FM_ALGORITHMS - 1)][feedback ? 1 : 0];
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// how the three oscillators are wired together. in every algorithm but Additive they are
+// operators: a modulator's output is added to the phase of the operator under it every sample
+// instead of being heard, so what comes out is phase modulation
+enum class FmAlgorithm : unsigned char {
+    Additive, // A + B + C mixed, nothing modulated, how patches sounded before
+    Stack,    // A -> B -> C, C heard
+    Branch,   // A and B both into C, C heard
+    Fan,      // A into both B and C, B and C heard
+    Pair,     // A -> B, B heard alongside C
+    Parallel, // A, B and C all heard, like Additive but with A's feedback
+};
+constexpr std::size_t FM_ALGORITHMS = 6;
+inline constexpr const char* FM_ALGORITHM_NAMES[FM_ALGORITHMS] = { "add", "stack", "branch", "fan", "pair", "parallel" };
+// the oscillators each algorithm mixes into the voice, one bit each, the rest only modulate
+inline constexpr unsigned FM_CARRIERS[FM_ALGORITHMS] = { 7, 4, 4, 6, 6, 7 };
+// cycles of phase a modulator swings the operator under it either way per unit of its amp, so
+// the mixer's 0.5 is 2 cycles, about 12.6 radians
+constexpr float FM_DEPTH = 4.0f;
+// cycles A's own output swings its phase at a feedback of 1
+constexpr float FM_MAX_FEEDBACK = 0.5f;
+
+// one operator of one channel for a stretch of frames
+struct FmOperator {
+    const float* table;  // a single band-limited level, with its guard sample
+    uint32_t phase;
+    uint32_t inc;
+    const float* gain;   // per sample, times scale
+    float scale;         // a carrier's gain, or a modulator's depth in fixed point phase
+};
+
+// adds the operators wired as the kernel's algorithm into out and moves their phases on.
+// A's phase is also moved by feedback (fixed point phase) times the sum of its last two
+// outputs, which history carries from one call to the next
+using FmKernel = void (*)(FmOperator* ops, float feedback, float* history, float* out, std::size_t frames);
+
+// every algorithm is its own kernel, with the wiring and the feedback path decided at compile
+// time so the sample loop never branches on them. nullptr for Additive, which is rendered by
+// the ordinary oscillator kernels
+FmKernel select_fm_kernel(FmAlgorithm algorithm, bool feedback);
@@ -11,9 +11,14 @@
 #include <string>
 #include <utility>
 #include <thread>
+#include <memory>
+#include <cstring>
 #include "wavetable.h"
 #include "imgui_includes.h"
 #include "Synth.h"
+#include "scope.h"
+#include "viewer_cache.h"
+#include "osc_server.h"
 
 // add pwm to lfo section
 // move synth into its own header file
@@ -31,14 +36,6 @@ int main(int, char**) {
     // window size stuff
     int display_w, display_h;
 
-    // useful to create some of these here for use in functions later
-    Wavetable_t saw_wave;
-    Wavetable_t sin_wave;
-    Wavetable_t sqr_wave;
-    gen_saw_wave(saw_wave);
-    gen_sin_wave(sin_wave);
-    gen_sqr_wave(sqr_wave, 0.5);
-
     // start setting up glfw
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
@@ -57,7 +54,11 @@ int main(int, char**) {
     glfwSwapInterval(1);
 
     // create our synth object and audio handler
-    Synth st;
+    // the synth carries every band-limited table level, which is too big for the stack
+    auto synth = std::make_unique<Synth>();
+    Synth& st = *synth;
+    // a couple of cores for the voices, leaving the rest for the gui and everything else
+    st.set_render_threads(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
     ScopedPaHandler paInit;
     
     // check that port audio streams are opened correctly with no errors
@@ -100,6 +101,13 @@ int main(int, char**) {
     bool show_oscC              = true;
     bool show_osc_mixer         = true;
     bool show_osc_scope         = true;
+    bool show_audio_settings    = true;
+    bool show_performance       = true;
+    bool show_presets           = false;
+    bool show_midi_player       = false;
+    bool show_envelope          = true;
+    bool show_filter            = true;
+    bool show_modulation        = false;
 
     // default window flags for use on all windows
     const bool no_titlebar            = false;
@@ -131,6 +139,8 @@ int main(int, char**) {
 
     // wwaveform names for dropdown lists
     const char* waveforms[] = { "Sawtooth", "Sine", "Square", "Triangle"};
+    // in the order of Interp
+    const char* interp_modes[] = { "Truncate", "Linear", "Cubic Hermite", "Sinc, 8 taps", "Sinc, 16 taps" };
 
     // notes for dropdown list, index used for freq manipulation
     const char* notes[] = { "A0", "A#0", "B0",
@@ -150,6 +160,7 @@ int main(int, char**) {
     // along with vectors containing pointers to them
     // for easy iteration later on
     float gui_global_amp{ 0.1f };
+    float gui_smoothing_ms{ 1000.0f * DEFAULT_SMOOTHING };
     float gui_oscA_amp{ 0.33f };
     float gui_oscB_amp{ 0.33f };
     float gui_oscC_amp{ 0.33f };
@@ -171,9 +182,145 @@ int main(int, char**) {
     std::atomic<bool> gui_updated { false };
     std::atomic<bool> pw_updated { false };
 
-    float osc_scopes[300];
-    int osc_scopes_offset = 0;
-    double osc_refresh_time = 0;
+    // the last value handed to the audio thread for each parameter
+    // starts out matching what the synth was constructed with
+    float sent_global_amp{ 0.1f };
+    float sent_smoothing{ DEFAULT_SMOOTHING };
+    float sent_fm_algorithm{ (float)FmAlgorithm::Additive };
+    float sent_fm_feedback{ 0.0f };
+    float sent_amps[3]{ 0.33f, 0.33f, 0.33f };
+    float sent_left_phase_incs[3]{ 1.0f, 1.0f, 1.0f };
+    float sent_right_phase_incs[3]{ 1.0f, 1.0f, 1.0f };
+    float sent_lfo_rates[3]{ 1.0f, 1.0f, 1.0f };
+    float sent_lfo_depths[3]{ 0.0f, 0.0f, 0.0f };
+    float sent_lfo_enables[3]{ 0.0f, 0.0f, 0.0f };
+    // how many remote changes the engine had mirrored when the controls last caught up with them
+    uint64_t seen_remote{ 0 };
+    EnvelopeShape gui_envelope{ gate_envelope() };
+    FilterSettings gui_filter{ default_filter() };
+    ModMatrix gui_matrix{ empty_matrix() };
+    float gui_mod_wheel{ 0.0f };
+    float sent_mod_wheel{ 0.0f };
+    int gui_interps[3]{ (int)Interp::Linear, (int)Interp::Linear, (int)Interp::Linear };
+    int gui_fm_algorithm{ (int)FmAlgorithm::Additive };
+    float gui_fm_feedback{ 0.0f };
+    float sent_interps[3]{ (float)Interp::Linear, (float)Interp::Linear, (float)Interp::Linear };
+    // stream settings, applied by reopening the stream
+    const double sample_rates[] = { 44100, 48000, 88200, 96000 };
+    const char* sample_rate_names[] = { "44100", "48000", "88200", "96000" };
+    const unsigned long buffer_sizes[] = { paFramesPerBufferUnspecified, 16, 32, 64, 128, 256, 512, 1024 };
+    const char* buffer_size_names[] = { "Host default", "16", "32", "64", "128", "256", "512", "1024" };
+    int gui_sample_rate{ 1 };
+    int gui_buffer_size{ 0 };
+
+    // the synth only sounds while a note is held, start with one held at the note that
+    // plays the oscillators at their own increments so it sounds like it always has
+    bool hold_note{ true };
+    bool note_held{ false };
+    auto send_param = [&st](Param id, std::size_t osc, float value, float& sent) {
+        if (value != sent && st.set_param(id, osc, value))
+            sent = value;
+    };
+
+    // PortAudio's cpu load, sampled a few times a second for the performance window
+    float load_history[200]{};
+    int load_history_offset = 0;
+    double load_refresh_time = 0;
+
+    // the wavetable viewer's curves, kept between frames
+    auto viewer_cache = std::make_unique<ViewerCache>();
+
+    // the oscilloscope copies twice the frames it shows so it has room to find a trigger
+    const char* scope_triggers[] = { "Free", "Rising", "Falling" };
+    int scope_trigger{ (int)ScopeTrigger::Rising };
+    float scope_level{ 0.0f };
+    int scope_frames{ 1024 };
+    std::vector<float> scope_capture(2 * (CAPTURE_FRAMES / 2));
+    std::vector<float> scope_left, scope_right;
+
+    // wavetable files the oscillators morph through. a table that gets replaced is kept until
+    // the audio thread has started a block without it
+    char morph_paths[3][260]{};
+    std::string morph_errors[3];
+    std::unique_ptr<MorphTable> morph_tables[3];
+    std::vector<std::pair<uint64_t, std::unique_ptr<MorphTable>>> retired_tables;
+    float gui_morphs[3]{ 0.0f, 0.0f, 0.0f };
+    float sent_morphs[3]{ 0.0f, 0.0f, 0.0f };
+    auto swap_morph_table = [&](std::size_t j, std::unique_ptr<MorphTable> table) {
+        const uint64_t ticket = st.set_morph_table(j, table.get());
+        if (morph_tables[j])
+            retired_tables.push_back({ ticket, std::move(morph_tables[j]) });
+        morph_tables[j] = std::move(table);
+    };
+
+    // the preset bank, mapped while it is open. a preset that didn't fit in the parameter queue
+    // waits here and is tried again next frame
+    char bank_path[260] = "presets.bank";
+    std::unique_ptr<PresetBank> bank;
+    std::string bank_error;
+    char preset_filter[64]{};
+    char preset_name[PRESET_NAME_LEN]{};
+    char preset_tags[PRESET_TAGS_LEN]{};
+    int selected_preset{ -1 };
+    Preset pending_preset{};
+    bool preset_pending{ false };
+    // rows that match the filter, only worked out again when the filter or the bank changes
+    std::vector<int> shown_presets;
+    bool refilter{ true };
+    auto open_bank = [&]() {
+        bank = PresetBank::open(bank_path, &bank_error);
+        if (bank)
+            bank_error.clear();
+        selected_preset = -1;
+        refilter = true;
+    };
+    // apply_preset has sent everything, so the controls only need to show it
+    auto show_preset = [&](const Preset& preset) {
+        gui_global_amp = sent_global_amp = preset.master_amp;
+        gui_fm_algorithm = st.operator_algorithm;
+        sent_fm_algorithm = (float)gui_fm_algorithm;
+        gui_fm_feedback = sent_fm_feedback = st.operator_feedback;
+        for (std::size_t j = 0; j < 3; ++j) {
+            const PresetOsc& o = preset.osc[j];
+            *gui_amplitudes[j] = sent_amps[j] = o.amp;
+            *gui_left_phase_incs[j] = sent_left_phase_incs[j] = o.left_inc;
+            *gui_right_phase_incs[j] = sent_right_phase_incs[j] = o.right_inc;
+            *pws[j] = o.pulse_width;
+            gui_interps[j] = std::clamp(o.interp, 0, (int)INTERP_MODES - 1);
+            sent_interps[j] = (float)gui_interps[j];
+            gui_morphs[j] = sent_morphs[j] = std::clamp(o.morph, 0.0f, 1.0f);
+            sent_lfo_rates[j] = o.lfo_rate;
+            sent_lfo_depths[j] = o.lfo_depth;
+            sent_lfo_enables[j] = o.lfo_enable ? 1.0f : 0.0f;
+        }
+        gui_envelope = st.envelope_sent;
+        gui_filter = st.filter_sent;
+        gui_matrix = st.mod_sent;
+        std::memcpy(preset_name, preset.name, PRESET_NAME_LEN);
+        std::memcpy(preset_tags, preset.tags, PRESET_TAGS_LEN);
+    };
+
+    // the song being played from a midi file, replaced ones are kept like morph tables
+    char midi_path[260]{};
+    std::string midi_error;
+    std::unique_ptr<MidiSequence> song;
+    std::vector<std::pair<uint64_t, std::unique_ptr<MidiSequence>>> retired_songs;
+    auto swap_song = [&](std::unique_ptr<MidiSequence> next) {
+        uint64_t ticket;
+        if (!st.set_sequence(next.get(), ticket))
+            return;
+        if (song)
+            retired_songs.push_back({ ticket, std::move(song) });
+        song = std::move(next);
+        // starting or stopping a song stops every note, the held one included
+        note_held = hold_note = false;
+    };
+
+    // remote control over osc, off until asked for in the audio settings
+    OscServer osc_server(st);
+    int osc_port{ 9000 };
+    bool osc_any_address{ false };
+    std::string osc_error;
 
     SetupImGuiStyle();
     while (!glfwWindowShouldClose(window))
@@ -185,30 +332,43 @@ int main(int, char**) {
         ImGui::NewFrame();
 
         // this window shows the combined waveform from the 3 oscillators
-        // with the correct amplitudes and pitches per channel
+        // with the correct amplitudes and pitches per channel, only worked out again when one changes
         if (show_wavetable_window) {
             const int viewer_width = 3;
             ImGui::Begin("Wavetable Viewer", &show_wavetable_window, window_flags);
-            float sum_table_L[TABLE_SIZE * viewer_width]{};
-            for (std::size_t i = 0; i < TABLE_SIZE * viewer_width; ++i) {
-                float tmp = 0;
-                for (const auto& osc : st.oscillators) {
-                    tmp += osc.first->interpolate_at(i * osc.first->ps.left_phase_inc) * osc.first->ps.amp;
-                }
-                sum_table_L[i] = tmp;
-            }
-            float sum_table_R[TABLE_SIZE*4]{};
-            for (std::size_t i = 0; i < TABLE_SIZE * viewer_width; ++i) {
-                float tmp = 0;
-                for (const auto& osc : st.oscillators) {
-                    tmp += osc.first->interpolate_at(i * osc.first->ps.right_phase_inc) * osc.first->ps.amp;
-                }
-                sum_table_R[i] = tmp;
+            const float plot_width = viewer_width * 100.0f;
+            viewer_cache->update(st.oscillators, TABLE_SIZE * viewer_width, (std::size_t)plot_width);
+            ImGui::PlotLines("L", viewer_cache->left(), (int)viewer_cache->size(), 0, NULL, -1.1f, 1.1f, ImVec2(plot_width, 100.0f));
+            ImGui::PlotLines("R", viewer_cache->right(), (int)viewer_cache->size(), 0, NULL, -1.1f, 1.1f, ImVec2(plot_width, 100.0f));
+            ImGui::End();
+        }
+
+        // lfo history published by the audio thread since the last frame
+        LfoFrame lfo_frame;
+        while (st.pop_lfo_frame(lfo_frame)) {
+            for (std::size_t j = 0; j < st.oscillators.size(); ++j) {
+                LFO_t* lfo = st.oscillators[j].second;
+                lfo->amps[lfo->amp_offset] = lfo_frame.value[j];
+                lfo->amp_offset = (lfo->amp_offset + 1) % IM_ARRAYSIZE(lfo->amps);
             }
+        }
 
-            ImGui::PlotLines("L", sum_table_L, TABLE_SIZE * viewer_width, 0, NULL, -1.1f, 1.1f, ImVec2(viewer_width * 100.0f, 100.0f));
-            ImGui::PlotLines("R", sum_table_R, TABLE_SIZE * viewer_width, 0, NULL, -1.1f, 1.1f, ImVec2(viewer_width * 100.0f, 100.0f));
-            ImGui::End();
+        // waveform changes that came in over osc, built below like a change from the combo
+        for (ShapeChange change; osc_server.pop_shape(change);) {
+            if (change.lfo) {
+                LFO_t* lfo = st.oscillators[change.osc].second;
+                if (change.waveform >= 0)
+                    lfo->ps.current_waveform = change.waveform;
+                if (change.pw >= 0)
+                    lfo->ps.pulse_width = change.pw;
+            }
+            else {
+                if (change.waveform >= 0)
+                    st.oscillators[change.osc].first->ps.current_waveform = change.waveform;
+                if (change.pw >= 0)
+                    *pws[change.osc] = change.pw;
+            }
+            gui_updated = true;
         }
 
         // idk why i have std::pair and shit and then also use an array and counter
@@ -224,31 +384,54 @@ int main(int, char**) {
             LFO_t* lfo = oscpair.second;
 
             ImGui::Begin((std::string("Oscillator ") + std::string(oscs[osc_idx])).c_str(), &show_oscA, window_flags);
-            ImGui::PlotLines("Waveform", (float*)osc->table, TABLE_SIZE, 0, nullptr, -1.1f, 1.1f, ImVec2(100.0f, 100.0f));
+            ImGui::PlotLines("Waveform", osc->table, TABLE_SIZE, 0, nullptr, -1.1f, 1.1f, ImVec2(100.0f, 100.0f));
             ImGui::SeparatorText("Waveform");
             if (ImGui::Combo("Waveform", (int*)&osc->ps.current_waveform, waveforms, IM_ARRAYSIZE(waveforms)))
                 gui_updated = true;
 
+            // only regenerates and hands a new table to the audio thread when something changed
+            osc->update_shape(osc->ps.current_waveform, *pws[osc_idx]);
             switch (osc->ps.current_waveform) {
-            case 0: // saw not special 
-                gen_saw_wave(osc);
-                break;
-            case 1: // sin not special
-                gen_sin_wave(osc);
-                break;
             case 2: // square has a pulse width
-                gen_sqr_wave(osc);
                 if (ImGui::CollapsingHeader("Square Settings", ImGuiTreeNodeFlags_DefaultOpen))
                     if (ImGui::DragFloat("Pulse Width", pws[osc_idx], 0.0025f, 0.0f, 1.0f))
                         gui_updated = true;
                 break;
             case 3:
-                gen_tri_wave(osc, *pws[osc_idx]);
                 if (ImGui::CollapsingHeader("Triangle Settings", ImGuiTreeNodeFlags_DefaultOpen))
                     if (ImGui::DragFloat("Duty Cycle", pws[osc_idx], 0.0025f, 0.0f, 1.0f))
                         gui_updated = true;
                 break;
             }
+            // cheaper to more accurate reads between table entries
+            if (ImGui::Combo("Interpolation", &gui_interps[osc_idx], interp_modes, IM_ARRAYSIZE(interp_modes)))
+                gui_updated = true;
+
+            // a wav file of many frames to morph through instead of the waveform above
+            if (ImGui::CollapsingHeader("Morph Table")) {
+                ImGui::InputText("File", morph_paths[osc_idx], IM_ARRAYSIZE(morph_paths[osc_idx]));
+                if (ImGui::Button("Load")) {
+                    auto table = MorphTable::open(morph_paths[osc_idx], 0, &morph_errors[osc_idx]);
+                    if (table) {
+                        // the frames it starts on are built straight away, the rest as they are played
+                        const std::size_t k = (std::size_t)(gui_morphs[osc_idx] * (table->frames() - 1));
+                        table->prepare(k);
+                        table->prepare(k + 1);
+                        morph_errors[osc_idx].clear();
+                        swap_morph_table(osc_idx, std::move(table));
+                    }
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Unload"))
+                    swap_morph_table(osc_idx, nullptr);
+                if (!morph_errors[osc_idx].empty())
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", morph_errors[osc_idx].c_str());
+                if (const MorphTable* table = morph_tables[osc_idx].get()) {
+                    ImGui::Text("%zu frames of %zu samples, %zu in use", table->frames(), table->frame_size(), table->built_frames());
+                    if (ImGui::SliderFloat("Morph", &gui_morphs[osc_idx], 0.0f, 1.0f))
+                        gui_updated = true;
+                }
+            }
 
             // settings such as per channel pitch
             ImGui::SeparatorText("General");
@@ -291,15 +474,9 @@ int main(int, char**) {
                     gui_updated = true;
 
                 // switch similarly to the osc waveforms
+                lfo->update_shape(lfo->ps.current_waveform, lfo->ps.pulse_width);
                 switch (lfo->ps.current_waveform) {
-                case 0:
-                    gen_saw_wave(*lfo);
-                    break;
-                case 1:
-                    gen_sin_wave(*lfo);
-                    break;
                 case 2:
-                    gen_sqr_wave(*lfo, lfo->ps.pulse_width);
                     if (ImGui::CollapsingHeader("Square Settings "))
                     {
                         if (ImGui::DragFloat("Pulse Width ", (float*)&lfo->ps.pulse_width, 0.0025f, 0.0f, 1.0f))
@@ -307,7 +484,6 @@ int main(int, char**) {
                     }
                     break;
                 case 3:
-                    gen_tri_wave(*lfo, lfo->ps.pulse_width);
                     if (ImGui::CollapsingHeader("Triangle Settings "))
                     {
                         if (ImGui::DragFloat("Midpoint ", (float*)&lfo->ps.pulse_width, 0.0025f, 0.0f, 1.0f))
@@ -316,50 +492,135 @@ int main(int, char**) {
                     break;
                 }
 
-                if (ImGui::Checkbox("Enable LFO?", &lfo->lfo_enable))
+                if (ImGui::Checkbox("Enable LFO?", (bool*)&lfo->lfo_enable))
                     gui_updated = true;
                 if (ImGui::DragFloat("LFO Rate", (float*)&lfo->ps.left_phase_inc, 0.005f, 0.0f, 15.0f, "%f"))
                     gui_updated = true;
-                if (ImGui::DragFloat("LFO Amp Depth", &lfo->lfo_amp, 0.005f, -1.0f, 1.0f, "%f"))
+                if (ImGui::DragFloat("LFO Amp Depth", (float*)&lfo->lfo_amp, 0.005f, -1.0f, 1.0f, "%f"))
                     gui_updated = true;
                     
-                // whilst it is a terrible idea, currently the LFO is tied
-                // to the GUI frame rate, and window actions such as dragging a window
-                // will pause the LFO. this is along with other unintented side-effects
-                // such as inconsistent pacing
-                // the lfo needs to be untied from the GUI asap
-                if (lfo->refresh_time == 0.0)
-                    lfo->refresh_time = ImGui::GetTime();
-
-                // animate and progress the LFO, looks cool but is terrible for pacing!
-                // depending on how i feel i might keep this
-                while (lfo->refresh_time < ImGui::GetTime())
-                {
-                    lfo->amps[lfo->amp_offset] = lfo->lfo_amp * lfo->interpolate_left();
-                    lfo->amp_offset = (lfo->amp_offset + 1) % IM_ARRAYSIZE(lfo->amps);
-                    lfo->ps.left_phase += lfo->ps.left_phase_inc;
-                    if (lfo->ps.left_phase >= TABLE_SIZE) lfo->ps.left_phase -= TABLE_SIZE;
-                    if (!lfo->lfo_enable) lfo->ps.left_phase = 0;
-                    lfo->refresh_time += 0.1f / 60.0f;
-                }
                 ImGui::PlotLines("LFO", lfo->amps, IM_ARRAYSIZE(lfo->amps), lfo->amp_offset, "", -1.0f, 1.0f, ImVec2(200.0f, 100.0f));
             }
             ImGui::End();
             ++osc_idx;
         }
 
+        // the real output as captured by the audio thread, lined up on a trigger in the left channel
         if (show_osc_scope) {
             ImGui::Begin("Oscilloscope", &show_osc_scope, window_flags);
-            if (osc_refresh_time == 0.0)
-                osc_refresh_time = ImGui::GetTime();
+            ImGui::Combo("Trigger", &scope_trigger, scope_triggers, IM_ARRAYSIZE(scope_triggers));
+            ImGui::SliderFloat("Level", &scope_level, -1.0f, 1.0f);
+            ImGui::SliderInt("Frames", &scope_frames, 64, (int)CAPTURE_FRAMES / 4);
+
+            const std::size_t shown = (std::size_t)scope_frames;
+            const std::size_t width = (std::size_t)std::max(ImGui::GetContentRegionAvail().x - 20.0f, 16.0f);
+            // a failed copy keeps what was on screen, the next frame will get one
+            if (st.capture.read_latest(scope_capture.data(), 2 * shown)) {
+                const std::size_t trigger = find_trigger(scope_capture.data(), 0, shown, (ScopeTrigger)scope_trigger, scope_level);
+                // without a trigger in the older half show the newest frames instead
+                const float* start = scope_capture.data() + 2 * (trigger < shown ? trigger : shown);
+                scope_left.resize(width);
+                scope_right.resize(width);
+                decimate_peak(start, 0, shown, scope_left.data(), width);
+                decimate_peak(start, 1, shown, scope_right.data(), width);
+            }
+            ImGui::PlotLines("L", scope_left.data(), (int)scope_left.size(), 0, "", -1.0f, 1.0f, ImVec2((float)width, 100.0f));
+            ImGui::PlotLines("R", scope_right.data(), (int)scope_right.size(), 0, "", -1.0f, 1.0f, ImVec2((float)width, 100.0f));
+            ImGui::End();
+        }
 
-            while (osc_refresh_time < ImGui::GetTime())
-            {
-                osc_scopes[osc_scopes_offset] = st.m_oscA.interpolate_left();
-                osc_scopes_offset = (osc_scopes_offset + 1) % IM_ARRAYSIZE(osc_scopes);
-                osc_refresh_time += 0.01f / 60.0f;
+        // the envelope every note follows, as many segments as wanted before the release
+        if (show_envelope) {
+            ImGui::Begin("Envelope", &show_envelope, window_flags);
+            // drawn held for a moment after the hold segment and then let go of
+            double to_hold = 0.0;
+            for (int k = 0; k < gui_envelope.count && (gui_envelope.sustain < 0 || k <= gui_envelope.sustain); ++k)
+                to_hold += gui_envelope.segment[k].seconds;
+            const double held = std::max(0.25 * to_hold, 0.1);
+            const double release_at = gui_envelope.sustain >= 0 ? to_hold + held : -1.0;
+            const double span = to_hold + (gui_envelope.sustain >= 0 ? held : 0.0) + gui_envelope.release.seconds;
+            float shape_plot[200];
+            for (int i = 0; i < IM_ARRAYSIZE(shape_plot); ++i)
+                shape_plot[i] = envelope_level_at(gui_envelope, span * i / (IM_ARRAYSIZE(shape_plot) - 1), release_at);
+            ImGui::PlotLines("Shape", shape_plot, IM_ARRAYSIZE(shape_plot), 0, nullptr, 0.0f, 1.05f, ImVec2(300.0f, 80.0f));
+            if (ImGui::Button("Gate", ImVec2(120, 20)))
+                gui_envelope = gate_envelope();
+            ImGui::SameLine();
+            if (ImGui::Button("ADSR", ImVec2(120, 20)))
+                gui_envelope = adsr_envelope(0.01f, 0.2f, 0.7f, 0.3f, 0.3f);
+
+            for (int k = 0; k < gui_envelope.count; ++k) {
+                EnvSegment& segment = gui_envelope.segment[k];
+                ImGui::PushID(k);
+                ImGui::SeparatorText(("Segment " + std::to_string(k + 1)).c_str());
+                ImGui::DragFloat("Level", &segment.level, 0.005f, 0.0f, 1.0f);
+                ImGui::DragFloat("Time (s)", &segment.seconds, 0.001f, 0.0f, 10.0f, "%.3f");
+                ImGui::DragFloat("Curve", &segment.curve, 0.005f, 0.0f, 1.0f);
+                ImGui::RadioButton("Hold here while the note is down", &gui_envelope.sustain, k);
+                ImGui::PopID();
+            }
+            ImGui::RadioButton("No hold, release straight after", &gui_envelope.sustain, -1);
+            if (ImGui::Button("Add segment", ImVec2(120, 20)) && gui_envelope.count < (int)ENV_MAX_SEGMENTS) {
+                gui_envelope.segment[gui_envelope.count] = { gui_envelope.segment[gui_envelope.count - 1].level, 0.1f, 0.0f };
+                ++gui_envelope.count;
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Remove segment", ImVec2(120, 20)) && gui_envelope.count > 1)
+                --gui_envelope.count;
+
+            ImGui::PushID((int)ENV_MAX_SEGMENTS);
+            ImGui::SeparatorText("Release");
+            ImGui::DragFloat("Time (s)", &gui_envelope.release.seconds, 0.001f, 0.0f, 10.0f, "%.3f");
+            ImGui::DragFloat("Curve", &gui_envelope.release.curve, 0.005f, 0.0f, 1.0f);
+            ImGui::PopID();
+            ImGui::End();
+        }
+
+        // the filter every voice goes through, after its envelope
+        if (show_filter) {
+            ImGui::Begin("Filter", &show_filter, window_flags);
+            const char* filter_modes[] = { "Off", "Low pass, 12 dB", "Band pass", "High pass", "Notch", "Ladder, 24 dB" };
+            ImGui::Combo("Type", &gui_filter.mode, filter_modes, IM_ARRAYSIZE(filter_modes));
+            ImGui::SliderFloat("Cutoff (Hz)", &gui_filter.cutoff, FILTER_MIN_CUTOFF, FILTER_MAX_CUTOFF, "%.0f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Resonance", &gui_filter.resonance, 0.0f, 1.0f);
+            ImGui::SliderFloat("Key tracking", &gui_filter.key_track, 0.0f, 1.0f);
+            ImGui::End();
+        }
+
+        // routes from the lfos, the envelope and midi controllers to whatever they should move
+        if (show_modulation) {
+            ImGui::Begin("Modulation", &show_modulation, window_flags);
+            const char* mod_sources[] = { "LFO A", "LFO B", "LFO C", "Envelope", "MIDI CC" };
+            const char* mod_dests[] = { "Amplitude", "Pitch (semitones)", "Pulse width", "Morph position", "Cutoff (octaves)" };
+            const char* mod_oscs[] = { "A", "B", "C", "All" };
+            for (int r = 0; r < gui_matrix.count; ++r) {
+                ModRoute& route = gui_matrix.route[r];
+                ImGui::PushID(r);
+                ImGui::SeparatorText(("Route " + std::to_string(r + 1)).c_str());
+                int source = route.source, controller = route.controller, dest = route.dest, osc = route.osc;
+                ImGui::Combo("Source", &source, mod_sources, IM_ARRAYSIZE(mod_sources));
+                if (source == (int)ModSource::Controller)
+                    ImGui::InputInt("CC", &controller);
+                ImGui::Combo("Destination", &dest, mod_dests, IM_ARRAYSIZE(mod_dests));
+                if (dest != (int)ModDest::Cutoff)
+                    ImGui::Combo("Oscillator", &osc, mod_oscs, IM_ARRAYSIZE(mod_oscs));
+                route.source = (uint8_t)source;
+                route.controller = (uint8_t)std::clamp(controller, 0, (int)MOD_CONTROLLERS - 1);
+                route.dest = (uint8_t)dest;
+                route.osc = (uint8_t)osc;
+                const float limit = MOD_DEPTH_LIMIT[route.dest];
+                ImGui::SliderFloat("Depth", &route.depth, -limit, limit);
+                if (ImGui::Button("Remove", ImVec2(120, 20))) {
+                    std::copy(gui_matrix.route + r + 1, gui_matrix.route + gui_matrix.count, gui_matrix.route + r);
+                    --gui_matrix.count;
+                }
+                ImGui::PopID();
             }
-            ImGui::PlotLines("Wave", osc_scopes, IM_ARRAYSIZE(osc_scopes), osc_scopes_offset, "", -1.0f, 1.0f, ImVec2(800.0f, 100.0f));
+            if (ImGui::Button("Add route", ImVec2(120, 20)) && gui_matrix.count < (int)MOD_MAX_ROUTES)
+                gui_matrix.route[gui_matrix.count++] = { (uint8_t)ModSource::LfoA, 1, (uint8_t)ModDest::Pitch, MOD_ALL_OSCS, 0.0f };
+            // what a route from cc 1 follows when there's no midi controller to move it
+            ImGui::SeparatorText("Controllers");
+            ImGui::SliderFloat("Mod wheel (CC 1)", &gui_mod_wheel, 0.0f, 1.0f);
             ImGui::End();
         }
 
@@ -382,32 +643,207 @@ int main(int, char**) {
             if (ImGui::VSliderFloat("OUT", ImVec2(20, 160), &gui_global_amp, 0.0f, 0.5f, ""))
                 gui_updated = true;
             ImGui::PopStyleVar();
+            // with fm the sliders of the oscillators that aren't heard set how far they modulate
+            const char* fm_algorithms[] = { "Mix A + B + C", "A > B > C", "A + B > C", "A > B + C", "A > B, C", "A, B, C with feedback" };
+            ImGui::Combo("FM", &gui_fm_algorithm, fm_algorithms, IM_ARRAYSIZE(fm_algorithms));
+            if (gui_fm_algorithm != (int)FmAlgorithm::Additive)
+                ImGui::SliderFloat("A feedback", &gui_fm_feedback, 0.0f, 1.0f);
             if (ImGui::Button("LFO Sync", ImVec2(120, 20))) {
-                st.m_lfoA.ps.left_phase.store(0);
-                st.m_lfoB.ps.left_phase.store(0);
-                st.m_lfoC.ps.left_phase.store(0);
+                for (std::size_t j = 0; j < st.oscillators.size(); ++j)
+                    st.set_param(Param::LfoSync, j, 0);
             }
             if (ImGui::Button("Phase reset", ImVec2(120, 20))) {
-                st.m_oscA.ps.left_phase.store(0);
-                st.m_oscA.ps.right_phase.store(0);
-                st.m_oscB.ps.left_phase.store(0);
-                st.m_oscB.ps.right_phase.store(0);
-                st.m_oscC.ps.left_phase.store(0);
-                st.m_oscC.ps.right_phase.store(0);
+                for (std::size_t j = 0; j < st.oscillators.size(); ++j)
+                    st.set_param(Param::PhaseReset, j, 0);
             }
+            ImGui::Checkbox("Hold note", &hold_note);
+            if (ImGui::Button("All notes off", ImVec2(120, 20)) && st.all_notes_off())
+                note_held = hold_note = false;
+            ImGui::Text("Voices %u / %zu", st.sounding_voices.load(std::memory_order_relaxed), st.max_voices());
 
             ImGui::End();
         }
 
-        // the menu bar, currently not really used at all apart from quitting
+        // plays a standard midi file through the voices, every event lands on its exact sample
+        if (show_midi_player) {
+            ImGui::Begin("MIDI Player", &show_midi_player, window_flags);
+            ImGui::InputText("File", midi_path, IM_ARRAYSIZE(midi_path));
+            if (ImGui::Button("Play", ImVec2(120, 20))) {
+                // read again every time, so an edited file is picked up
+                auto next = MidiSequence::open(midi_path, &midi_error);
+                if (next) {
+                    midi_error.clear();
+                    swap_song(std::move(next));
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Stop", ImVec2(120, 20)) && song)
+                swap_song(nullptr);
+            if (!midi_error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", midi_error.c_str());
+            if (song) {
+                const double position = std::min(st.sequence_position.load(std::memory_order_relaxed), song->seconds());
+                ImGui::ProgressBar(song->seconds() > 0 ? (float)(position / song->seconds()) : 1.0f, ImVec2(250.0f, 0.0f));
+                ImGui::Text("%.1f / %.1f s, %zu events", position, song->seconds(), song->size());
+            }
+            ImGui::End();
+        }
+
+        // sample rate and buffer size, or let the auto-tune find the smallest buffer that doesn't xrun
+        if (show_audio_settings) {
+            ImGui::Begin("Audio Settings", &show_audio_settings, window_flags);
+            ImGui::Combo("Sample rate", &gui_sample_rate, sample_rate_names, IM_ARRAYSIZE(sample_rate_names));
+            ImGui::Combo("Buffer size", &gui_buffer_size, buffer_size_names, IM_ARRAYSIZE(buffer_size_names));
+            if (ImGui::Button("Apply", ImVec2(120, 20)) && !st.autotuning()) {
+                const double old_rate = st.stream_sample_rate();
+                const unsigned long old_frames = st.frames_per_buffer();
+                if (!st.reopen(sample_rates[gui_sample_rate], buffer_sizes[gui_buffer_size])) {
+                    fprintf(stderr, "could not open the stream at those settings, going back\n");
+                    st.reopen(old_rate, old_frames);
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button(st.autotuning() ? "Tuning..." : "Auto-tune", ImVec2(120, 20)) && !st.autotuning())
+                st.begin_autotune();
+            if (st.frames_per_buffer() == paFramesPerBufferUnspecified)
+                ImGui::Text("%.0f Hz, host buffer size", st.stream_sample_rate());
+            else
+                ImGui::Text("%.0f Hz, %lu frames", st.stream_sample_rate(), st.frames_per_buffer());
+            ImGui::Text("Output latency %.1f ms", 1000.0 * st.output_latency());
+            ImGui::Text("Xruns %u", st.perf.xruns());
+            // how long gains and pitches take to glide to a new setting instead of stepping there
+            ImGui::SliderFloat("Smoothing (ms)", &gui_smoothing_ms, 0.0f, 1000.0f * MAX_SMOOTHING, "%.0f", ImGuiSliderFlags_Logarithmic);
+
+            // parameter changes from sequencers and scripts, see osc_server.h for the addresses
+            ImGui::SeparatorText("OSC");
+            if (osc_server.listening()) {
+                ImGui::Text("Listening on udp port %u", osc_server.port());
+                if (ImGui::Button("Stop listening", ImVec2(120, 20)))
+                    osc_server.stop();
+                ImGui::Text("%llu packets, %llu changes applied", (unsigned long long)osc_server.packets.load(), (unsigned long long)st.remote_applied.load());
+                ImGui::Text("%llu unknown, %llu dropped", (unsigned long long)osc_server.unknown.load(), (unsigned long long)osc_server.dropped.load());
+            }
+            else {
+                ImGui::InputInt("UDP port", &osc_port);
+                osc_port = std::clamp(osc_port, 0, 65535);
+                ImGui::Checkbox("Other machines too", &osc_any_address);
+                if (ImGui::Button("Listen", ImVec2(120, 20)) && osc_server.start((unsigned short)osc_port, !osc_any_address, &osc_error))
+                    osc_error.clear();
+                if (!osc_error.empty())
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", osc_error.c_str());
+            }
+            ImGui::End();
+        }
+        st.update_autotune();
+
+        // how close the callback runs to its deadline, from the engine's own block timings
+        if (show_performance) {
+            ImGui::Begin("Performance", &show_performance, window_flags);
+            const PerfSnapshot perf = st.perf.snapshot();
+            const double budget_ms = perf.budget_ns * 1e-6;
+            ImGui::Text("Block budget %.2f ms over %llu blocks", budget_ms, (unsigned long long)perf.blocks);
+            ImGui::Text("p50  %5.1f%%  %.3f ms", 100.0 * perf.p50, perf.p50 * budget_ms);
+            ImGui::Text("p99  %5.1f%%  %.3f ms", 100.0 * perf.p99, perf.p99 * budget_ms);
+            ImGui::Text("max  %5.1f%%  %.3f ms", 100.0 * perf.max, perf.max * budget_ms);
+            ImGui::Text("Xruns %u (%u underflows, %u overflows)", perf.underflows + perf.overflows, perf.underflows, perf.overflows);
+
+            float histogram[PERF_BUCKETS];
+            for (std::size_t b = 0; b < PERF_BUCKETS; ++b)
+                histogram[b] = (float)perf.buckets[b];
+            ImGui::PlotHistogram("Block time", histogram, IM_ARRAYSIZE(histogram), 0, "0 to 200% of budget", 0.0f, FLT_MAX, ImVec2(300.0f, 80.0f));
+
+            if (load_refresh_time == 0.0)
+                load_refresh_time = ImGui::GetTime();
+            while (load_refresh_time < ImGui::GetTime()) {
+                load_history[load_history_offset] = (float)st.cpu_load();
+                load_history_offset = (load_history_offset + 1) % IM_ARRAYSIZE(load_history);
+                load_refresh_time += 0.1;
+            }
+            ImGui::PlotLines("CPU load", load_history, IM_ARRAYSIZE(load_history), load_history_offset, "", 0.0f, 1.0f, ImVec2(300.0f, 80.0f));
+            if (ImGui::Button("Reset", ImVec2(120, 20)))
+                st.perf.request_reset();
+            ImGui::End();
+        }
+
+        // browsing and saving presets. without a filter only the rows on screen are read from the
+        // bank's index, and a preset's record is only read when it is loaded
+        if (show_presets) {
+            ImGui::Begin("Presets", &show_presets, window_flags);
+            ImGui::InputText("Bank", bank_path, IM_ARRAYSIZE(bank_path));
+            ImGui::SameLine();
+            if (ImGui::Button("Open"))
+                open_bank();
+            if (!bank_error.empty())
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", bank_error.c_str());
+
+            if (ImGui::InputText("Filter", preset_filter, IM_ARRAYSIZE(preset_filter)))
+                refilter = true;
+            const bool filtered = preset_filter[0] != 0;
+            if (refilter && filtered) {
+                shown_presets.clear();
+                for (std::size_t i = 0; bank && i < bank->size(); ++i)
+                    if (preset_matches(bank->entry(i), preset_filter))
+                        shown_presets.push_back((int)i);
+            }
+            refilter = false;
+            ImGui::BeginChild("Bank", ImVec2(0.0f, 200.0f), true);
+            ImGuiListClipper clipper;
+            clipper.Begin(!bank ? 0 : filtered ? (int)shown_presets.size() : (int)bank->size());
+            while (clipper.Step()) {
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                    const int i = filtered ? shown_presets[row] : row;
+                    const PresetIndexEntry& entry = bank->entry(i);
+                    ImGui::PushID(i);
+                    if (ImGui::Selectable(entry.name, selected_preset == i, ImGuiSelectableFlags_AllowDoubleClick)) {
+                        selected_preset = i;
+                        if (ImGui::IsMouseDoubleClicked(0) && bank->load(i, pending_preset))
+                            preset_pending = true;
+                    }
+                    ImGui::SameLine(200.0f);
+                    ImGui::TextDisabled("%s", entry.tags);
+                    ImGui::PopID();
+                }
+            }
+            ImGui::EndChild();
+            if (ImGui::Button("Load") && bank && selected_preset >= 0) {
+                if (bank->load(selected_preset, pending_preset))
+                    preset_pending = true;
+                else
+                    bank_error = "the preset is damaged or from a newer version";
+            }
+
+            ImGui::SeparatorText("Save");
+            ImGui::InputText("Name", preset_name, IM_ARRAYSIZE(preset_name));
+            ImGui::InputText("Tags", preset_tags, IM_ARRAYSIZE(preset_tags));
+            if (ImGui::Button("Save") && preset_name[0]) {
+                Preset preset = st.capture_preset();
+                std::memcpy(preset.name, preset_name, PRESET_NAME_LEN);
+                std::memcpy(preset.tags, preset_tags, PRESET_TAGS_LEN);
+                // let go of the mapping first, a mapped file can't be replaced everywhere
+                bank.reset();
+                std::string why;
+                const bool saved = PresetBank::store(bank_path, preset, &why) != 0;
+                open_bank();
+                if (!saved)
+                    bank_error = why;
+            }
+            ImGui::End();
+        }
+
+        // the menu bar, file and window toggles
+        if (io.KeyCtrl && (ImGui::IsKeyPressed(ImGuiKey_S, false) || ImGui::IsKeyPressed(ImGuiKey_O, false)))
+            show_presets = true;
         if (ImGui::BeginMainMenuBar()) {
             if (ImGui::BeginMenu("File")) {
                 if (ImGui::MenuItem("Quit", "Alt+F4"))
                     glfwSetWindowShouldClose(window, 1);
                 if (ImGui::MenuItem("Save Config", "CTRL+S"))
-                {}
-                if (ImGui::MenuItem("Open Config", "CTRL+O"))
-                {}
+                    show_presets = true;
+                if (ImGui::MenuItem("Open Config", "CTRL+O")) {
+                    show_presets = true;
+                    if (!bank)
+                        open_bank();
+                }
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("Windows")) {
@@ -425,29 +861,103 @@ int main(int, char**) {
                     show_oscC = true;
                 if (ImGui::MenuItem("Volume Mixer"))
                     show_osc_mixer = true;
+                if (ImGui::MenuItem("Envelope"))
+                    show_envelope = true;
+                if (ImGui::MenuItem("Filter"))
+                    show_filter = true;
+                if (ImGui::MenuItem("Modulation"))
+                    show_modulation = true;
+                if (ImGui::MenuItem("Audio Settings"))
+                    show_audio_settings = true;
+                if (ImGui::MenuItem("Performance"))
+                    show_performance = true;
+                if (ImGui::MenuItem("Presets"))
+                    show_presets = true;
+                if (ImGui::MenuItem("MIDI Player"))
+                    show_midi_player = true;
                 ImGui::EndMenu();
             }
             ImGui::EndMainMenuBar();
         }
 
-        // only when the GUI has actually been updated
-        // then update the atomic variables in the oscillators
+        // pulse width is only read by the table generators on this thread
         if (gui_updated) {
-            st.m_oscA.ps.amp.store(gui_oscA_amp);
-            st.m_oscB.ps.amp.store(gui_oscB_amp);
-            st.m_oscC.ps.amp.store(gui_oscC_amp);
-            st.m_oscA.ps.left_phase_inc.store(gui_oscA_lpi);
-            st.m_oscA.ps.right_phase_inc.store(gui_oscA_rpi);
-            st.m_oscB.ps.left_phase_inc.store(gui_oscB_lpi);
-            st.m_oscB.ps.right_phase_inc.store(gui_oscB_rpi);
-            st.m_oscC.ps.left_phase_inc.store(gui_oscC_lpi);
-            st.m_oscC.ps.right_phase_inc.store(gui_oscC_rpi);
             st.m_oscA.ps.pulse_width.store(gui_oscA_pw);
             st.m_oscB.ps.pulse_width.store(gui_oscB_pw);
             st.m_oscC.ps.pulse_width.store(gui_oscC_pw);
-            st.amplitude.store(gui_global_amp);
         }
 
+        // a preset goes over in one piece, the controls follow once it has
+        if (preset_pending && st.apply_preset(pending_preset)) {
+            preset_pending = false;
+            show_preset(pending_preset);
+        }
+
+        // the osc server mirrors its changes into the engine's atomics, the controls follow them
+        // here so they don't send their old values back over the top
+        if (const uint64_t mirrored = st.remote_mirrored.load(); mirrored != seen_remote) {
+            seen_remote = mirrored;
+            gui_global_amp = sent_global_amp = st.amplitude;
+            gui_smoothing_ms = 1000.0f * st.smoothing;
+            sent_smoothing = 0.001f * gui_smoothing_ms;
+            gui_fm_algorithm = st.operator_algorithm;
+            sent_fm_algorithm = (float)gui_fm_algorithm;
+            gui_fm_feedback = sent_fm_feedback = st.operator_feedback;
+            // the note menus show a note when the increment is one of theirs
+            auto follow_note = [&freqs](float inc, std::atomic<int>& note) {
+                const float* found = std::find(std::begin(freqs), std::end(freqs), inc);
+                if (found != std::end(freqs))
+                    note = (int)(found - freqs);
+            };
+            for (std::size_t j = 0; j < 3; ++j) {
+                Wavetable_t* osc = st.oscillators[j].first;
+                LFO_t* lfo = st.oscillators[j].second;
+                *gui_amplitudes[j] = sent_amps[j] = osc->ps.amp;
+                *gui_left_phase_incs[j] = sent_left_phase_incs[j] = osc->ps.left_phase_inc;
+                *gui_right_phase_incs[j] = sent_right_phase_incs[j] = osc->ps.right_phase_inc;
+                follow_note(sent_left_phase_incs[j], osc->ps.current_note_left);
+                follow_note(sent_right_phase_incs[j], osc->ps.current_note_right);
+                gui_interps[j] = osc->ps.interpolation;
+                sent_interps[j] = (float)gui_interps[j];
+                gui_morphs[j] = sent_morphs[j] = osc->ps.morph_position;
+                sent_lfo_rates[j] = lfo->ps.left_phase_inc;
+                sent_lfo_depths[j] = lfo->lfo_amp;
+                sent_lfo_enables[j] = lfo->lfo_enable ? 1.0f : 0.0f;
+            }
+        }
+
+        // queue up anything the audio thread hasn't been told about yet
+        // if the queue is full the value stays unsent and is retried next frame
+        for (std::size_t j = 0; j < 3; ++j) {
+            send_param(Param::OscAmp, j, *gui_amplitudes[j], sent_amps[j]);
+            send_param(Param::LeftPhaseInc, j, *gui_left_phase_incs[j], sent_left_phase_incs[j]);
+            send_param(Param::RightPhaseInc, j, *gui_right_phase_incs[j], sent_right_phase_incs[j]);
+            send_param(Param::Interpolation, j, (float)gui_interps[j], sent_interps[j]);
+            send_param(Param::MorphPosition, j, gui_morphs[j], sent_morphs[j]);
+
+            LFO_t* lfo = st.oscillators[j].second;
+            send_param(Param::LfoRate, j, lfo->ps.left_phase_inc, sent_lfo_rates[j]);
+            send_param(Param::LfoDepth, j, lfo->lfo_amp, sent_lfo_depths[j]);
+            send_param(Param::LfoEnable, j, lfo->lfo_enable ? 1.0f : 0.0f, sent_lfo_enables[j]);
+        }
+        send_param(Param::MasterAmp, 0, gui_global_amp, sent_global_amp);
+        send_param(Param::SmoothingTime, 0, 0.001f * gui_smoothing_ms, sent_smoothing);
+        send_param(Param::FmAlgorithm, 0, (float)gui_fm_algorithm, sent_fm_algorithm);
+        send_param(Param::FmFeedback, 0, gui_fm_feedback, sent_fm_feedback);
+        // the whole envelope goes over in one piece whenever any of it changes
+        gui_envelope = sanitise_envelope(gui_envelope);
+        if (std::memcmp(&gui_envelope, &st.envelope_sent, sizeof(EnvelopeShape)) != 0)
+            st.set_envelope(gui_envelope);
+        gui_filter = sanitise_filter(gui_filter);
+        if (std::memcmp(&gui_filter, &st.filter_sent, sizeof(FilterSettings)) != 0)
+            st.set_filter(gui_filter);
+        gui_matrix = sanitise_matrix(gui_matrix);
+        if (std::memcmp(&gui_matrix, &st.mod_sent, sizeof(ModMatrix)) != 0)
+            st.set_modulation(gui_matrix);
+        send_param(Param::Controller, 1, gui_mod_wheel, sent_mod_wheel);
+        if (hold_note != note_held && (hold_note ? st.note_on(BASE_NOTE, 1.0f) : st.note_off(BASE_NOTE)))
+            note_held = hold_note;
+
         // render all our shit 
         ImGui::Render();
 
@@ -461,10 +971,18 @@ int main(int, char**) {
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         glfwSwapBuffers(window);
 
+        // build whatever morph frames the audio thread asked for, and let go of replaced tables
+        for (auto& table : morph_tables)
+            if (table)
+                table->service();
+        std::erase_if(retired_tables, [&st](const auto& retired) { return st.block_passed(retired.first); });
+        std::erase_if(retired_songs, [&st](const auto& retired) { return st.block_passed(retired.first); });
+
         // reset the gui check
         gui_updated.store(false);
     }
 
+    osc_server.stop();
     st.close();
 
     ImGui_ImplOpenGL3_Shutdown();
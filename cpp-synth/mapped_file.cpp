@@ -0,0 +1,93 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    close();
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        CloseHandle(f);
+        return false;
+    }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (m)
+            CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    file = f;
+    mapping = m;
+    bytes = static_cast<const unsigned char*>(view);
+    length = (std::size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes)
+        UnmapViewOfFile(bytes);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    bytes = nullptr;
+    mapping = file = nullptr;
+    length = 0;
+}
+
+// the file was opened for random access, and windows has no way to drop clean pages of a view
+void MappedFile::advise_random() {}
+void MappedFile::release(std::size_t, std::size_t) {}
+#else
+bool MappedFile::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file open by itself
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    bytes = static_cast<const unsigned char*>(view);
+    length = (std::size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes)
+        munmap(const_cast<unsigned char*>(bytes), length);
+    bytes = nullptr;
+    length = 0;
+}
+
+void MappedFile::advise_random() {
+    if (bytes)
+        madvise(const_cast<unsigned char*>(bytes), length, MADV_RANDOM);
+}
+
+void MappedFile::release(std::size_t offset, std::size_t n) {
+    const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+    const std::size_t begin = (offset + page - 1) / page * page;
+    const std::size_t end = (offset + n) / page * page;
+    if (bytes && end > begin && end <= length)
+        madvise(const_cast<unsigned char*>(bytes) + begin, end - begin, MADV_DONTNEED);
+}
+#endif
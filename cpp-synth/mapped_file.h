@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// a whole file mapped read-only into memory. pages are only read from disk when they are
+// first touched and are shared with every other process mapping the same file
+class MappedFile
+{
+private:
+    const unsigned char* bytes{ nullptr };
+    std::size_t length{ 0 };
+#ifdef _WIN32
+    void* file{ nullptr };
+    void* mapping{ nullptr };
+#endif
+    void close();
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    // maps path, replacing anything mapped before. returns false if it can't be opened
+    bool open(const std::string& path);
+    const unsigned char* data() const { return bytes; }
+    std::size_t size() const { return length; }
+    // tells the os reads will jump around, so it doesn't read far ahead of what is touched
+    void advise_random();
+    // lets the os drop the pages wholly inside [offset, offset + n) from this process,
+    // they are read back in if touched again
+    void release(std::size_t offset, std::size_t n);
+};
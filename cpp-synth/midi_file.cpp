@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "midi_file.h"
+
+static std::unique_ptr<MidiSequence> fail(std::string* error, const char* why) {
+    if (error)
+        *error = why;
+    return nullptr;
+}
+
+static uint32_t read_be(const unsigned char* p, std::size_t n) {
+    uint32_t v = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        v = v << 8 | p[i];
+    return v;
+}
+
+// an event before its time is known, tempo changes are kept alongside to build the tempo map
+struct TickEvent {
+    uint64_t tick;
+    uint32_t order;   // position in the file, so events at the same tick keep their order
+    MidiEvent event;
+};
+
+struct TempoChange {
+    uint64_t tick;
+    uint32_t usec_per_quarter;
+};
+
+// walks one MTrk chunk. returns false if it runs off the end of the chunk
+static bool read_track(const unsigned char* p, const unsigned char* end, std::vector<TickEvent>& out, std::vector<TempoChange>& tempos, uint64_t& last_tick) {
+    uint64_t tick = 0;
+    unsigned char status = 0;
+    auto read_varlen = [&](uint32_t& v) {
+        v = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (p >= end)
+                return false;
+            const unsigned char b = *p++;
+            v = v << 7 | (b & 0x7F);
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    };
+
+    while (p < end) {
+        uint32_t delta;
+        if (!read_varlen(delta))
+            return false;
+        tick += delta;
+        if (p >= end)
+            return false;
+
+        if (*p == 0xFF) {
+            // meta event, only the tempo and the end of the track matter
+            if (end - p < 2)
+                return false;
+            const unsigned char type = p[1];
+            p += 2;
+            uint32_t len;
+            if (!read_varlen(len) || (std::size_t)(end - p) < len)
+                return false;
+            if (type == 0x51 && len == 3)
+                tempos.push_back({ tick, read_be(p, 3) });
+            p += len;
+            if (type == 0x2F)
+                break;
+            continue;
+        }
+        if (*p == 0xF0 || *p == 0xF7) {
+            ++p;
+            uint32_t len;
+            if (!read_varlen(len) || (std::size_t)(end - p) < len)
+                return false;
+            p += len;
+            continue;
+        }
+
+        // channel message, the status byte can be left out to repeat the last one
+        if (*p & 0x80)
+            status = *p++;
+        if (!(status & 0x80))
+            return false;
+        const unsigned kind = status >> 4;
+        const std::size_t len = kind == 0xC || kind == 0xD ? 1 : 2;
+        if ((std::size_t)(end - p) < len)
+            return false;
+        const unsigned char d1 = p[0] & 0x7F, d2 = len > 1 ? p[1] & 0x7F : 0;
+        p += len;
+
+        MidiEvent e{ 0.0, MidiEventType::Control, (uint8_t)(status & 0x0F), d1, 0.0f };
+        if (kind == 0x9 && d2 > 0) {
+            e.type = MidiEventType::NoteOn;
+            e.value = d2 / 127.0f;
+        }
+        else if (kind == 0x8 || kind == 0x9) {
+            e.type = MidiEventType::NoteOff;
+        }
+        else if (kind == 0xB) {
+            e.value = d2 / 127.0f;
+        }
+        else if (kind == 0xE) {
+            e.type = MidiEventType::PitchBend;
+            e.data = 0;
+            e.value = std::max(((d2 << 7 | d1) - 8192) / 8191.0f, -1.0f);
+        }
+        else {
+            continue;
+        }
+        out.push_back({ tick, (uint32_t)out.size(), e });
+    }
+    last_tick = std::max(last_tick, tick);
+    return true;
+}
+
+std::unique_ptr<MidiSequence> MidiSequence::open(const std::string& path, std::string* error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return fail(error, "could not open the file");
+    const std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return parse(bytes.data(), bytes.size(), error);
+}
+
+std::unique_ptr<MidiSequence> MidiSequence::parse(const unsigned char* data, std::size_t size, std::string* error) {
+    if (size < 14 || std::memcmp(data, "MThd", 4) != 0 || read_be(data + 4, 4) < 6)
+        return fail(error, "not a midi file");
+    const uint32_t format = read_be(data + 8, 2);
+    const uint32_t tracks = read_be(data + 10, 2);
+    const uint32_t division = read_be(data + 12, 2);
+    if (format > 1)
+        return fail(error, "only type 0 and type 1 midi files can be played");
+    // ticks per quarter note, or an smpte frame rate and ticks per frame
+    if (division == 0 || (division & 0x8000 && (division & 0xFF) == 0))
+        return fail(error, "the midi file has no time division");
+
+    std::vector<TickEvent> ticked;
+    std::vector<TempoChange> tempos;
+    uint64_t last_tick = 0;
+    std::size_t pos = 8 + read_be(data + 4, 4);
+    for (uint32_t t = 0; t < tracks && pos + 8 <= size; ) {
+        const std::size_t len = std::min<std::size_t>(read_be(data + pos + 4, 4), size - pos - 8);
+        if (std::memcmp(data + pos, "MTrk", 4) == 0) {
+            if (!read_track(data + pos + 8, data + pos + 8 + len, ticked, tempos, last_tick))
+                return fail(error, "a track of the midi file is damaged");
+            ++t;
+        }
+        pos += 8 + len;
+    }
+
+    // merged by time, a note-off goes before a note-on at the same tick so a repeated note
+    // is let go of before it is struck again
+    std::sort(ticked.begin(), ticked.end(), [](const TickEvent& a, const TickEvent& b) {
+        if (a.tick != b.tick)
+            return a.tick < b.tick;
+        const bool a_off = a.event.type == MidiEventType::NoteOff, b_off = b.event.type == MidiEventType::NoteOff;
+        if (a_off != b_off)
+            return a_off;
+        return a.order < b.order;
+    });
+    std::stable_sort(tempos.begin(), tempos.end(), [](const TempoChange& a, const TempoChange& b) { return a.tick < b.tick; });
+
+    // ticks to seconds, either through the tempo map or at a fixed smpte rate
+    std::size_t tempo_at = 0;
+    uint64_t tempo_tick = 0;
+    double tempo_time = 0.0;
+    double seconds_per_tick;
+    const bool smpte = division & 0x8000;
+    if (smpte) {
+        const int fps = -(int8_t)(division >> 8);
+        const double rate = fps == 29 ? 30000.0 / 1001.0 : fps;
+        seconds_per_tick = 1.0 / (rate * (division & 0xFF));
+    }
+    else {
+        seconds_per_tick = 0.5 / division; // 120 bpm until told otherwise
+    }
+    auto to_seconds = [&](uint64_t tick) {
+        while (!smpte && tempo_at < tempos.size() && tempos[tempo_at].tick <= tick) {
+            tempo_time += (tempos[tempo_at].tick - tempo_tick) * seconds_per_tick;
+            tempo_tick = tempos[tempo_at].tick;
+            seconds_per_tick = tempos[tempo_at].usec_per_quarter * 1e-6 / division;
+            ++tempo_at;
+        }
+        return tempo_time + (tick - tempo_tick) * seconds_per_tick;
+    };
+
+    auto sequence = std::make_unique<MidiSequence>();
+    sequence->events.reserve(ticked.size());
+    for (const TickEvent& t : ticked) {
+        MidiEvent e = t.event;
+        e.time = to_seconds(t.tick);
+        sequence->events.push_back(e);
+    }
+    sequence->length = to_seconds(last_tick);
+    return sequence;
+}
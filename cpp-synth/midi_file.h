@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class MidiEventType : uint8_t {
+    NoteOn,
+    NoteOff,
+    Control,   // data is the controller number
+    PitchBend,
+};
+
+// one event of a song, with its time already worked out through the tempo map
+struct MidiEvent {
+    double time;        // seconds from the start of the song
+    MidiEventType type;
+    uint8_t channel;
+    uint8_t data;       // the note or controller number
+    float value;        // velocity or controller value 0-1, bend -1 to 1
+};
+
+// the note, controller and pitch bend events of a standard midi file (type 0 or 1) with every
+// track merged into one array, sorted by time and allocated once when the file is read, so
+// the audio thread can walk it without doing anything but compare times.
+// everything else in the file (program changes, sysex, lyrics...) is dropped
+class MidiSequence
+{
+private:
+    std::vector<MidiEvent> events;
+    double length{ 0 };
+public:
+    // reads a .mid file. returns nullptr and says why in error if it can't be used
+    static std::unique_ptr<MidiSequence> open(const std::string& path, std::string* error = nullptr);
+    static std::unique_ptr<MidiSequence> parse(const unsigned char* data, std::size_t size, std::string* error = nullptr);
+
+    const MidiEvent* data() const { return events.data(); }
+    std::size_t size() const { return events.size(); }
+    // where the last track ends, which can be after the last event
+    double seconds() const { return length; }
+};
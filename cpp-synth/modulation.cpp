@@ -0,0 +1,57 @@
+#include <algorithm>
+#include "modulation.h"
+
+ModMatrix empty_matrix() {
+    return ModMatrix{};
+}
+
+ModMatrix sanitise_matrix(const ModMatrix& matrix) {
+    ModMatrix m = empty_matrix();
+    m.count = std::clamp(matrix.count, 0, (int32_t)MOD_MAX_ROUTES);
+    for (int32_t r = 0; r < m.count; ++r) {
+        ModRoute route = matrix.route[r];
+        route.source = std::min<uint8_t>(route.source, (uint8_t)ModSource::Controller);
+        route.controller = route.source == (uint8_t)ModSource::Controller ? std::min<uint8_t>(route.controller, MOD_CONTROLLERS - 1) : 0;
+        route.dest = std::min<uint8_t>(route.dest, (uint8_t)ModDest::Cutoff);
+        route.osc = route.dest == (uint8_t)ModDest::Cutoff ? 0 : std::min<uint8_t>(route.osc, MOD_ALL_OSCS);
+        // written to catch nan as well
+        const float limit = MOD_DEPTH_LIMIT[route.dest];
+        route.depth = route.depth >= -limit ? std::min(route.depth, limit) : (route.depth < -limit ? -limit : 0.0f);
+        m.route[r] = route;
+    }
+    return m;
+}
+
+void ModProgram::compile(const ModMatrix& matrix) {
+    count = 0;
+    targets = 0;
+    lfos = 0;
+    const int32_t routes = std::clamp(matrix.count, 0, (int32_t)MOD_MAX_ROUTES);
+    for (int32_t r = 0; r < routes; ++r) {
+        const ModRoute& route = matrix.route[r];
+        if (route.depth == 0.0f)
+            continue;
+        const uint8_t source = route.source < (uint8_t)ModSource::Controller ? route.source : (uint8_t)MOD_VOICE_SOURCES;
+        // the cutoff is one slot for the whole voice, the rest have one per oscillator
+        unsigned first = MOD_CUTOFF, last = MOD_CUTOFF;
+        if (route.dest != (uint8_t)ModDest::Cutoff) {
+            first = route.dest * 3u + (route.osc == MOD_ALL_OSCS ? 0u : route.osc);
+            last = route.osc == MOD_ALL_OSCS ? first + 2 : first;
+        }
+        for (unsigned target = first; target <= last; ++target) {
+            steps[count++] = { source, route.controller, (uint8_t)target, route.depth };
+            targets |= 1u << target;
+        }
+        if (source < MOD_ENVELOPE)
+            lfos |= 1u << source;
+    }
+}
+
+void ModProgram::evaluate(const float* voice_sources, const float* controllers, float* out) const {
+    std::fill(out, out + MOD_TARGETS, 0.0f);
+    for (std::size_t s = 0; s < count; ++s) {
+        const Step& step = steps[s];
+        const float value = step.source < MOD_VOICE_SOURCES ? voice_sources[step.source] : controllers[step.controller];
+        out[step.target] += step.depth * value;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// routes a patch can have, as many as fit in a preset
+constexpr std::size_t MOD_MAX_ROUTES = 6;
+// the controllers a route can follow, every midi cc
+constexpr std::size_t MOD_CONTROLLERS = 128;
+
+// what a route follows
+enum class ModSource : unsigned char {
+    LfoA,       // the oscillator's lfo, -1 to 1, running whether or not it moves the amplitude
+    LfoB,
+    LfoC,
+    Envelope,   // the voice's envelope, 0 to 1
+    Controller, // a midi cc, 0 to 1, the same for every voice
+};
+constexpr std::size_t MOD_SOURCES = 5;
+inline constexpr const char* MOD_SOURCE_NAMES[MOD_SOURCES] = { "lfo.A", "lfo.B", "lfo.C", "env", "cc" };
+
+// what a route moves, its depth is in the destination's units for a source at 1
+enum class ModDest : unsigned char {
+    Amp,        // the oscillator's gain, 1 doubles it, it never goes below silence
+    Pitch,      // semitones
+    PulseWidth, // added to a pulse oscillator's width, the other shapes don't have one
+    Morph,      // added to the oscillator's position in its morph table, if it has one
+    Cutoff,     // octaves, the filter of the whole voice
+};
+constexpr std::size_t MOD_DESTS = 5;
+inline constexpr const char* MOD_DEST_NAMES[MOD_DESTS] = { "amp", "pitch", "pw", "morph", "cutoff" };
+// the most a route can move each destination either way
+inline constexpr float MOD_DEPTH_LIMIT[MOD_DESTS] = { 1.0f, 24.0f, 0.5f, 1.0f, 8.0f };
+// a route's osc when it moves all three
+constexpr uint8_t MOD_ALL_OSCS = 3;
+// a modulated pulse gets no narrower than this either way, where it would all but vanish
+constexpr float MOD_MIN_PULSE_WIDTH = 0.01f;
+
+// one source to one destination
+struct ModRoute {
+    uint8_t source;     // a ModSource
+    uint8_t controller; // the cc for ModSource::Controller
+    uint8_t dest;       // a ModDest
+    uint8_t osc;        // 0-2 or MOD_ALL_OSCS, the cutoff ignores it
+    float depth;
+};
+
+// the routes of a patch, the ones in use packed at the front
+struct ModMatrix {
+    int32_t count;
+    ModRoute route[MOD_MAX_ROUTES];
+};
+
+// no routes, how patches sounded before there were any
+ModMatrix empty_matrix();
+// known sources and destinations, depths in range, and every unused route zeroed
+ModMatrix sanitise_matrix(const ModMatrix& matrix);
+
+// where a voice's routes are summed, one slot per destination and oscillator
+enum ModTarget : unsigned {
+    MOD_AMP = 0,
+    MOD_PITCH = 3,
+    MOD_PW = 6,
+    MOD_MORPH = 9,
+    MOD_CUTOFF = 12,
+    MOD_TARGETS = 13,
+};
+// the sources that belong to a voice, in the order evaluate() takes them
+enum : unsigned {
+    MOD_LFO = 0,
+    MOD_ENVELOPE = 3,
+    MOD_VOICE_SOURCES = 4,
+};
+
+// a matrix flattened for the audio thread: one step per route and oscillator it moves, routes
+// at depth 0 left out. evaluating it costs one multiply-add per step, so it costs nothing with
+// no routes and grows with the routes in use, never with the ones a patch could have
+class ModProgram
+{
+private:
+    struct Step {
+        uint8_t source;     // a voice source, or MOD_VOICE_SOURCES for a controller
+        uint8_t controller;
+        uint8_t target;     // a ModTarget
+        float depth;
+    };
+    Step steps[MOD_MAX_ROUTES * 3];
+    std::size_t count{ 0 };
+    unsigned targets{ 0 };
+    unsigned lfos{ 0 };
+public:
+    void compile(const ModMatrix& matrix);
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    // which ModTargets any route moves, one bit each
+    unsigned moved() const { return targets; }
+    bool moves(unsigned target) const { return (targets >> target & 1) != 0; }
+    // whether lfo j is the source of a route, and has to run even if it is switched off
+    bool follows_lfo(std::size_t j) const { return (lfos >> j & 1) != 0; }
+    // every route summed into out, MOD_TARGETS of them, from a voice's MOD_VOICE_SOURCES
+    // and the controllers
+    void evaluate(const float* voice_sources, const float* controllers, float* out) const;
+};
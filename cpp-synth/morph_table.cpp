@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "morph_table.h"
+#include "bandlimit.h"
+
+template <typename T>
+static T read_le(const unsigned char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static std::unique_ptr<MorphTable> fail(std::string* error, const char* why) {
+    if (error)
+        *error = why;
+    return nullptr;
+}
+
+// the frame length serum stores in its clm chunk, "<!>2048 ..."
+static std::size_t parse_clm(const unsigned char* p, std::size_t n) {
+    const std::string text((const char*)p, n);
+    const std::size_t at = text.find("<!>");
+    return at == std::string::npos ? 0 : (std::size_t)std::strtoul(text.c_str() + at + 3, nullptr, 10);
+}
+
+std::unique_ptr<MorphTable> MorphTable::open(const std::string& path, std::size_t frame_size, std::string* error) {
+    auto table = std::make_unique<MorphTable>();
+    MappedFile& file = table->file;
+    if (!file.open(path))
+        return fail(error, "could not open the file");
+    const unsigned char* p = file.data();
+    const std::size_t size = file.size();
+    if (size < 12 || std::memcmp(p, "RIFF", 4) != 0 || std::memcmp(p + 8, "WAVE", 4) != 0)
+        return fail(error, "not a wav file");
+
+    // walk the chunks, each is padded to an even length
+    uint16_t format = 0, bits = 0;
+    const unsigned char* data = nullptr;
+    std::size_t data_bytes = 0, clm_size = 0;
+    for (std::size_t pos = 12; pos + 8 <= size;) {
+        const unsigned char* chunk = p + pos;
+        const std::size_t len = std::min<std::size_t>(read_le<uint32_t>(chunk + 4), size - pos - 8);
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && len >= 16) {
+            format = read_le<uint16_t>(chunk + 8);
+            table->channels = read_le<uint16_t>(chunk + 10);
+            bits = read_le<uint16_t>(chunk + 22);
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of its sub format guid
+            if (format == 0xFFFE && len >= 40)
+                format = read_le<uint16_t>(chunk + 32);
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0) {
+            data = chunk + 8;
+            data_bytes = len;
+        }
+        else if (std::memcmp(chunk, "clm ", 4) == 0) {
+            clm_size = parse_clm(chunk + 8, len);
+        }
+        pos += 8 + len + (len & 1);
+    }
+
+    if (!((format == 3 && bits == 32) || (format == 1 && (bits == 16 || bits == 24 || bits == 32))))
+        return fail(error, "only 16, 24 and 32-bit pcm or 32-bit float wav files can be read");
+    if (!data || table->channels == 0)
+        return fail(error, "the wav file has no samples");
+    table->is_float = format == 3;
+    table->bytes_per_sample = bits / 8;
+    table->samples = data;
+
+    const std::size_t count = data_bytes / (table->bytes_per_sample * table->channels);
+    if (frame_size == 0)
+        frame_size = clm_size ? clm_size : std::min(count, DEFAULT_FRAME_SIZE);
+    if (frame_size < 32 || frame_size > 65536 || (frame_size & (frame_size - 1)) != 0)
+        return fail(error, "frames must be a power of two from 32 to 65536 samples long");
+    table->frame_len = frame_size;
+    table->frame_count = std::min(count / frame_size, MAX_MORPH_FRAMES);
+    if (table->frame_count == 0)
+        return fail(error, "the file is shorter than one frame");
+
+    // nothing is touched here, the allocation is only backed by memory where frames get built
+    table->storage.reset(new MorphFrame[table->frame_count]);
+    table->state.reset(new std::atomic<uint8_t>[table->frame_count]());
+    table->cycle.resize(frame_size);
+    file.advise_random();
+    return table;
+}
+
+void MorphTable::read_frame(std::size_t k, float* out) const {
+    const std::size_t stride = bytes_per_sample * channels;
+    const unsigned char* p = samples + k * frame_len * stride;
+    for (std::size_t i = 0; i < frame_len; ++i, p += stride) {
+        if (is_float)
+            out[i] = read_le<float>(p);
+        else if (bytes_per_sample == 2)
+            out[i] = read_le<int16_t>(p) * (1.0f / 32768.0f);
+        else if (bytes_per_sample == 3)
+            out[i] = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) * (1.0f / 2147483648.0f);
+        else
+            out[i] = read_le<int32_t>(p) * (1.0f / 2147483648.0f);
+    }
+}
+
+void MorphTable::build(std::size_t k) {
+    read_frame(k, cycle.data());
+    build_mip_levels_from(cycle.data(), frame_len, storage[k].mips);
+    state[k].store(READY, std::memory_order_release);
+    built.fetch_add(1, std::memory_order_relaxed);
+    // the levels are all that's needed from now on
+    const std::size_t stride = bytes_per_sample * channels;
+    file.release((std::size_t)(samples - file.data()) + k * frame_len * stride, frame_len * stride);
+}
+
+const MipTable* MorphTable::frame(std::size_t k) {
+    if (k >= frame_count)
+        return nullptr;
+    uint8_t s = state[k].load(std::memory_order_acquire);
+    if (s == READY)
+        return &storage[k].mips;
+    if (s == EMPTY)
+        state[k].compare_exchange_strong(s, WANTED, std::memory_order_relaxed);
+    return nullptr;
+}
+
+std::size_t MorphTable::service(std::size_t max_frames) {
+    std::size_t done = 0;
+    for (std::size_t k = 0; k < frame_count && done < max_frames; ++k) {
+        if (state[k].load(std::memory_order_relaxed) == WANTED) {
+            build(k);
+            ++done;
+        }
+    }
+    return done;
+}
+
+void MorphTable::prepare(std::size_t k) {
+    if (k < frame_count && state[k].load(std::memory_order_relaxed) != READY)
+        build(k);
+}
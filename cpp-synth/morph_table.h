@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "wavetable.h"
+#include "mapped_file.h"
+
+// frames a morph table can have, plenty for any wavetable synth's files
+constexpr std::size_t MAX_MORPH_FRAMES = 4096;
+// frame length when the file doesn't say, what serum and most others write
+constexpr std::size_t DEFAULT_FRAME_SIZE = 2048;
+
+// one frame of a morph table with every band-limited level, aligned so the frames sit
+// back to back in one allocation without any two sharing a cache line
+struct alignas(64) MorphFrame {
+    MipTable mips;
+};
+
+// a wavetable of many single cycles ("frames") that an oscillator morphs through, read from a
+// wav file of the frames back to back. the file is memory mapped, so opening it costs nothing
+// and its pages are shared by everyone who has it open. a frame is only read and band-limited
+// the first time it is played, and its raw pages are handed back to the os straight after,
+// so only the frames that have been used take up memory
+class MorphTable
+{
+private:
+    enum : uint8_t { EMPTY, WANTED, READY };
+    MappedFile file;
+    const unsigned char* samples{ nullptr };
+    std::size_t frame_len{ 0 };
+    std::size_t frame_count{ 0 };
+    unsigned channels{ 1 };
+    unsigned bytes_per_sample{ 4 };
+    bool is_float{ true };
+    // storage for every frame, only the pages of frames that are built ever get touched
+    std::unique_ptr<MorphFrame[]> storage;
+    std::unique_ptr<std::atomic<uint8_t>[]> state;
+    std::atomic<std::size_t> built{ 0 };
+    // builder thread only
+    std::vector<float> cycle;
+    void build(std::size_t k);
+public:
+    // maps a wav file of frames. frame_size 0 takes it from the file's clm chunk the way serum
+    // writes it, or DEFAULT_FRAME_SIZE. returns nullptr and says why in error if it can't be used
+    static std::unique_ptr<MorphTable> open(const std::string& path, std::size_t frame_size = 0, std::string* error = nullptr);
+
+    std::size_t frames() const { return frame_count; }
+    std::size_t frame_size() const { return frame_len; }
+    std::size_t built_frames() const { return built.load(std::memory_order_relaxed); }
+    // the cycle of frame k exactly as stored, frame_size() samples of the first channel
+    void read_frame(std::size_t k, float* out) const;
+
+    // audio thread, the band-limited levels of frame k if they have been built.
+    // if not, the frame is asked for and nullptr is returned
+    const MipTable* frame(std::size_t k);
+    // builder thread (the gui, or whoever drives an offline render between blocks).
+    // builds the frames the audio thread has asked for, at most max_frames of them,
+    // and returns how many it built
+    std::size_t service(std::size_t max_frames = 4);
+    // builder thread, builds frame k now unless it already is
+    void prepare(std::size_t k);
+};
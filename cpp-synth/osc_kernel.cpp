@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include "osc_kernel.h"
+#include "wavetable.h"
+#if SYNTH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// the phase fraction below the sinc table position, what neighbouring positions are blended by
+constexpr auto SINC_SUB_BITS = PHASE_FRAC_BITS - SINC_PHASE_BITS;
+constexpr uint32_t SINC_SUB_MASK = (1u << SINC_SUB_BITS) - 1;
+constexpr float SINC_SUB_SCALE = 1.0f / (1u << SINC_SUB_BITS);
+
+// taps for every fractional position of a windowed sinc, tap t of a read at table index idx
+// weighs entry idx + t - (TAPS / 2 - 1). delta is how far each tap moves by the next position
+template <int TAPS>
+struct SincTable {
+    float coef[SINC_PHASES][TAPS];
+    float delta[SINC_PHASES][TAPS];
+
+    SincTable() {
+        double rows[SINC_PHASES + 1][TAPS];
+        for (int p = 0; p <= SINC_PHASES; ++p) {
+            double sum = 0;
+            for (int t = 0; t < TAPS; ++t) {
+                const double x = t - (TAPS / 2 - 1) - p / (double)SINC_PHASES;
+                const double sinc = x == 0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+                // 4-term blackman-harris across the taps
+                const double u = 2 * M_PI * (x + TAPS / 2) / TAPS;
+                const double window = 0.35875 - 0.48829 * std::cos(u) + 0.14128 * std::cos(2 * u) - 0.01168 * std::cos(3 * u);
+                rows[p][t] = sinc * window;
+                sum += rows[p][t];
+            }
+            // so a constant table stays exactly that constant wherever it is read
+            for (int t = 0; t < TAPS; ++t)
+                rows[p][t] /= sum;
+        }
+        for (int p = 0; p < SINC_PHASES; ++p) {
+            for (int t = 0; t < TAPS; ++t) {
+                coef[p][t] = (float)rows[p][t];
+                delta[p][t] = (float)(rows[p + 1][t] - rows[p][t]);
+            }
+        }
+    }
+};
+
+template <int TAPS>
+static const SincTable<TAPS>& sinc_table() {
+    static const SincTable<TAPS> table;
+    return table;
+}
+
+uint32_t render_osc_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    for (std::size_t i = 0; i < frames; ++i) {
+        const uint32_t idx = phase >> PHASE_FRAC_BITS;
+        const float frac = (phase & PHASE_FRAC_MASK) * PHASE_FRAC_SCALE;
+        const float a = table[idx];
+        out[i] += gain * (a + frac * (table[idx + 1] - a));
+        phase += inc;
+    }
+    return phase;
+}
+
+uint32_t render_osc_truncate_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    for (std::size_t i = 0; i < frames; ++i) {
+        out[i] += gain * table[phase >> PHASE_FRAC_BITS];
+        phase += inc;
+    }
+    return phase;
+}
+
+uint32_t render_osc_hermite_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    for (std::size_t i = 0; i < frames; ++i) {
+        const uint32_t idx = phase >> PHASE_FRAC_BITS;
+        const float frac = (phase & PHASE_FRAC_MASK) * PHASE_FRAC_SCALE;
+        const float y0 = table[(idx - 1) & TABLE_MASK];
+        const float y1 = table[idx];
+        const float y2 = table[(idx + 1) & TABLE_MASK];
+        const float y3 = table[(idx + 2) & TABLE_MASK];
+        // catmull-rom, passes through y1 and y2 with slopes taken from their neighbours
+        const float c1 = 0.5f * (y2 - y0);
+        const float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+        const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+        out[i] += gain * (((c3 * frac + c2) * frac + c1) * frac + y1);
+        phase += inc;
+    }
+    return phase;
+}
+
+template <int TAPS>
+static uint32_t render_osc_sinc_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    const SincTable<TAPS>& sinc = sinc_table<TAPS>();
+    for (std::size_t i = 0; i < frames; ++i) {
+        const uint32_t base = (phase >> PHASE_FRAC_BITS) - (TAPS / 2 - 1);
+        const uint32_t frac = phase & PHASE_FRAC_MASK;
+        const uint32_t row = frac >> SINC_SUB_BITS;
+        const float sub = (frac & SINC_SUB_MASK) * SINC_SUB_SCALE;
+        float v = 0;
+        for (int t = 0; t < TAPS; ++t)
+            v += (sinc.coef[row][t] + sub * sinc.delta[row][t]) * table[(base + t) & TABLE_MASK];
+        out[i] += gain * v;
+        phase += inc;
+    }
+    return phase;
+}
+
+uint32_t render_osc_sinc8_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    return render_osc_sinc_portable<8>(table, phase, inc, gain, out, frames);
+}
+
+uint32_t render_osc_sinc16_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    return render_osc_sinc_portable<16>(table, phase, inc, gain, out, frames);
+}
+
+#if SYNTH_HAVE_AVX2
+// phases of 8 consecutive samples
+SYNTH_TARGET_AVX2
+static inline __m256i phase_lanes(uint32_t phase, uint32_t inc) {
+    return _mm256_add_epi32(_mm256_set1_epi32((int)phase),
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)inc)));
+}
+
+// 8 linear reads at the phases in p, added into out at gain g
+SYNTH_TARGET_AVX2
+static inline void linear_lanes(const float* table, __m256i p, __m256 g, float* out) {
+    const __m256i idx = _mm256_srli_epi32(p, PHASE_FRAC_BITS);
+    const __m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(p, _mm256_set1_epi32(PHASE_FRAC_MASK))), _mm256_set1_ps(PHASE_FRAC_SCALE));
+    const __m256 a = _mm256_i32gather_ps(table, idx, 4);
+    const __m256 b = _mm256_i32gather_ps(table + 1, idx, 4);
+    const __m256 v = _mm256_fmadd_ps(frac, _mm256_sub_ps(b, a), a);
+    _mm256_storeu_ps(out, _mm256_fmadd_ps(g, v, _mm256_loadu_ps(out)));
+}
+
+SYNTH_TARGET_AVX2
+uint32_t render_osc_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    const __m256i step = _mm256_set1_epi32((int)(inc * 8));
+    const __m256 g = _mm256_set1_ps(gain);
+    __m256i p = phase_lanes(phase, inc);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        linear_lanes(table, p, g, out + i);
+        p = _mm256_add_epi32(p, step);
+    }
+    // the last few samples go through one more vector on a copy of them padded with zeros, so
+    // each gets the same arithmetic wherever a block ends and a song renders the same at any
+    // block size. the kernels below do the same
+    if (i < frames) {
+        float tail[8]{};
+        std::copy(out + i, out + frames, tail);
+        linear_lanes(table, p, g, tail);
+        std::copy(tail, tail + (frames - i), out + i);
+    }
+    return phase + (uint32_t)frames * inc;
+}
+
+// 8 nearest entry reads at the phases in p, added into out at gain g
+SYNTH_TARGET_AVX2
+static inline void truncate_lanes(const float* table, __m256i p, __m256 g, float* out) {
+    const __m256 v = _mm256_i32gather_ps(table, _mm256_srli_epi32(p, PHASE_FRAC_BITS), 4);
+    _mm256_storeu_ps(out, _mm256_fmadd_ps(g, v, _mm256_loadu_ps(out)));
+}
+
+SYNTH_TARGET_AVX2
+uint32_t render_osc_truncate_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    const __m256i step = _mm256_set1_epi32((int)(inc * 8));
+    const __m256 g = _mm256_set1_ps(gain);
+    __m256i p = phase_lanes(phase, inc);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        truncate_lanes(table, p, g, out + i);
+        p = _mm256_add_epi32(p, step);
+    }
+    if (i < frames) {
+        float tail[8]{};
+        std::copy(out + i, out + frames, tail);
+        truncate_lanes(table, p, g, tail);
+        std::copy(tail, tail + (frames - i), out + i);
+    }
+    return phase + (uint32_t)frames * inc;
+}
+
+// 8 cubic hermite reads at the phases in p, added into out at gain g
+SYNTH_TARGET_AVX2
+static inline void hermite_lanes(const float* table, __m256i p, __m256 g, float* out) {
+    const __m256i table_mask = _mm256_set1_epi32(TABLE_MASK);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i idx = _mm256_srli_epi32(p, PHASE_FRAC_BITS);
+    const __m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(p, _mm256_set1_epi32(PHASE_FRAC_MASK))), _mm256_set1_ps(PHASE_FRAC_SCALE));
+    const __m256i next = _mm256_add_epi32(idx, one);
+    const __m256 y0 = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_sub_epi32(idx, one), table_mask), 4);
+    const __m256 y1 = _mm256_i32gather_ps(table, idx, 4);
+    const __m256 y2 = _mm256_i32gather_ps(table, _mm256_and_si256(next, table_mask), 4);
+    const __m256 y3 = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_add_epi32(next, one), table_mask), 4);
+
+    const __m256 c1 = _mm256_mul_ps(half, _mm256_sub_ps(y2, y0));
+    const __m256 c2 = _mm256_fnmadd_ps(half, y3, _mm256_fmadd_ps(_mm256_set1_ps(2.0f), y2, _mm256_fnmadd_ps(_mm256_set1_ps(2.5f), y1, y0)));
+    const __m256 c3 = _mm256_fmadd_ps(_mm256_set1_ps(1.5f), _mm256_sub_ps(y1, y2), _mm256_mul_ps(half, _mm256_sub_ps(y3, y0)));
+    __m256 v = _mm256_fmadd_ps(c3, frac, c2);
+    v = _mm256_fmadd_ps(v, frac, c1);
+    v = _mm256_fmadd_ps(v, frac, y1);
+    _mm256_storeu_ps(out, _mm256_fmadd_ps(g, v, _mm256_loadu_ps(out)));
+}
+
+SYNTH_TARGET_AVX2
+uint32_t render_osc_hermite_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    const __m256i step = _mm256_set1_epi32((int)(inc * 8));
+    const __m256 g = _mm256_set1_ps(gain);
+    __m256i p = phase_lanes(phase, inc);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        hermite_lanes(table, p, g, out + i);
+        p = _mm256_add_epi32(p, step);
+    }
+    if (i < frames) {
+        float tail[8]{};
+        std::copy(out + i, out + frames, tail);
+        hermite_lanes(table, p, g, tail);
+        std::copy(tail, tail + (frames - i), out + i);
+    }
+    return phase + (uint32_t)frames * inc;
+}
+
+// one sample's taps times the table entries under them, TAPS / 8 vectors already added together.
+// the window is loaded straight from the table unless it wraps round the ends
+template <int TAPS>
+SYNTH_TARGET_AVX2
+static inline __m256 sinc_products(const float* table, uint32_t phase, const SincTable<TAPS>& sinc) {
+    const uint32_t base = (phase >> PHASE_FRAC_BITS) - (TAPS / 2 - 1);
+    const uint32_t frac = phase & PHASE_FRAC_MASK;
+    const uint32_t row = frac >> SINC_SUB_BITS;
+    const __m256 sub = _mm256_set1_ps((frac & SINC_SUB_MASK) * SINC_SUB_SCALE);
+    const bool inside = base <= (uint32_t)(TABLE_SIZE - TAPS);
+    __m256 v = _mm256_setzero_ps();
+    for (int t = 0; t < TAPS; t += 8) {
+        const __m256 c = _mm256_fmadd_ps(sub, _mm256_loadu_ps(sinc.delta[row] + t), _mm256_loadu_ps(sinc.coef[row] + t));
+        const __m256 y = inside ? _mm256_loadu_ps(table + base + t)
+            : _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_add_epi32(_mm256_set1_epi32((int)(base + t)),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)), _mm256_set1_epi32(TABLE_MASK)), 4);
+        v = _mm256_fmadd_ps(c, y, v);
+    }
+    return v;
+}
+
+// 8 samples from phase on, each one a dot product across its taps. the eight products are
+// summed horizontally together so every sample costs a fraction of a shuffle
+template <int TAPS>
+SYNTH_TARGET_AVX2
+static inline void sinc_lanes(const float* table, uint32_t phase, uint32_t inc, const SincTable<TAPS>& sinc, __m256 g, float* out) {
+    __m256 v[8];
+    for (int k = 0; k < 8; ++k) {
+        v[k] = sinc_products<TAPS>(table, phase, sinc);
+        phase += inc;
+    }
+    // per 128-bit half, the sums of samples 0-3 and of 4-7, then the two halves added
+    const __m256 s0123 = _mm256_hadd_ps(_mm256_hadd_ps(v[0], v[1]), _mm256_hadd_ps(v[2], v[3]));
+    const __m256 s4567 = _mm256_hadd_ps(_mm256_hadd_ps(v[4], v[5]), _mm256_hadd_ps(v[6], v[7]));
+    const __m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(s0123, s4567, 0x20), _mm256_permute2f128_ps(s0123, s4567, 0x31));
+    _mm256_storeu_ps(out, _mm256_fmadd_ps(g, sum, _mm256_loadu_ps(out)));
+}
+
+template <int TAPS>
+SYNTH_TARGET_AVX2
+static uint32_t render_osc_sinc_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    const SincTable<TAPS>& sinc = sinc_table<TAPS>();
+    const __m256 g = _mm256_set1_ps(gain);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        sinc_lanes<TAPS>(table, phase, inc, sinc, g, out + i);
+        phase += 8 * inc;
+    }
+    if (i < frames) {
+        float tail[8]{};
+        std::copy(out + i, out + frames, tail);
+        sinc_lanes<TAPS>(table, phase, inc, sinc, g, tail);
+        std::copy(tail, tail + (frames - i), out + i);
+        phase += (uint32_t)(frames - i) * inc;
+    }
+    return phase;
+}
+
+uint32_t render_osc_sinc8_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    return render_osc_sinc_avx2<8>(table, phase, inc, gain, out, frames);
+}
+
+uint32_t render_osc_sinc16_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames) {
+    return render_osc_sinc_avx2<16>(table, phase, inc, gain, out, frames);
+}
+#endif
+
+// the sinc tables are built when a kernel is picked, never on the audio thread's first read
+static void prepare_kernel(Interp mode) {
+    if (mode == Interp::Sinc8)
+        sinc_table<8>();
+    else if (mode == Interp::Sinc16)
+        sinc_table<16>();
+}
+
+OscKernel portable_osc_kernel(Interp mode) {
+    prepare_kernel(mode);
+    static const OscKernel kernels[INTERP_MODES] = {
+        render_osc_truncate_portable, render_osc_portable, render_osc_hermite_portable,
+        render_osc_sinc8_portable, render_osc_sinc16_portable,
+    };
+    return kernels[std::min((std::size_t)mode, INTERP_MODES - 1)];
+}
+
+OscKernel select_osc_kernel(Interp mode) {
+    prepare_kernel(mode);
+#if SYNTH_HAVE_AVX2
+    static const OscKernel kernels[INTERP_MODES] = {
+        render_osc_truncate_avx2, render_osc_avx2, render_osc_hermite_avx2,
+        render_osc_sinc8_avx2, render_osc_sinc16_avx2,
+    };
+    if (cpu_has_avx2())
+        return kernels[std::min((std::size_t)mode, INTERP_MODES - 1)];
+#endif
+    return portable_osc_kernel(mode);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "cpu_features.h"
+
+// block renderers for a single oscillator channel
+// phases are 32-bit fixed point, one full cycle is 2^32 so wrapping is just integer overflow.
+// the top TABLE_BITS bits index the table and the rest are the interpolation fraction.
+// each kernel adds gain * table(phase) into out for a whole block and returns the phase
+// to start the next block from. the table needs a guard sample at table[TABLE_SIZE]
+// equal to table[0] so the interpolation never has to wrap its second index
+using OscKernel = uint32_t (*)(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+
+// how an oscillator reads between table entries, from cheapest to cleanest
+enum class Interp : unsigned char {
+    Truncate, // the entry at or before the phase
+    Linear,   // straight line between the two neighbours
+    Hermite,  // 4-point cubic through the neighbours either side
+    Sinc8,    // 8-tap windowed sinc from a polyphase table
+    Sinc16,   // the same with 16 taps
+};
+constexpr std::size_t INTERP_MODES = 5;
+inline constexpr const char* INTERP_NAMES[INTERP_MODES] = { "truncate", "linear", "hermite", "sinc8", "sinc16" };
+
+// the windowed-sinc kernels look their taps up in a table of this many fractional
+// positions between two entries, and interpolate linearly between neighbouring positions
+constexpr auto SINC_PHASE_BITS = 8;
+constexpr auto SINC_PHASES = 1 << SINC_PHASE_BITS;
+
+// the cubic and sinc kernels read entries on both sides of the phase and wrap their indices,
+// they only rely on the guard sample as much as linear does
+uint32_t render_osc_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_truncate_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_hermite_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_sinc8_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_sinc16_portable(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+#if SYNTH_HAVE_AVX2
+uint32_t render_osc_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_truncate_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_hermite_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_sinc8_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+uint32_t render_osc_sinc16_avx2(const float* table, uint32_t phase, uint32_t inc, float gain, float* out, std::size_t frames);
+#endif
+
+// the fastest kernel this cpu can run for a mode, linear unless told otherwise
+OscKernel select_osc_kernel(Interp mode = Interp::Linear);
+// the portable kernel for a mode, the reference the simd ones are checked against
+OscKernel portable_osc_kernel(Interp mode);
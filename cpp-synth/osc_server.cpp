@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "osc_server.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static uint32_t read_be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t read_be64(const unsigned char* p) {
+    return (uint64_t)read_be32(p) << 32 | read_be32(p + 4);
+}
+
+// length of the nul terminated string at p padded to four bytes, 0 if it runs past end
+static std::size_t padded_string(const unsigned char* p, const unsigned char* end) {
+    const unsigned char* nul = (const unsigned char*)std::memchr(p, 0, end - p);
+    if (!nul)
+        return 0;
+    const std::size_t len = (nul - p + 4) & ~(std::size_t)3;
+    return len <= (std::size_t)(end - p) ? len : 0;
+}
+
+static void write_be32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// the system clock less the steady clock, in ns
+static int64_t system_offset_ns(int64_t now_ns) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - now_ns;
+}
+
+// an osc time tag to the steady clock, 1 means straight away
+static int64_t timetag_to_steady(uint64_t tag, int64_t now_ns) {
+    if (tag <= 1)
+        return now_ns;
+    // ntp counts from 1900, the system clock from 1970
+    const int64_t seconds = (int64_t)(tag >> 32) - 2208988800LL;
+    const int64_t unix_ns = seconds * 1000000000LL + (int64_t)(((tag & 0xFFFFFFFFu) * 1000000000ull) >> 32);
+    return unix_ns - system_offset_ns(now_ns);
+}
+
+uint64_t steady_to_timetag(int64_t steady_ns) {
+    const int64_t unix_ns = steady_ns + system_offset_ns(steady_now_ns());
+    const int64_t seconds = unix_ns / 1000000000LL;
+    const uint64_t fraction = (((uint64_t)(unix_ns - seconds * 1000000000LL) << 32) + 999999999ull) / 1000000000ull;
+    return (uint64_t)(seconds + 2208988800LL) << 32 | fraction;
+}
+
+struct ActionWriter {
+    OscAction* out;
+    std::size_t max;
+    std::size_t n;
+    int64_t time;
+    void param(Param id, std::size_t index, float value) {
+        if (n < max) {
+            out[n] = {};
+            out[n].time_ns = time;
+            out[n].param = { id, (unsigned char)index, value };
+            ++n;
+        }
+    }
+    void shape(std::size_t osc, bool lfo, int waveform, float pw) {
+        if (n < max) {
+            out[n] = {};
+            out[n].time_ns = time;
+            out[n].is_shape = true;
+            out[n].shape = { (unsigned char)osc, lfo, waveform, pw };
+            ++n;
+        }
+    }
+};
+
+// an argument as an entry of a menu or a count, clamped before it is made an int so that no
+// number sent can overflow it
+static int clamp_int(double v, int lo, int hi) {
+    return (int)std::clamp(v, (double)lo, (double)hi);
+}
+
+// the gui's note menus, a semitone per entry above an increment of 1
+static float note_inc(double note) {
+    const int n = clamp_int(note, 0, 71);
+    return (float)std::pow(2, (float)(n / 12.0));
+}
+
+// one message's address and arguments to actions, false if it doesn't mean anything
+static bool map_message(std::string_view address, const double* args, std::size_t nargs, ActionWriter& w) {
+    const bool has = nargs > 0;
+    const double v = has ? args[0] : 0.0;
+    const float f = (float)v;
+    if (address == "/master" && has)
+        w.param(Param::MasterAmp, 0, std::clamp(f, 0.0f, 1.0f));
+    else if (address == "/control_block" && has)
+        w.param(Param::ControlBlock, 0, (float)clamp_int(v, 1, MAX_BLOCK));
+    else if (address == "/smoothing" && has)
+        w.param(Param::SmoothingTime, 0, std::clamp(f, 0.0f, MAX_SMOOTHING));
+    else if (address == "/cc" && nargs > 1 && v >= 0 && v < (int)MOD_CONTROLLERS)
+        w.param(Param::Controller, (std::size_t)v, std::clamp((float)args[1], 0.0f, 1.0f));
+    else if (address == "/fm/algorithm" && has)
+        w.param(Param::FmAlgorithm, 0, (float)clamp_int(v, 0, (int)FM_ALGORITHMS - 1));
+    else if (address == "/fm/feedback" && has)
+        w.param(Param::FmFeedback, 0, std::clamp(f, 0.0f, 1.0f));
+    else if (address == "/steal" && has)
+        w.param(Param::StealPolicy, 0, (float)clamp_int(v, 0, (int)VoiceSteal::SameNote));
+    else if (address == "/notes/off")
+        w.param(Param::AllNotesOff, 0, 0.0f);
+    else if (address == "/note/on" && has && v >= 0 && v < 128)
+        w.param(Param::NoteOn, (std::size_t)v, nargs > 1 ? std::clamp((float)args[1], 0.0f, 1.0f) : 1.0f);
+    else if (address == "/note/off" && has && v >= 0 && v < 128)
+        w.param(Param::NoteOff, (std::size_t)v, 0.0f);
+    else if (address.size() > 7 && address.substr(0, 5) == "/osc/" && address[5] >= 'A' && address[5] <= 'C' && address[6] == '/') {
+        const std::size_t j = address[5] - 'A';
+        const std::string_view name = address.substr(7);
+        if (name == "phase_reset")
+            w.param(Param::PhaseReset, j, 0.0f);
+        else if (name == "lfo/sync")
+            w.param(Param::LfoSync, j, 0.0f);
+        else if (!has)
+            return false;
+        else if (name == "amp")
+            w.param(Param::OscAmp, j, f);
+        else if (name == "inc") {
+            w.param(Param::LeftPhaseInc, j, f);
+            w.param(Param::RightPhaseInc, j, f);
+        }
+        else if (name == "left_inc")
+            w.param(Param::LeftPhaseInc, j, f);
+        else if (name == "right_inc")
+            w.param(Param::RightPhaseInc, j, f);
+        else if (name == "note") {
+            w.param(Param::LeftPhaseInc, j, note_inc(v));
+            w.param(Param::RightPhaseInc, j, note_inc(v));
+        }
+        else if (name == "left_note")
+            w.param(Param::LeftPhaseInc, j, note_inc(v));
+        else if (name == "right_note")
+            w.param(Param::RightPhaseInc, j, note_inc(v));
+        else if (name == "interp")
+            w.param(Param::Interpolation, j, (float)clamp_int(v, 0, (int)INTERP_MODES - 1));
+        else if (name == "morph")
+            w.param(Param::MorphPosition, j, std::clamp(f, 0.0f, 1.0f));
+        else if (name == "wave")
+            w.shape(j, false, clamp_int(v, 0, 3), -1.0f);
+        else if (name == "pw")
+            w.shape(j, false, -1, std::clamp(f, 0.0f, 1.0f));
+        else if (name == "lfo/rate")
+            w.param(Param::LfoRate, j, f);
+        else if (name == "lfo/depth")
+            w.param(Param::LfoDepth, j, f);
+        else if (name == "lfo/enable")
+            w.param(Param::LfoEnable, j, v != 0 ? 1.0f : 0.0f);
+        else if (name == "lfo/wave")
+            w.shape(j, true, clamp_int(v, 0, 3), -1.0f);
+        else if (name == "lfo/pw")
+            w.shape(j, true, -1, std::clamp(f, 0.0f, 1.0f));
+        else
+            return false;
+    }
+    else
+        return false;
+    return true;
+}
+
+static bool parse_message(const unsigned char* p, const unsigned char* end, ActionWriter& w) {
+    const std::size_t address_len = padded_string(p, end);
+    if (!address_len || p[0] != '/')
+        return false;
+    const std::string_view address((const char*)p);
+    p += address_len;
+    // a message without a type tag string has no arguments
+    std::size_t nargs = 0;
+    double args[4];
+    if (p < end && *p == ',') {
+        const std::size_t tags_len = padded_string(p, end);
+        if (!tags_len)
+            return false;
+        const char* tag = (const char*)p + 1;
+        p += tags_len;
+        for (; *tag; ++tag) {
+            double value;
+            std::size_t size;
+            switch (*tag) {
+            case 'i': size = 4; if (end - p < 4) return false; value = (int32_t)read_be32(p); break;
+            case 'f': { size = 4; if (end - p < 4) return false; const uint32_t bits = read_be32(p); float x; std::memcpy(&x, &bits, 4); value = x; break; }
+            case 'h': size = 8; if (end - p < 8) return false; value = (double)(int64_t)read_be64(p); break;
+            case 'd': { size = 8; if (end - p < 8) return false; const uint64_t bits = read_be64(p); std::memcpy(&value, &bits, 8); break; }
+            case 'T': size = 0; value = 1.0; break;
+            case 'F': size = 0; value = 0.0; break;
+            case 's': case 'S': size = padded_string(p, end); if (!size) return false; value = NAN; break;
+            case 'b': if (end - p < 4) return false; size = 4 + ((read_be32(p) + 3) & ~3u); if (size > (std::size_t)(end - p)) return false; value = NAN; break;
+            case 't': size = 8; if (end - p < 8) return false; value = NAN; break;
+            case 'c': case 'r': case 'm': size = 4; if (end - p < 4) return false; value = NAN; break;
+            default: size = 0; value = NAN; break;
+            }
+            p += size;
+            if (nargs < 4)
+                args[nargs++] = value;
+        }
+    }
+    for (std::size_t a = 0; a < nargs; ++a)
+        if (!std::isfinite(args[a]))
+            return false;
+    return map_message(address, args, nargs, w);
+}
+
+static void parse_element(const unsigned char* p, std::size_t size, int64_t now_ns, ActionWriter& w, uint64_t& unknown, int depth) {
+    const unsigned char* end = p + size;
+    if (size >= 16 && std::memcmp(p, "#bundle", 8) == 0) {
+        if (depth > 4)
+            return;
+        const int64_t outer = w.time;
+        const int64_t time = std::max(timetag_to_steady(read_be64(p + 8), now_ns), outer);
+        for (p += 16; end - p >= 4;) {
+            const std::size_t len = read_be32(p);
+            p += 4;
+            if (len > (std::size_t)(end - p) || (len & 3))
+                break;
+            w.time = time;
+            parse_element(p, len, now_ns, w, unknown, depth + 1);
+            w.time = outer;
+            p += len;
+        }
+        return;
+    }
+    if (!parse_message(p, end, w))
+        ++unknown;
+}
+
+std::size_t parse_osc_packet(const unsigned char* data, std::size_t size, int64_t now_ns, OscAction* out, std::size_t max, uint64_t& unknown) {
+    ActionWriter w{ out, max, 0, now_ns };
+    if (size >= 4 && (size & 3) == 0)
+        parse_element(data, size, now_ns, w, unknown, 0);
+    else
+        ++unknown;
+    return w.n;
+}
+
+void OscWriter::begin_bundle(uint64_t timetag) {
+    std::memcpy(bytes, "#bundle", 8);
+    write_be32(bytes + 8, (uint32_t)(timetag >> 32));
+    write_be32(bytes + 12, (uint32_t)timetag);
+    used = 16;
+    bundle = true;
+}
+
+bool OscWriter::message(std::string_view address, float value) {
+    const std::size_t address_len = (address.size() + 4) & ~(std::size_t)3;
+    const std::size_t len = address_len + 4 + 4;
+    if (used + (bundle ? 4 : 0) + len > OSC_MAX_PACKET || (!bundle && used))
+        return false;
+    unsigned char* p = bytes + used;
+    if (bundle) {
+        write_be32(p, (uint32_t)len);
+        p += 4;
+    }
+    std::memset(p, 0, len);
+    std::memcpy(p, address.data(), address.size());
+    std::memcpy(p + address_len, ",f", 2);
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    write_be32(p + address_len + 4, bits);
+    used = p + len - bytes;
+    return true;
+}
+
+bool OscWriter::message(std::string_view address) {
+    const std::size_t address_len = (address.size() + 4) & ~(std::size_t)3;
+    const std::size_t len = address_len + 4;
+    if (used + (bundle ? 4 : 0) + len > OSC_MAX_PACKET || (!bundle && used))
+        return false;
+    unsigned char* p = bytes + used;
+    if (bundle) {
+        write_be32(p, (uint32_t)len);
+        p += 4;
+    }
+    std::memset(p, 0, len);
+    std::memcpy(p, address.data(), address.size());
+    p[address_len] = ',';
+    used = p + len - bytes;
+    return true;
+}
+
+#ifdef _WIN32
+static void close_socket(intptr_t fd) { closesocket((SOCKET)fd); }
+#else
+static void close_socket(intptr_t fd) { ::close((int)fd); }
+#endif
+
+bool OscClient::open(unsigned short port) {
+    close();
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+        return false;
+#endif
+    socket_fd = (intptr_t)::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (socket_fd >= 0 && ::connect(socket_fd, (const sockaddr*)&addr, sizeof addr) == 0)
+        return true;
+    if (socket_fd >= 0)
+        close();
+#ifdef _WIN32
+    else
+        WSACleanup();
+#endif
+    socket_fd = -1;
+    return false;
+}
+
+void OscClient::close() {
+    if (socket_fd < 0)
+        return;
+    close_socket(socket_fd);
+    socket_fd = -1;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+bool OscClient::send(const unsigned char* data, std::size_t size) {
+    return socket_fd >= 0 && ::send(socket_fd, (const char*)data, (int)size, 0) == (int)size;
+}
+
+bool OscServer::start(unsigned short port, bool loopback_only, std::string* error) {
+    stop();
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        if (error)
+            *error = "could not start winsock";
+        return false;
+    }
+#endif
+    auto fail = [&](const char* why) {
+        if (socket_fd >= 0)
+            close_socket(socket_fd);
+        socket_fd = -1;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        if (error)
+            *error = why;
+        return false;
+    };
+    socket_fd = (intptr_t)::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_fd < 0)
+        return fail("could not create a udp socket");
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+    if (::bind(socket_fd, (const sockaddr*)&addr, sizeof addr) != 0)
+        return fail("could not bind the port, is something else listening on it?");
+    socklen_t len = sizeof addr;
+    getsockname(socket_fd, (sockaddr*)&addr, &len);
+    bound_port = ntohs(addr.sin_port);
+
+    // room for bursts while the thread is busy, and a timeout so stop() is noticed
+    int buffer = 1 << 20;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer, sizeof buffer);
+#ifdef _WIN32
+    DWORD timeout = 100;
+#else
+    timeval timeout{ 0, 100000 };
+#endif
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof timeout);
+
+    running = true;
+    thread = std::thread(&OscServer::run, this);
+    return true;
+}
+
+void OscServer::stop() {
+    if (!running.exchange(false))
+        return;
+    thread.join();
+    close_socket(socket_fd);
+    socket_fd = -1;
+    bound_port = 0;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// waits up to the socket's timeout for the first packet, then takes whatever else is already
+// there, up to OSC_BATCH packets. returns how many were read
+static std::size_t receive_batch(intptr_t fd, unsigned char (*buffers)[OSC_MAX_PACKET], std::size_t* sizes) {
+#ifdef __linux__
+    // one system call for the whole batch
+    iovec iov[OSC_BATCH];
+    mmsghdr headers[OSC_BATCH]{};
+    for (std::size_t k = 0; k < OSC_BATCH; ++k) {
+        iov[k] = { buffers[k], OSC_MAX_PACKET };
+        headers[k].msg_hdr.msg_iov = &iov[k];
+        headers[k].msg_hdr.msg_iovlen = 1;
+    }
+    const int got = recvmmsg((int)fd, headers, OSC_BATCH, MSG_WAITFORONE, nullptr);
+    for (int k = 0; k < got; ++k)
+        sizes[k] = headers[k].msg_len;
+    return got > 0 ? (std::size_t)got : 0;
+#else
+    std::size_t got = 0;
+    while (got < OSC_BATCH) {
+        if (got > 0) {
+            // only carry on while there is more to read straight away
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(fd, &readable);
+            timeval now{ 0, 0 };
+            if (select((int)fd + 1, &readable, nullptr, nullptr, &now) <= 0)
+                break;
+        }
+        const auto n = recv(fd, (char*)buffers[got], (int)OSC_MAX_PACKET, 0);
+        if (n <= 0)
+            break;
+        sizes[got++] = (std::size_t)n;
+    }
+    return got;
+#endif
+}
+
+void OscServer::run() {
+    std::vector<unsigned char> storage(OSC_BATCH * OSC_MAX_PACKET);
+    auto buffers = (unsigned char (*)[OSC_MAX_PACKET])storage.data();
+    std::size_t sizes[OSC_BATCH];
+    OscAction actions[OSC_MAX_ACTIONS];
+    while (running.load(std::memory_order_relaxed)) {
+        const std::size_t got = receive_batch(socket_fd, buffers, sizes);
+        if (!got)
+            continue;
+        const int64_t now = steady_now_ns();
+        uint64_t batch_unknown = 0, batch_changes = 0, batch_dropped = 0;
+        for (std::size_t k = 0; k < got; ++k) {
+            const std::size_t n = parse_osc_packet(buffers[k], sizes[k], now, actions, OSC_MAX_ACTIONS, batch_unknown);
+            batch_changes += n;
+            for (std::size_t a = 0; a < n; ++a) {
+                const bool queued = actions[a].is_shape ? shapes.push(actions[a].shape) : engine.push_remote(actions[a].param, actions[a].time_ns);
+                batch_dropped += !queued;
+            }
+        }
+        packets.fetch_add(got, std::memory_order_relaxed);
+        changes.fetch_add(batch_changes, std::memory_order_relaxed);
+        unknown.fetch_add(batch_unknown, std::memory_order_relaxed);
+        dropped.fetch_add(batch_dropped, std::memory_order_relaxed);
+    }
+}
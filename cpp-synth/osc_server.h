@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "SynthEngine.h"
+
+// open sound control over udp, so sequencers and scripts can drive the synth without the gui.
+// addresses, with A, B or C for the oscillator, and an int or float argument:
+//   /master   /control_block   /smoothing   /steal   (0-1, 1-512 samples, 0-1 s, a VoiceSteal)
+//   /notes/off   /note/on note [velocity]   /note/off note
+//   /fm/algorithm   /fm/feedback   (an FmAlgorithm, and 0-1)
+//   /cc controller value   (0-1, what the modulation routes from midi controllers follow)
+//   /osc/A/amp   /osc/A/inc   /osc/A/left_inc   /osc/A/right_inc   /osc/A/interp   /osc/A/morph
+//   /osc/A/note   /osc/A/left_note   /osc/A/right_note   (0-71 like the gui's note menus)
+//   /osc/A/phase_reset   /osc/A/wave   /osc/A/pw
+//   /osc/A/lfo/rate   /osc/A/lfo/depth   /osc/A/lfo/enable   /osc/A/lfo/sync   /osc/A/lfo/wave   /osc/A/lfo/pw
+// bundles are taken apart and their messages timed by the bundle's time tag
+
+// a waveform or pulse width change, which has to be built on the thread that owns the tables
+struct ShapeChange {
+    unsigned char osc;
+    bool lfo;
+    int waveform;   // -1 leaves it as it is
+    float pw;       // negative leaves it as it is
+};
+
+// what one osc message asks for
+struct OscAction {
+    int64_t time_ns;  // steady clock, when it should take effect
+    bool is_shape;
+    ParamMsg param;
+    ShapeChange shape;
+};
+
+// largest udp packet that is read whole
+constexpr std::size_t OSC_MAX_PACKET = 1536;
+// packets read by one receive call, and the most actions one batch of them turns into
+constexpr std::size_t OSC_BATCH = 32;
+constexpr std::size_t OSC_MAX_ACTIONS = 256;
+
+// parses one packet, a message or a bundle of them, into at most max actions and returns how
+// many. messages with addresses or arguments that don't mean anything are counted in unknown
+std::size_t parse_osc_packet(const unsigned char* data, std::size_t size, int64_t now_ns, OscAction* out, std::size_t max, uint64_t& unknown);
+
+// the steady clock time to the osc time tag that parses back to it
+uint64_t steady_to_timetag(int64_t steady_ns);
+
+// builds a packet, a message or a bundle of them, each message with one float or none
+class OscWriter
+{
+private:
+    unsigned char bytes[OSC_MAX_PACKET];
+    std::size_t used{ 0 };
+    bool bundle{ false };
+public:
+    void clear() { used = 0; bundle = false; }
+    // starts a bundle, every message after it goes in it. a time tag of 1 means straight away
+    void begin_bundle(uint64_t timetag = 1);
+    // false if it doesn't fit
+    bool message(std::string_view address, float value);
+    bool message(std::string_view address);
+    const unsigned char* data() const { return bytes; }
+    std::size_t size() const { return used; }
+};
+
+// sends packets to a port on this machine, for the load test
+class OscClient
+{
+private:
+    intptr_t socket_fd{ -1 };
+public:
+    OscClient() = default;
+    OscClient(const OscClient&) = delete;
+    OscClient& operator=(const OscClient&) = delete;
+    ~OscClient() { close(); }
+    bool open(unsigned short port);
+    void close();
+    bool send(const unsigned char* data, std::size_t size);
+    bool send(const OscWriter& packet) { return send(packet.data(), packet.size()); }
+};
+
+// listens on a udp port on its own thread. packets are read a batch at a time and parsed,
+// parameter changes go straight to the engine's remote queue with their time, and shape
+// changes wait in a queue of their own for the owner of the tables to take them
+class OscServer
+{
+private:
+    SynthEngine& engine;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    intptr_t socket_fd{ -1 };
+    unsigned short bound_port{ 0 };
+    SpscQueue<ShapeChange, 256> shapes;
+    void run();
+public:
+    // counters for display and the load test, written by the server thread
+    std::atomic<uint64_t> packets{ 0 };
+    std::atomic<uint64_t> changes{ 0 };   // parameter and shape changes the messages turned into
+    std::atomic<uint64_t> unknown{ 0 };
+    std::atomic<uint64_t> dropped{ 0 }; // the engine's queue was full
+
+    explicit OscServer(SynthEngine& engine) : engine(engine) {}
+    OscServer(const OscServer&) = delete;
+    OscServer& operator=(const OscServer&) = delete;
+    ~OscServer() { stop(); }
+
+    // binds port (0 picks a free one) on the loopback address only, or on every address,
+    // and starts the thread. returns false and says why in error if it can't
+    bool start(unsigned short port, bool loopback_only = true, std::string* error = nullptr);
+    void stop();
+    bool listening() const { return running.load(); }
+    unsigned short port() const { return bound_port; }
+    // the owner of the tables (the gui thread), the next waveform change that came in
+    bool pop_shape(ShapeChange& change) { return shapes.pop(change); }
+};
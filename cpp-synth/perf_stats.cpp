@@ -0,0 +1,80 @@
+#include <algorithm>
+#include "perf_stats.h"
+
+// weight of the newest block in the smoothed load, about a quarter of a second at 128 frames
+constexpr double LOAD_SMOOTHING = 0.01;
+
+template <typename T>
+static void bump(std::atomic<T>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void PerfStats::record_block(double ns, double block_budget_ns) {
+    if (reset_requested.load(std::memory_order_acquire)) {
+        reset();
+        reset_requested.store(false, std::memory_order_relaxed);
+    }
+    if (block_budget_ns <= 0)
+        return;
+    const double ratio = ns / block_budget_ns;
+    const std::size_t bucket = std::min((std::size_t)(ratio / PERF_BUCKET_WIDTH), PERF_BUCKETS - 1);
+    bump(buckets[bucket]);
+    bump(blocks);
+    if (ratio > max_ratio.load(std::memory_order_relaxed))
+        max_ratio.store(ratio, std::memory_order_relaxed);
+    const double smoothed = load.load(std::memory_order_relaxed);
+    load.store(smoothed + LOAD_SMOOTHING * (ratio - smoothed), std::memory_order_relaxed);
+    budget_ns.store(block_budget_ns, std::memory_order_relaxed);
+}
+
+void PerfStats::record_status(bool underflow, bool overflow) {
+    if (underflow)
+        bump(underflows);
+    if (overflow)
+        bump(overflows);
+}
+
+// upper edge of the bucket the given fraction of blocks falls under
+static double percentile(const uint32_t* buckets, uint64_t total, double fraction) {
+    if (total == 0)
+        return 0;
+    const uint64_t wanted = (uint64_t)(fraction * total);
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b < PERF_BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen > wanted)
+            return (b + 1) * PERF_BUCKET_WIDTH;
+    }
+    return PERF_BUCKETS * PERF_BUCKET_WIDTH;
+}
+
+PerfSnapshot PerfStats::snapshot() const {
+    PerfSnapshot s{};
+    // the buckets are summed rather than trusting blocks, so the percentiles stay
+    // consistent with the copy even if a block is recorded part way through it
+    uint64_t total = 0;
+    for (std::size_t b = 0; b < PERF_BUCKETS; ++b) {
+        s.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+        total += s.buckets[b];
+    }
+    s.blocks = blocks.load(std::memory_order_relaxed);
+    s.underflows = underflows.load(std::memory_order_relaxed);
+    s.overflows = overflows.load(std::memory_order_relaxed);
+    s.p50 = percentile(s.buckets, total, 0.50);
+    s.p99 = percentile(s.buckets, total, 0.99);
+    s.max = max_ratio.load(std::memory_order_relaxed);
+    s.load = load.load(std::memory_order_relaxed);
+    s.budget_ns = budget_ns.load(std::memory_order_relaxed);
+    return s;
+}
+
+void PerfStats::reset() {
+    for (auto& b : buckets)
+        b.store(0, std::memory_order_relaxed);
+    blocks.store(0, std::memory_order_relaxed);
+    underflows.store(0, std::memory_order_relaxed);
+    overflows.store(0, std::memory_order_relaxed);
+    max_ratio.store(0, std::memory_order_relaxed);
+    load.store(0, std::memory_order_relaxed);
+    budget_ns.store(0, std::memory_order_relaxed);
+}
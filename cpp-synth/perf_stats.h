@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// how long the audio thread takes per block compared to how long it has, and how often
+// the stream glitched. written by the audio thread only, read from anywhere without locks
+
+// block time histogram, each bucket is 2% of the block's budget and the last also takes
+// anything slower than that, so blocks that miss their deadline land in the top half
+constexpr std::size_t PERF_BUCKETS = 100;
+constexpr double PERF_BUCKET_WIDTH = 0.02;
+
+// a copy of the counters at one moment, times are fractions of the block budget
+struct PerfSnapshot {
+    uint64_t blocks;
+    unsigned underflows;
+    unsigned overflows;
+    double p50;
+    double p99;
+    double max;
+    double load;           // smoothed block time over budget, roughly the cpu load of the callback
+    double budget_ns;      // budget of the most recent block
+    uint32_t buckets[PERF_BUCKETS];
+};
+
+class PerfStats
+{
+private:
+    // single writer, so plain load and store are enough and the audio thread never needs a locked add
+    std::atomic<uint32_t> buckets[PERF_BUCKETS]{};
+    std::atomic<uint64_t> blocks{ 0 };
+    std::atomic<unsigned> underflows{ 0 };
+    std::atomic<unsigned> overflows{ 0 };
+    std::atomic<double> max_ratio{ 0 };
+    std::atomic<double> load{ 0 };
+    std::atomic<double> budget_ns{ 0 };
+    std::atomic<bool> reset_requested{ false };
+public:
+    // audio thread, one rendered block and the time it had for it
+    void record_block(double ns, double block_budget_ns);
+    // audio thread, the stream's status flags for the block
+    void record_status(bool underflow, bool overflow);
+    // any thread
+    PerfSnapshot snapshot() const;
+    unsigned xruns() const { return underflows.load(std::memory_order_relaxed) + overflows.load(std::memory_order_relaxed); }
+    // only while nothing is recording
+    void reset();
+    // any thread, the audio thread clears everything before it records its next block
+    void request_reset() { reset_requested.store(true, std::memory_order_release); }
+};
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "preset.h"
+
+// records start on a boundary of this, the smallest page size of anything the synth runs on
+constexpr std::size_t BANK_PAGE = 4096;
+constexpr uint32_t BANK_VERSION = 1;
+
+struct BankHeader {
+    char magic[4];      // "CSPB"
+    uint32_t version;
+    uint32_t count;
+    uint32_t record_size;
+    uint64_t index_offset;
+    uint64_t records_offset;
+    uint32_t reserved[8];
+};
+
+static_assert(sizeof(BankHeader) == 64);
+
+Preset blank_preset() {
+    Preset preset{};
+    std::memcpy(preset.magic, "CSPR", 4);
+    preset.version = PRESET_VERSION;
+    preset.envelope = gate_envelope();
+    preset.filter = default_filter();
+    preset.modulation = empty_matrix();
+    return preset;
+}
+
+void set_preset_text(char* field, std::size_t field_len, const std::string& text) {
+    const std::size_t n = std::min(text.size(), field_len - 1);
+    std::memset(field, 0, field_len);
+    std::memcpy(field, text.data(), n);
+}
+
+bool preset_valid(const Preset& preset) {
+    return std::memcmp(preset.magic, "CSPR", 4) == 0 && preset.version >= 1 && preset.version <= PRESET_VERSION;
+}
+
+static std::unique_ptr<PresetBank> fail(std::string* error, const char* why) {
+    if (error)
+        *error = why;
+    return nullptr;
+}
+
+std::unique_ptr<PresetBank> PresetBank::open(const std::string& path, std::string* error) {
+    auto bank = std::make_unique<PresetBank>();
+    if (!bank->file.open(path))
+        return fail(error, "could not open the file");
+    const unsigned char* p = bank->file.data();
+    const std::size_t size = bank->file.size();
+    BankHeader header;
+    if (size < sizeof header)
+        return fail(error, "not a preset bank");
+    std::memcpy(&header, p, sizeof header);
+    if (std::memcmp(header.magic, "CSPB", 4) != 0)
+        return fail(error, "not a preset bank");
+    if (header.version > BANK_VERSION || header.record_size != PRESET_SIZE)
+        return fail(error, "the bank was written by a newer version");
+    // nothing is added to an offset until it's known to be inside the file, a damaged header can't wrap round
+    if (header.index_offset % alignof(PresetIndexEntry) != 0
+        || header.index_offset > size || header.count > (size - header.index_offset) / sizeof(PresetIndexEntry)
+        || header.records_offset > size || header.count > (size - header.records_offset) / PRESET_SIZE)
+        return fail(error, "the bank is cut short");
+
+    bank->index = reinterpret_cast<const PresetIndexEntry*>(p + header.index_offset);
+    bank->records = p + header.records_offset;
+    bank->count = header.count;
+    // browsing jumps around, reading ahead would only pull in records nobody asked for
+    bank->file.advise_random();
+    return bank;
+}
+
+bool PresetBank::write(const std::string& path, const std::vector<Preset>& presets, std::string* error) {
+    BankHeader header{};
+    std::memcpy(header.magic, "CSPB", 4);
+    header.version = BANK_VERSION;
+    header.count = (uint32_t)presets.size();
+    header.record_size = PRESET_SIZE;
+    header.index_offset = sizeof header;
+    header.records_offset = (header.index_offset + presets.size() * sizeof(PresetIndexEntry) + BANK_PAGE - 1) / BANK_PAGE * BANK_PAGE;
+
+    std::vector<unsigned char> bytes(header.records_offset + presets.size() * PRESET_SIZE);
+    std::memcpy(bytes.data(), &header, sizeof header);
+    for (std::size_t i = 0; i < presets.size(); ++i) {
+        PresetIndexEntry entry{};
+        std::memcpy(entry.name, presets[i].name, PRESET_NAME_LEN);
+        std::memcpy(entry.tags, presets[i].tags, PRESET_TAGS_LEN);
+        entry.name[PRESET_NAME_LEN - 1] = entry.tags[PRESET_TAGS_LEN - 1] = 0;
+        entry.record = (uint32_t)i;
+        std::memcpy(bytes.data() + header.index_offset + i * sizeof entry, &entry, sizeof entry);
+        std::memcpy(bytes.data() + header.records_offset + i * PRESET_SIZE, &presets[i], PRESET_SIZE);
+    }
+
+    const std::string temp = path + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f) {
+        if (error)
+            *error = "could not open " + temp + " for writing";
+        return false;
+    }
+    const bool written = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    if (fclose(f) != 0 || !written) {
+        std::remove(temp.c_str());
+        if (error)
+            *error = "could not write " + temp;
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::remove(temp.c_str());
+        if (error)
+            *error = "could not replace " + path + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+std::size_t PresetBank::store(const std::string& path, const Preset& preset, std::string* error) {
+    // only a missing file starts a new bank. one that's there but can't be read, or is from a newer
+    // version, is left alone rather than replaced by a bank holding just this preset
+    std::vector<Preset> presets;
+    std::error_code ec;
+    const bool exists = std::filesystem::exists(path, ec);
+    if (ec) {
+        if (error)
+            *error = "could not look for " + path + ": " + ec.message();
+        return 0;
+    }
+    if (exists) {
+        std::string why;
+        auto bank = open(path, &why);
+        if (!bank) {
+            if (error)
+                *error = "could not read " + path + ": " + why;
+            return 0;
+        }
+        // records are copied byte for byte, not through load, so damaged or newer presets survive.
+        // the old bank is closed again straight away, before the new one is renamed over it
+        presets.resize(bank->count);
+        for (std::size_t i = 0; i < bank->count; ++i) {
+            const std::size_t record = bank->index[i].record < bank->count ? bank->index[i].record : i;
+            std::memcpy(&presets[i], bank->records + record * PRESET_SIZE, PRESET_SIZE);
+        }
+        for (std::size_t i = 0; i < bank->count; ++i)
+            if (std::strncmp(bank->index[i].name, preset.name, PRESET_NAME_LEN) == 0) {
+                presets[i] = preset;
+                return write(path, presets, error) ? presets.size() : 0;
+            }
+    }
+    presets.push_back(preset);
+    return write(path, presets, error) ? presets.size() : 0;
+}
+
+bool PresetBank::load(std::size_t i, Preset& out) const {
+    if (i >= count || index[i].record >= count)
+        return false;
+    std::memcpy(&out, records + (std::size_t)index[i].record * PRESET_SIZE, PRESET_SIZE);
+    out.name[PRESET_NAME_LEN - 1] = out.tags[PRESET_TAGS_LEN - 1] = 0;
+    return preset_valid(out);
+}
+
+std::size_t PresetBank::find(const std::string& name) const {
+    // names are cut short the same way when they are saved
+    const std::string key = name.substr(0, PRESET_NAME_LEN - 1);
+    for (std::size_t i = 0; i < count; ++i)
+        if (std::strncmp(index[i].name, key.c_str(), PRESET_NAME_LEN) == 0)
+            return i;
+    return count;
+}
+
+std::vector<Preset> PresetBank::load_all() const {
+    std::vector<Preset> presets;
+    presets.reserve(count);
+    Preset preset;
+    for (std::size_t i = 0; i < count; ++i)
+        if (load(i, preset))
+            presets.push_back(preset);
+    return presets;
+}
+
+// names and tags are ascii, which keeps this cheap enough to run over a whole bank every keystroke
+static char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool contains_nocase(const char* field, std::size_t field_len, const std::string& lowered) {
+    const char* end = field + strnlen(field, field_len);
+    return std::search(field, end, lowered.begin(), lowered.end(), [](char a, char b) { return lower(a) == b; }) != end;
+}
+
+bool preset_matches(const PresetIndexEntry& entry, const std::string& text) {
+    if (text.empty())
+        return true;
+    std::string lowered = text;
+    for (char& c : lowered)
+        c = lower(c);
+    return contains_nocase(entry.name, PRESET_NAME_LEN, lowered) || contains_nocase(entry.tags, PRESET_TAGS_LEN, lowered);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "envelope.h"
+#include "filter.h"
+#include "modulation.h"
+#include "mapped_file.h"
+
+// a patch as a fixed-layout binary record, written and read as raw little-endian bytes.
+// new fields take bytes out of the reserved space, which older files have zeroed, so a version
+// bump only has to say what zero means for them. newer versions than PRESET_VERSION are refused
+// version 2 added the envelope, version 1 presets play with the gate envelope
+// version 3 added the filter, older presets play with it off
+// version 4 added the modulation matrix, older presets have no routes
+// version 5 added the fm algorithm and feedback, older presets mix the oscillators
+constexpr uint32_t PRESET_VERSION = 5;
+constexpr std::size_t PRESET_NAME_LEN = 32; // both nul terminated, so one less usable character
+constexpr std::size_t PRESET_TAGS_LEN = 64; // comma separated
+constexpr std::size_t PRESET_SIZE = 512;
+
+// everything about one oscillator and its lfo, in the units the gui sends them in
+struct PresetOsc {
+    int32_t waveform;   // a Waveform
+    float pulse_width;
+    float amp;
+    float left_inc;
+    float right_inc;
+    int32_t note_left;  // which note the gui's pitch menus show, display only
+    int32_t note_right;
+    int32_t interp;     // an Interp
+    float morph;
+    int32_t lfo_waveform;
+    float lfo_pulse_width;
+    float lfo_rate;
+    float lfo_depth;
+    int32_t lfo_enable;
+    uint32_t reserved[2];
+};
+
+struct Preset {
+    char magic[4];      // "CSPR"
+    uint32_t version;
+    char name[PRESET_NAME_LEN];
+    char tags[PRESET_TAGS_LEN];
+    float master_amp;
+    int32_t control_block;
+    int32_t steal_policy; // a VoiceSteal
+    int32_t fm_algorithm; // an FmAlgorithm
+    float fm_feedback;
+    uint32_t reserved0[1];
+    PresetOsc osc[3];
+    EnvelopeShape envelope;
+    FilterSettings filter;
+    ModMatrix modulation;
+    unsigned char reserved[PRESET_SIZE - 128 - 3 * sizeof(PresetOsc) - sizeof(EnvelopeShape) - sizeof(FilterSettings) - sizeof(ModMatrix)];
+};
+
+static_assert(std::is_trivially_copyable_v<Preset> && sizeof(PresetOsc) == 64 && sizeof(Preset) == PRESET_SIZE);
+static_assert(offsetof(Preset, osc) == 128 && offsetof(Preset, envelope) == 320 && sizeof(EnvelopeShape) == 116 &&
+    offsetof(Preset, filter) == 436 && sizeof(FilterSettings) == 16 && offsetof(Preset, modulation) == 452 && sizeof(ModMatrix) == 52,
+    "the preset layout is part of the file format");
+
+// a preset with the magic and version filled in, the gate envelope, the default filter, no
+// modulation routes and everything else zero
+Preset blank_preset();
+// copies text into one of the fixed-length fields, cutting it short if it doesn't fit
+void set_preset_text(char* field, std::size_t field_len, const std::string& text);
+// true if the record is one this build can read
+bool preset_valid(const Preset& preset);
+
+// one row of a bank's index, kept apart from the records so browsing never touches them
+struct PresetIndexEntry {
+    char name[PRESET_NAME_LEN];
+    char tags[PRESET_TAGS_LEN];
+    uint32_t record; // position of the record in the bank
+    uint32_t reserved[7];
+};
+
+static_assert(sizeof(PresetIndexEntry) == 128);
+
+// thousands of presets in one file: a header, the index of every name and tag list, then the
+// records, each PRESET_SIZE bytes and starting on a page boundary so no record straddles two.
+// the file is memory mapped and used in place, so opening it reads nothing, a screenful of the
+// index is one or two pages and loading a preset is a copy out of a single page
+class PresetBank
+{
+private:
+    MappedFile file;
+    const PresetIndexEntry* index{ nullptr };
+    const unsigned char* records{ nullptr };
+    std::size_t count{ 0 };
+public:
+    // maps a bank file. returns nullptr and says why in error if it can't be used
+    static std::unique_ptr<PresetBank> open(const std::string& path, std::string* error = nullptr);
+    // writes presets as a bank, indexed in the order given. the file is written beside path and
+    // renamed over it, so a failed write never leaves half a bank. close any bank mapping path first
+    static bool write(const std::string& path, const std::vector<Preset>& presets, std::string* error = nullptr);
+    // adds preset to the bank at path, or replaces the one of the same name, creating the bank
+    // if there's no file. a bank that can't be read is refused, never overwritten. returns how
+    // many presets the bank has now, 0 if it couldn't be written
+    static std::size_t store(const std::string& path, const Preset& preset, std::string* error = nullptr);
+
+    std::size_t size() const { return count; }
+    const PresetIndexEntry& entry(std::size_t i) const { return index[i]; }
+    // copies preset i out of the bank, false if its record is damaged or from a newer version
+    bool load(std::size_t i, Preset& out) const;
+    // the first preset called name, or size() if there isn't one
+    std::size_t find(const std::string& name) const;
+    // every preset is copied out, for rewriting the bank with changes
+    std::vector<Preset> load_all() const;
+};
+
+// true if the preset's name or one of its tags contains text, ignoring case. empty text matches all
+bool preset_matches(const PresetIndexEntry& entry, const std::string& text);
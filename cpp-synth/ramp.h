@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// a parameter that glides to each new value in a straight line over a set number of samples
+// instead of stepping to it. the ramp is worked out once when it is aimed, and once it has
+// arrived there is nothing left to do per sample
+class LinearRamp
+{
+private:
+    double current{ 0.0 };
+    double goal{ 0.0 };
+    double step{ 0.0 };
+    uint32_t left{ 0 };
+public:
+    // heads for target over samples from wherever it is now, or straight there if samples is 0.
+    // aiming again at the target it is already heading for changes nothing
+    void aim(double target, uint32_t samples) {
+        if (target == goal && (left || current == goal))
+            return;
+        goal = target;
+        left = samples;
+        if (samples == 0)
+            current = target;
+        else
+            step = (target - current) / samples;
+    }
+    void jump(double value) {
+        current = goal = value;
+        left = 0;
+    }
+    bool moving() const { return left != 0; }
+    double value() const { return current; }
+    double target() const { return goal; }
+    // the value at each of the next frames samples, holding at the target once it gets there
+    void fill(float* out, std::size_t frames) const {
+        std::size_t i = 0;
+        for (; i < frames && i < left; ++i)
+            out[i] = (float)(current + step * i);
+        for (; i < frames; ++i)
+            out[i] = (float)goal;
+    }
+    // moves on frames samples, landing exactly on the target at the end of the ramp
+    void advance(std::size_t frames) {
+        if (frames >= left) {
+            current = goal;
+            left = 0;
+        }
+        else {
+            current += step * frames;
+            left -= (uint32_t)frames;
+        }
+    }
+};
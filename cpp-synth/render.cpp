@@ -0,0 +1,684 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "osc_server.h"
+#include "SynthEngine.h"
+
+// headless offline renderer, drives SynthEngine directly with no audio device or gui
+// renders as fast as it can and reports how that compares to real time
+//
+// parameters are "key=value" pairs, either on the command line or one per line in a
+// patch file (# starts a comment). oscillator keys are prefixed with A, B or C:
+//   master=0.1   control_block=32   voices=64   steal=oldest|quietest|same   smoothing=0.01
+//   notes=33,45,57   velocity=1.0   (plays BASE_NOTE if no notes are given)
+//   A.wave=saw|sine|square|triangle   A.pw=0.5   A.amp=0.33
+//   A.inc=1.0   A.left_inc=1.0   A.right_inc=1.0   A.interp=truncate|linear|hermite|sinc8|sinc16
+//   A.morph_file=table.wav   A.frame_size=2048   A.morph=0.5   (frame size 0 reads it from the file)
+//   A.lfo.wave=sine   A.lfo.pw=0.5   A.lfo.rate=1.0   A.lfo.depth=0.5   A.lfo.enable=1
+//   env.attack=0.01   env.decay=0.2   env.sustain=0.7   env.release=0.3   env.curve=0.5
+//   env.segments=1:0.005,0.6:0.1,0.4:1.5   env.hold=2   (level:seconds[:curve] each, hold -1 for a one-shot)
+//   filter=off|lowpass|bandpass|highpass|notch|ladder   filter.cutoff=2000   filter.resonance=0.3   filter.key=0.5
+//   fm=add|stack|branch|fan|pair|parallel   fm.feedback=0.3   (the modulators' depths are their A.amp)
+//   mod=lfo.A:pitch.B:0.5   mod=env:cutoff:3   mod=cc1:pw:0.3   cc.1=0.5   (each mod adds a route from
+//     lfo.A-C, env or ccN to amp, pitch, pw, morph or cutoff, .A-C for one oscillator. mod=none clears them)
+//   bank=presets.bank   preset=Name   (starts from a preset in the bank, other keys change it)
+//   save=Name   tags=pad,bright   (stores the patch in the bank, replacing one of the same name)
+
+static void usage() {
+    fprintf(stderr,
+        "usage: cpp-synth-render [options] [key=value ...]\n"
+        "  -s, --seconds N   length to render in seconds (default 10, or the song and a second more)\n"
+        "  -b, --block N     frames per block (default 512)\n"
+        "  -r, --rate N      sample rate in Hz (default 48000)\n"
+        "  -t, --threads N   threads rendering the voices, counting the main one (default 1)\n"
+        "  -o, --out FILE    write the output, .wav gives 32-bit float WAV, anything else raw interleaved float\n"
+        "  -p, --patch FILE  read key=value parameters from FILE, command line pairs win\n"
+        "  -m, --midi FILE   play a standard midi file instead of holding notes\n"
+        "      --osc PORT    take osc messages on a udp port on this machine, rendering in real time\n"
+        "      --osc-load N  send the --osc port (or a free one) N messages a second of mixed changes\n"
+        "      --realtime    render each block no earlier than an audio device would ask for it\n");
+}
+
+static int parse_steal(const std::string& value) {
+    const char* names[] = { "oldest", "quietest", "same" };
+    for (int i = 0; i < 3; ++i)
+        if (value == names[i])
+            return i;
+    return std::atoi(value.c_str());
+}
+
+static int parse_waveform(const std::string& value) {
+    const char* names[] = { "saw", "sine", "square", "triangle" };
+    for (int i = 0; i < 4; ++i)
+        if (value == names[i])
+            return i;
+    return std::atoi(value.c_str());
+}
+
+static int parse_interp(const std::string& value) {
+    for (std::size_t i = 0; i < INTERP_MODES; ++i)
+        if (value == INTERP_NAMES[i])
+            return (int)i;
+    return std::atoi(value.c_str());
+}
+
+static int parse_fm(const std::string& value) {
+    for (std::size_t i = 0; i < FM_ALGORITHMS; ++i)
+        if (value == FM_ALGORITHM_NAMES[i])
+            return (int)i;
+    return std::atoi(value.c_str());
+}
+
+static int parse_filter(const std::string& value) {
+    for (std::size_t i = 0; i < FILTER_MODES; ++i)
+        if (value == FILTER_NAMES[i])
+            return (int)i;
+    return std::atoi(value.c_str());
+}
+
+// "source:dest:depth", see the top of the file. false if any part of it doesn't mean anything
+static bool parse_route(const std::string& value, ModRoute& route) {
+    const std::size_t colon = value.find(':'), last = value.rfind(':');
+    if (colon == std::string::npos || last == colon)
+        return false;
+    const std::string source = value.substr(0, colon);
+    std::string dest = value.substr(colon + 1, last - colon - 1);
+    route = { 0, 0, 0, MOD_ALL_OSCS, (float)std::atof(value.c_str() + last + 1) };
+    if (source.compare(0, 2, "cc") == 0 && source.size() > 2) {
+        route.source = (uint8_t)ModSource::Controller;
+        route.controller = (uint8_t)std::clamp(std::atoi(source.c_str() + 2), 0, (int)MOD_CONTROLLERS - 1);
+    }
+    else {
+        const std::size_t s = std::find(MOD_SOURCE_NAMES, MOD_SOURCE_NAMES + MOD_SOURCES, source) - MOD_SOURCE_NAMES;
+        if (s >= (std::size_t)ModSource::Controller)
+            return false;
+        route.source = (uint8_t)s;
+    }
+    const std::size_t dot = dest.find('.');
+    if (dot != std::string::npos) {
+        if (dest.size() != dot + 2 || dest[dot + 1] < 'A' || dest[dot + 1] > 'C')
+            return false;
+        route.osc = (uint8_t)(dest[dot + 1] - 'A');
+        dest.resize(dot);
+    }
+    const std::size_t d = std::find(MOD_DEST_NAMES, MOD_DEST_NAMES + MOD_DESTS, dest) - MOD_DEST_NAMES;
+    if (d == MOD_DESTS)
+        return false;
+    route.dest = (uint8_t)d;
+    return true;
+}
+
+// the load test's sender: every millisecond, its share of rate messages to the oscillators,
+// the master level and the notes, with every fourth packet a bundle timed a block ahead
+static void send_load(unsigned short port, double rate, const std::atomic<bool>& running, uint64_t& sent) {
+    OscClient client;
+    if (!client.open(port))
+        return;
+    OscWriter packet;
+    const char* addresses[] = { "/osc/A/amp", "/osc/B/note", "/osc/C/morph", "/osc/A/lfo/rate", "/osc/B/left_inc", "/osc/C/amp", "/master", "/osc/A/note" };
+    const std::size_t kinds = sizeof addresses / sizeof addresses[0];
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t k = 0;
+    for (int64_t ms = 1; running.load(); ++ms) {
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(ms));
+        for (const uint64_t due = (uint64_t)(rate * ms / 1000.0); k < due;) {
+            packet.clear();
+            const bool bundled = k % 4 == 0;
+            if (bundled)
+                packet.begin_bundle(steady_to_timetag(steady_now_ns() + 10000000));
+            for (std::size_t m = 0; m < (bundled ? 8u : 1u) && k < due; ++m, ++k) {
+                const std::size_t kind = k % kinds;
+                const float wobble = (float)(k / kinds % 16) / 16.0f;
+                float value = wobble;
+                if (kind == 0 || kind == 5)
+                    value = 0.2f + 0.3f * wobble;
+                else if (kind == 1 || kind == 7)
+                    value = (float)(k / kinds % 24);
+                else if (kind == 3)
+                    value = 1.0f + 4.0f * wobble;
+                else if (kind == 4)
+                    value = 1.0f + 0.01f * wobble;
+                else if (kind == 6)
+                    value = 0.05f + 0.05f * wobble;
+                packet.message(addresses[kind], value);
+            }
+            sent += client.send(packet);
+        }
+    }
+}
+
+// the shape of each table is only built once every parameter has been read
+struct ShapeSettings {
+    int waveform;
+    float pw;
+};
+
+// morph tables are opened once the engine exists
+struct MorphSettings {
+    std::string path;
+    std::size_t frame_size{ 0 };
+    float position{ 0.0f };
+};
+
+// notes are started once the patch is set up, the pool size is needed before the engine exists
+struct NoteSettings {
+    std::vector<int> notes;
+    float velocity{ 1.0f };
+    std::size_t voices{ DEFAULT_VOICES };
+};
+
+// the envelope keys are gathered up and applied on top of whatever envelope there was, negative
+// for the ones that weren't given
+struct EnvelopeSettings {
+    std::string segments;
+    float attack{ -1 };
+    float decay{ -1 };
+    float sustain{ -1 };
+    float release{ -1 };
+    float curve{ -1 };
+    int hold{ -2 };
+    bool given{ false };
+};
+
+static EnvelopeShape build_envelope(EnvelopeShape shape, const EnvelopeSettings& e) {
+    if (!e.segments.empty()) {
+        shape.count = 0;
+        for (std::size_t pos = 0; pos < e.segments.size() && shape.count < (int)ENV_MAX_SEGMENTS;) {
+            const std::size_t comma = std::min(e.segments.find(',', pos), e.segments.size());
+            EnvSegment segment{ 0.0f, 0.0f, 0.0f };
+            sscanf(e.segments.substr(pos, comma - pos).c_str(), "%f:%f:%f", &segment.level, &segment.seconds, &segment.curve);
+            shape.segment[shape.count++] = segment;
+            pos = comma + 1;
+        }
+        shape.sustain = shape.count - 1;
+    }
+    if (e.attack >= 0 || e.decay >= 0 || e.sustain >= 0) {
+        if (shape.count != 2 || shape.sustain != 1)
+            shape = adsr_envelope(0.0f, 0.0f, 1.0f, shape.release.seconds, shape.release.curve);
+        if (e.attack >= 0)
+            shape.segment[0].seconds = e.attack;
+        if (e.decay >= 0)
+            shape.segment[1].seconds = e.decay;
+        if (e.sustain >= 0)
+            shape.segment[1].level = e.sustain;
+    }
+    if (e.hold >= -1)
+        shape.sustain = e.hold;
+    if (e.release >= 0)
+        shape.release.seconds = e.release;
+    if (e.curve >= 0) {
+        for (auto& segment : shape.segment)
+            segment.curve = e.curve;
+        shape.release.curve = e.curve;
+    }
+    return shape;
+}
+
+// routes are added to whatever the preset had and sent in one go once every key has been read
+struct RouteSettings {
+    ModMatrix matrix{ empty_matrix() };
+    bool given{ false };
+};
+
+// the preset everything else starts from, and where the finished patch is saved
+struct BankSettings {
+    std::string path;
+    std::string preset;
+    std::string save;
+    std::string tags;
+};
+
+static bool apply_setting(SynthEngine& st, ShapeSettings* osc_shapes, ShapeSettings* lfo_shapes, MorphSettings* morphs, NoteSettings& notes, EnvelopeSettings& env,
+    RouteSettings& routes, const std::string& key, const std::string& value) {
+    const float v = (float)std::atof(value.c_str());
+    if (key == "mod") {
+        routes.given = true;
+        if (value == "none") {
+            routes.matrix = empty_matrix();
+            return true;
+        }
+        ModRoute route;
+        if (routes.matrix.count >= (int32_t)MOD_MAX_ROUTES || !parse_route(value, route))
+            return false;
+        routes.matrix.route[routes.matrix.count++] = route;
+        return true;
+    }
+    if (key.compare(0, 3, "cc.") == 0)
+        return st.set_controller(std::clamp(std::atoi(key.c_str() + 3), 0, (int)MOD_CONTROLLERS - 1), v);
+    if (key.compare(0, 4, "env.") == 0) {
+        env.given = true;
+        const std::string name = key.substr(4);
+        if (name == "segments")
+            env.segments = value;
+        else if (name == "attack")
+            env.attack = std::max(v, 0.0f);
+        else if (name == "decay")
+            env.decay = std::max(v, 0.0f);
+        else if (name == "sustain")
+            env.sustain = std::max(v, 0.0f);
+        else if (name == "release")
+            env.release = std::max(v, 0.0f);
+        else if (name == "curve")
+            env.curve = std::max(v, 0.0f);
+        else if (name == "hold")
+            env.hold = std::max(std::atoi(value.c_str()), -1);
+        else
+            return false;
+        return true;
+    }
+    if (key == "master")
+        return st.set_param(Param::MasterAmp, 0, v);
+    if (key == "control_block")
+        return st.set_param(Param::ControlBlock, 0, v);
+    if (key == "smoothing")
+        return st.set_param(Param::SmoothingTime, 0, v);
+    if (key == "steal")
+        return st.set_param(Param::StealPolicy, 0, (float)parse_steal(value));
+    if (key == "fm")
+        return st.set_param(Param::FmAlgorithm, 0, (float)parse_fm(value));
+    if (key == "fm.feedback")
+        return st.set_param(Param::FmFeedback, 0, v);
+    if (key == "filter")
+        return st.set_param(Param::FilterType, 0, (float)parse_filter(value));
+    if (key == "filter.cutoff")
+        return st.set_param(Param::FilterCutoff, 0, v);
+    if (key == "filter.resonance")
+        return st.set_param(Param::FilterResonance, 0, v);
+    if (key == "filter.key")
+        return st.set_param(Param::FilterKeyTrack, 0, v);
+    if (key == "voices" || key == "bank" || key == "preset" || key == "save" || key == "tags")
+        return true;
+    if (key == "velocity") {
+        notes.velocity = v;
+        return true;
+    }
+    if (key == "notes") {
+        notes.notes.clear();
+        for (std::size_t pos = 0; pos < value.size();) {
+            const std::size_t comma = std::min(value.find(',', pos), value.size());
+            notes.notes.push_back(std::atoi(value.substr(pos, comma - pos).c_str()));
+            pos = comma + 1;
+        }
+        return true;
+    }
+
+    if (key.size() < 3 || key[0] < 'A' || key[0] > 'C' || key[1] != '.')
+        return false;
+    const std::size_t j = key[0] - 'A';
+    const std::string name = key.substr(2);
+
+    if (name == "wave")
+        osc_shapes[j].waveform = parse_waveform(value);
+    else if (name == "pw")
+        osc_shapes[j].pw = v;
+    else if (name == "amp")
+        return st.set_param(Param::OscAmp, j, v);
+    else if (name == "inc")
+        return st.set_param(Param::LeftPhaseInc, j, v) && st.set_param(Param::RightPhaseInc, j, v);
+    else if (name == "left_inc")
+        return st.set_param(Param::LeftPhaseInc, j, v);
+    else if (name == "right_inc")
+        return st.set_param(Param::RightPhaseInc, j, v);
+    else if (name == "morph_file")
+        morphs[j].path = value;
+    else if (name == "frame_size")
+        morphs[j].frame_size = std::strtoul(value.c_str(), nullptr, 10);
+    else if (name == "morph") {
+        morphs[j].position = std::clamp(v, 0.0f, 1.0f);
+        return st.set_param(Param::MorphPosition, j, morphs[j].position);
+    }
+    else if (name == "interp")
+        return st.set_param(Param::Interpolation, j, (float)parse_interp(value));
+    else if (name == "lfo.wave")
+        lfo_shapes[j].waveform = parse_waveform(value);
+    else if (name == "lfo.pw")
+        lfo_shapes[j].pw = v;
+    else if (name == "lfo.rate")
+        return st.set_param(Param::LfoRate, j, v);
+    else if (name == "lfo.depth")
+        return st.set_param(Param::LfoDepth, j, v);
+    else if (name == "lfo.enable")
+        return st.set_param(Param::LfoEnable, j, v != 0);
+    else
+        return false;
+    return true;
+}
+
+static bool split_setting(const std::string& line, std::string& key, std::string& value) {
+    const std::size_t eq = line.find('=');
+    if (eq == std::string::npos)
+        return false;
+    auto trim = [](std::string s) {
+        s.erase(0, s.find_first_not_of(" \t\r"));
+        s.erase(s.find_last_not_of(" \t\r") + 1);
+        return s;
+    };
+    key = trim(line.substr(0, eq));
+    value = trim(line.substr(eq + 1));
+    return !key.empty();
+}
+
+static void write_wav_header(FILE* f, unsigned int frames, unsigned int rate) {
+    const unsigned int data_bytes = frames * 2 * sizeof(float);
+    const unsigned int riff_bytes = 36 + data_bytes;
+    const unsigned int fmt_bytes = 16;
+    const unsigned short format = 3; // IEEE float
+    const unsigned short channels = 2;
+    const unsigned int byte_rate = rate * 2 * sizeof(float);
+    const unsigned short align = 2 * sizeof(float);
+    const unsigned short bits = 32;
+
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&riff_bytes, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    fwrite(&fmt_bytes, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);
+    fwrite(&byte_rate, 4, 1, f);
+    fwrite(&align, 2, 1, f);
+    fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    fwrite(&data_bytes, 4, 1, f);
+}
+
+int main(int argc, char** argv) {
+    double seconds = 10.0;
+    unsigned long block = 512;
+    unsigned threads = 1;
+    unsigned sample_rate = DEFAULT_SAMPLE_RATE;
+    std::string out_path;
+    std::string patch_path;
+    std::string midi_path;
+    bool seconds_given = false;
+    bool realtime = false;
+    int osc_port = -1;
+    double osc_load = 0;
+    std::vector<std::string> settings;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if ((arg == "-s" || arg == "--seconds") && has_value) {
+            seconds = std::atof(argv[++i]);
+            seconds_given = true;
+        }
+        else if ((arg == "-b" || arg == "--block") && has_value)
+            block = std::strtoul(argv[++i], nullptr, 10);
+        else if ((arg == "-r" || arg == "--rate") && has_value)
+            sample_rate = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        else if ((arg == "-t" || arg == "--threads") && has_value)
+            threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        else if ((arg == "-o" || arg == "--out") && has_value)
+            out_path = argv[++i];
+        else if ((arg == "-p" || arg == "--patch") && has_value)
+            patch_path = argv[++i];
+        else if ((arg == "-m" || arg == "--midi") && has_value)
+            midi_path = argv[++i];
+        else if (arg == "--osc" && has_value)
+            osc_port = std::atoi(argv[++i]);
+        else if (arg == "--osc-load" && has_value)
+            osc_load = std::atof(argv[++i]);
+        else if (arg == "--realtime")
+            realtime = true;
+        else if (arg.find('=') != std::string::npos)
+            settings.push_back(arg);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (osc_load > 0 && osc_port < 0)
+        osc_port = 0;
+    // remote changes are timed by the wall clock, so an osc session plays at the speed of one
+    if (osc_port >= 0)
+        realtime = true;
+    if (seconds <= 0 || block == 0 || sample_rate == 0 || osc_port > 65535 || osc_load < 0) {
+        usage();
+        return 1;
+    }
+
+    // patch file lines go first so anything on the command line overrides them
+    if (!patch_path.empty()) {
+        std::ifstream patch(patch_path);
+        if (!patch) {
+            fprintf(stderr, "could not open patch file %s\n", patch_path.c_str());
+            return 1;
+        }
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(patch, line)) {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                lines.push_back(line);
+        }
+        settings.insert(settings.begin(), lines.begin(), lines.end());
+    }
+
+    NoteSettings notes;
+    BankSettings bank_settings;
+    for (const auto& setting : settings) {
+        std::string key, value;
+        if (!split_setting(setting, key, value))
+            continue;
+        if (key == "voices")
+            notes.voices = std::strtoul(value.c_str(), nullptr, 10);
+        else if (key == "bank")
+            bank_settings.path = value;
+        else if (key == "preset")
+            bank_settings.preset = value;
+        else if (key == "save")
+            bank_settings.save = value;
+        else if (key == "tags")
+            bank_settings.tags = value;
+    }
+    if ((!bank_settings.preset.empty() || !bank_settings.save.empty()) && bank_settings.path.empty()) {
+        fprintf(stderr, "preset and save need a bank\n");
+        return 1;
+    }
+
+    // far too big for the stack with every band-limited table level in it
+    auto engine = std::make_unique<SynthEngine>(notes.voices);
+    SynthEngine& st = *engine;
+    st.set_render_threads(threads);
+    st.set_sample_rate(sample_rate);
+    ShapeSettings osc_shapes[3]{ { 2, 0.5f }, { 2, 0.5f }, { 2, 0.5f } };
+    ShapeSettings lfo_shapes[3]{ { 2, 0.5f }, { 2, 0.5f }, { 2, 0.5f } };
+    if (!bank_settings.preset.empty()) {
+        std::string error;
+        auto bank = PresetBank::open(bank_settings.path, &error);
+        if (!bank) {
+            fprintf(stderr, "could not open bank %s: %s\n", bank_settings.path.c_str(), error.c_str());
+            return 1;
+        }
+        Preset preset;
+        const std::size_t i = bank->find(bank_settings.preset);
+        if (i == bank->size() || !bank->load(i, preset) || !st.apply_preset(preset)) {
+            fprintf(stderr, "could not load preset %s from %s\n", bank_settings.preset.c_str(), bank_settings.path.c_str());
+            return 1;
+        }
+        for (std::size_t j = 0; j < 3; ++j) {
+            osc_shapes[j] = { preset.osc[j].waveform, preset.osc[j].pulse_width };
+            lfo_shapes[j] = { preset.osc[j].lfo_waveform, preset.osc[j].lfo_pulse_width };
+        }
+    }
+    MorphSettings morphs[3];
+    EnvelopeSettings env;
+    RouteSettings routes{ st.mod_sent };
+    for (const auto& setting : settings) {
+        std::string key, value;
+        if (!split_setting(setting, key, value) || !apply_setting(st, osc_shapes, lfo_shapes, morphs, notes, env, routes, key, value)) {
+            fprintf(stderr, "unknown setting: %s\n", setting.c_str());
+            return 1;
+        }
+    }
+    if ((env.given && !st.set_envelope(build_envelope(st.envelope_sent, env))) || (routes.given && !st.set_modulation(routes.matrix))) {
+        fprintf(stderr, "too many settings\n");
+        return 1;
+    }
+    for (std::size_t j = 0; j < 3; ++j) {
+        st.oscillators[j].first->ps.current_waveform = osc_shapes[j].waveform;
+        st.oscillators[j].first->update_shape(osc_shapes[j].waveform, osc_shapes[j].pw);
+        st.oscillators[j].second->ps.current_waveform = lfo_shapes[j].waveform;
+        st.oscillators[j].second->ps.pulse_width = lfo_shapes[j].pw;
+        st.oscillators[j].second->update_shape(lfo_shapes[j].waveform, lfo_shapes[j].pw);
+    }
+
+    // only the frames either side of the starting position are built up front, anything else
+    // the engine asks for is built between blocks, like the gui does between frames
+    std::unique_ptr<MorphTable> morph_tables[3];
+    for (std::size_t j = 0; j < 3; ++j) {
+        if (morphs[j].path.empty())
+            continue;
+        std::string error;
+        morph_tables[j] = MorphTable::open(morphs[j].path, morphs[j].frame_size, &error);
+        if (!morph_tables[j]) {
+            fprintf(stderr, "could not load %s: %s\n", morphs[j].path.c_str(), error.c_str());
+            return 1;
+        }
+        const std::size_t k = (std::size_t)(morphs[j].position * (morph_tables[j]->frames() - 1));
+        morph_tables[j]->prepare(k);
+        morph_tables[j]->prepare(k + 1);
+        st.set_morph_table(j, morph_tables[j].get());
+    }
+
+    if (!bank_settings.save.empty()) {
+        Preset preset = st.capture_preset();
+        set_preset_text(preset.name, PRESET_NAME_LEN, bank_settings.save);
+        set_preset_text(preset.tags, PRESET_TAGS_LEN, bank_settings.tags);
+        std::string error;
+        const std::size_t presets = PresetBank::store(bank_settings.path, preset, &error);
+        if (!presets) {
+            fprintf(stderr, "could not save preset %s: %s\n", bank_settings.save.c_str(), error.c_str());
+            return 1;
+        }
+        printf("saved preset %s to %s, %zu presets\n", bank_settings.save.c_str(), bank_settings.path.c_str(), presets);
+    }
+
+    // a song plays from the first block, with its events split out to the exact frame
+    std::unique_ptr<MidiSequence> song;
+    if (!midi_path.empty()) {
+        std::string error;
+        song = MidiSequence::open(midi_path, &error);
+        uint64_t ticket;
+        if (!song || !st.set_sequence(song.get(), ticket)) {
+            fprintf(stderr, "could not play %s: %s\n", midi_path.c_str(), error.c_str());
+            return 1;
+        }
+        if (!seconds_given)
+            seconds = song->seconds() + 1.0;
+    }
+
+    if (notes.notes.empty() && !song)
+        notes.notes.push_back(BASE_NOTE);
+    for (int note : notes.notes) {
+        if (!st.note_on(note, notes.velocity)) {
+            fprintf(stderr, "too many notes\n");
+            return 1;
+        }
+    }
+
+    OscServer osc(st);
+    std::atomic<bool> loading{ false };
+    std::thread load_thread;
+    uint64_t load_sent = 0;
+    if (osc_port >= 0) {
+        std::string error;
+        if (!osc.start((unsigned short)osc_port, true, &error)) {
+            fprintf(stderr, "could not listen for osc on port %d: %s\n", osc_port, error.c_str());
+            return 1;
+        }
+        printf("listening for osc on udp port %u\n", osc.port());
+        if (osc_load > 0) {
+            loading = true;
+            load_thread = std::thread(send_load, osc.port(), osc_load, std::cref(loading), std::ref(load_sent));
+        }
+    }
+
+    FILE* out = nullptr;
+    const bool wav = out_path.size() >= 4 && out_path.compare(out_path.size() - 4, 4, ".wav") == 0;
+    if (!out_path.empty()) {
+        out = fopen(out_path.c_str(), "wb");
+        if (!out) {
+            fprintf(stderr, "could not open %s for writing\n", out_path.c_str());
+            return 1;
+        }
+    }
+
+    const unsigned long total = (unsigned long)(seconds * sample_rate);
+    if (out && wav)
+        write_wav_header(out, (unsigned int)total, sample_rate);
+
+    std::vector<float> buffer(2 * block);
+    double render_ns = 0, peak_block_ns = 0;
+    unsigned long blocks = 0, late_blocks = 0;
+    const double budget_ns = 1e9 * block / sample_rate;
+    const auto started = std::chrono::steady_clock::now();
+    for (unsigned long done = 0; done < total; done += block) {
+        const unsigned long frames = std::min(block, total - done);
+        // a device asks for the next block once the last one has played
+        if (realtime)
+            std::this_thread::sleep_until(started + std::chrono::nanoseconds((int64_t)(1e9 * done / sample_rate)));
+        auto t0 = std::chrono::steady_clock::now();
+        st.render(buffer.data(), frames);
+        auto t1 = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        render_ns += ns;
+        peak_block_ns = std::max(peak_block_ns, ns);
+        late_blocks += ns > budget_ns;
+        ++blocks;
+        // waveform changes from osc are built here between blocks, like the gui does between frames
+        for (ShapeChange change; osc.pop_shape(change);) {
+            ShapeSettings& shape = change.lfo ? lfo_shapes[change.osc] : osc_shapes[change.osc];
+            if (change.waveform >= 0)
+                shape.waveform = change.waveform;
+            if (change.pw >= 0)
+                shape.pw = change.pw;
+            Wavetable_t* table = change.lfo ? st.oscillators[change.osc].second : st.oscillators[change.osc].first;
+            table->ps.current_waveform = shape.waveform;
+            if (change.lfo)
+                table->ps.pulse_width = shape.pw;
+            table->update_shape(shape.waveform, shape.pw);
+        }
+        for (auto& table : morph_tables)
+            if (table)
+                table->service();
+        if (out)
+            fwrite(buffer.data(), sizeof(float), 2 * frames, out);
+    }
+    if (out)
+        fclose(out);
+    loading = false;
+    if (load_thread.joinable())
+        load_thread.join();
+    osc.stop();
+
+    printf("rendered %lu frames (%.2f s) in %lu blocks of %lu\n", total, total / (double)sample_rate, blocks, block);
+    printf("voices            %u sounding of %zu on %u thread(s)\n", st.sounding_voices.load(), st.max_voices(), st.render_threads());
+    printf("real-time factor  %.1fx\n", (total / (double)sample_rate) / (render_ns * 1e-9));
+    printf("ns/sample         %.2f (per stereo frame)\n", render_ns / total);
+    printf("peak block        %.0f ns (%.1f%% of the %.0f ns budget)\n", peak_block_ns, 100.0 * peak_block_ns / budget_ns, budget_ns);
+    if (osc_port >= 0) {
+        if (osc_load > 0)
+            printf("osc load          %llu packets sent\n", (unsigned long long)load_sent);
+        printf("osc               %llu packets, %llu changes, %llu unknown messages, %llu dropped\n", (unsigned long long)osc.packets.load(), (unsigned long long)osc.changes.load(), (unsigned long long)osc.unknown.load(), (unsigned long long)osc.dropped.load());
+        printf("osc applied       %llu (%.0f/s), longest wait for a block %.2f ms\n", (unsigned long long)st.remote_applied.load(), st.remote_applied.load() * (double)sample_rate / total, st.remote_peak_wait_ns.load() * 1e-6);
+        printf("late blocks       %lu of %lu over budget\n", late_blocks, blocks);
+    }
+    if (song)
+        printf("midi file         %zu events over %.2f s\n", song->size(), song->seconds());
+    for (std::size_t j = 0; j < 3; ++j) {
+        if (morph_tables[j])
+            printf("morph table %c     %zu of %zu frames of %zu built\n", (char)('A' + j), morph_tables[j]->built_frames(), morph_tables[j]->frames(), morph_tables[j]->frame_size());
+    }
+    const PerfSnapshot perf = st.perf.snapshot();
+    printf("block time        p50 < %.0f%%  p99 < %.0f%%  of budget, engine load %.2f%%\n", 100.0 * perf.p50, 100.0 * perf.p99, 100.0 * perf.load);
+    return 0;
+}
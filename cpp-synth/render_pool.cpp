@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include "render_pool.h"
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// how long a worker keeps polling for the next batch before it parks. one 128 frame block
+// at 48 kHz is 2.7 ms, so this keeps back to back batches off the futex without burning a core
+constexpr auto SPIN_TIME = std::chrono::microseconds(50);
+
+static uint64_t pack_range(uint64_t begin, uint64_t end) {
+    return begin | (end << 32);
+}
+
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// best effort, an unprivileged process just keeps the normal scheduler
+static void make_realtime(std::thread& thread, unsigned core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << (core % (8 * sizeof(DWORD_PTR))));
+    SetThreadPriority(thread.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    sched_param param{};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+#else
+    (void)thread;
+    (void)core;
+#endif
+}
+
+RenderPool::RenderPool(unsigned count)
+    : ranges(new Range[std::max(count, 1u)]),
+      worker_count(std::max(count, 1u)) {
+    // the caller is usually on core 0, so the workers start from core 1
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned w = 1; w < worker_count; ++w) {
+        threads.emplace_back(&RenderPool::worker_main, this, w);
+        make_realtime(threads.back(), w % cores);
+    }
+}
+
+RenderPool::~RenderPool() {
+    quit.store(true);
+    epoch.fetch_add(1);
+    epoch.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void RenderPool::run(std::size_t tasks, Job fn, void* context) {
+    if (worker_count == 1 || tasks <= 1) {
+        for (std::size_t t = 0; t < tasks; ++t)
+            fn(context, t, 0);
+        return;
+    }
+
+    job = fn;
+    ctx = context;
+    done.store(0, std::memory_order_relaxed);
+    // contiguous runs, so neighbouring tasks stay on one core unless someone steals them
+    for (unsigned w = 0; w < worker_count; ++w) {
+        const std::size_t begin = tasks * w / worker_count;
+        const std::size_t end = tasks * (w + 1) / worker_count;
+        ranges[w].bounds.store(pack_range(begin, end), std::memory_order_release);
+    }
+    // opens the batch
+    epoch.fetch_add(1);
+    if (parked.load())
+        epoch.notify_all();
+
+    work(0);
+    while (done.load(std::memory_order_acquire) < tasks)
+        cpu_relax();
+    // closes it. a worker counts itself busy before it looks at the epoch, so one that saw the
+    // batch open is waited for here, and one that comes later sees it closed and keeps its hands
+    // off the ranges the next batch is about to reset
+    epoch.fetch_add(1);
+    while (busy.load())
+        cpu_relax();
+}
+
+void RenderPool::worker_main(unsigned worker) {
+    using clock = std::chrono::steady_clock;
+    uint32_t seen = 0;
+    for (;;) {
+        const auto spin_until = clock::now() + SPIN_TIME;
+        while (epoch.load(std::memory_order_acquire) == seen) {
+            for (int i = 0; i < 64; ++i)
+                cpu_relax();
+            if (clock::now() < spin_until)
+                continue;
+            // run() checks parked after bumping the epoch, and wait() returns straight away
+            // if the epoch already moved, so a batch can't slip past a worker going to sleep
+            parked.fetch_add(1);
+            epoch.wait(seen);
+            parked.fetch_sub(1);
+        }
+        busy.fetch_add(1);
+        seen = epoch.load();
+        if (quit.load()) {
+            busy.fetch_sub(1);
+            return;
+        }
+        if (seen & 1)
+            work(worker);
+        busy.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void RenderPool::work(unsigned worker) {
+    std::size_t task;
+    while (pop(worker, task) || steal(worker, task)) {
+        job(ctx, task, worker);
+        done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool RenderPool::pop(unsigned worker, std::size_t& task) {
+    uint64_t r = ranges[worker].bounds.load(std::memory_order_acquire);
+    for (;;) {
+        const uint64_t begin = r & 0xffffffffu, end = r >> 32;
+        if (begin >= end)
+            return false;
+        if (ranges[worker].bounds.compare_exchange_weak(r, pack_range(begin + 1, end), std::memory_order_acq_rel)) {
+            task = (std::size_t)begin;
+            return true;
+        }
+    }
+}
+
+bool RenderPool::steal(unsigned worker, std::size_t& task) {
+    for (unsigned i = 1; i < worker_count; ++i) {
+        Range& victim = ranges[(worker + i) % worker_count];
+        uint64_t r = victim.bounds.load(std::memory_order_acquire);
+        for (;;) {
+            const uint64_t begin = r & 0xffffffffu, end = r >> 32;
+            if (begin >= end)
+                break;
+            // take the back half, rounded up so a single task left can still be stolen
+            const uint64_t split = end - (end - begin + 1) / 2;
+            if (!victim.bounds.compare_exchange_weak(r, pack_range(begin, split), std::memory_order_acq_rel))
+                continue;
+            // our own range is empty, so nobody else is changing it while we refill it
+            ranges[worker].bounds.store(pack_range(split + 1, end), std::memory_order_release);
+            task = (std::size_t)split;
+            return true;
+        }
+    }
+    return false;
+}
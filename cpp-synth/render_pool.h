@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// a fixed set of real-time worker threads that the audio callback hands a batch of tasks to.
+// the calling thread is worker 0 and works on the batch too, the others are pinned to their
+// own cores. each worker starts on a contiguous run of the tasks and steals half of whatever
+// is left in someone else's run once its own is done. nothing here allocates or locks after
+// construction, workers spin for a short while after a batch and then park on a futex
+class RenderPool
+{
+public:
+    // task is the index into the batch, worker the index of the thread running it (0 is the caller)
+    using Job = void (*)(void* ctx, std::size_t task, unsigned worker);
+private:
+    // a worker's remaining tasks, begin in the low half and end in the high half,
+    // so the owner taking from the front and thieves taking from the back are both one CAS
+    struct alignas(64) Range {
+        std::atomic<uint64_t> bounds{ 0 };
+    };
+    std::unique_ptr<Range[]> ranges;
+    std::vector<std::thread> threads;
+    unsigned worker_count;
+
+    // set before the epoch opens a batch, so a worker that sees it open sees them too
+    Job job{ nullptr };
+    void* ctx{ nullptr };
+    // bumped twice per batch and workers wait on it: odd while a batch is open, even once it has
+    // closed and its ranges are free to be rewritten
+    alignas(64) std::atomic<uint32_t> epoch{ 0 };
+    alignas(64) std::atomic<std::size_t> done{ 0 };  // tasks finished in the current batch
+    alignas(64) std::atomic<unsigned> busy{ 0 };     // workers that may be looking at the ranges
+    std::atomic<unsigned> parked{ 0 };               // workers asleep in epoch.wait
+    std::atomic<bool> quit{ false };
+
+    void worker_main(unsigned worker);
+    // takes and runs tasks until there are none left to take or steal
+    void work(unsigned worker);
+    bool pop(unsigned worker, std::size_t& task);
+    bool steal(unsigned worker, std::size_t& task);
+public:
+    // count includes the caller, so 1 makes a pool with no extra threads that runs everything inline
+    explicit RenderPool(unsigned count);
+    ~RenderPool();
+    RenderPool(const RenderPool&) = delete;
+    RenderPool& operator=(const RenderPool&) = delete;
+
+    unsigned size() const { return worker_count; }
+    // audio thread only, runs job for every task in [0, tasks) and returns once all of them are done
+    void run(std::size_t tasks, Job fn, void* context);
+};
@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <cmath>
+#include "scope.h"
+
+std::size_t find_trigger(const float* frames, std::size_t channel, std::size_t span, ScopeTrigger trigger, float level) {
+    if (trigger == ScopeTrigger::Free || span < 2)
+        return span;
+    for (std::size_t i = span - 1; i > 0; --i) {
+        const float before = frames[2 * (i - 1) + channel];
+        const float now = frames[2 * i + channel];
+        if (trigger == ScopeTrigger::Rising ? (before < level && now >= level) : (before > level && now <= level))
+            return i;
+    }
+    return span;
+}
+
+template <std::size_t STRIDE>
+static void decimate_peak_strided(const float* samples, std::size_t n, float* out, std::size_t width) {
+    for (std::size_t p = 0; p < width; ++p) {
+        const std::size_t begin = n * p / width;
+        const std::size_t end = std::max(begin + 1, n * (p + 1) / width);
+        float peak = 0;
+        for (std::size_t i = begin; i < end && i < n; ++i) {
+            const float v = samples[STRIDE * i];
+            if (std::fabs(v) > std::fabs(peak))
+                peak = v;
+        }
+        out[p] = peak;
+    }
+}
+
+void decimate_peak(const float* frames, std::size_t channel, std::size_t n, float* out, std::size_t width) {
+    decimate_peak_strided<2>(frames + channel, n, out, width);
+}
+
+void decimate_peak(const float* samples, std::size_t n, float* out, std::size_t width) {
+    decimate_peak_strided<1>(samples, n, out, width);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+
+// the oscilloscope's signal handling, kept apart from the gui so it can run headless
+
+enum class ScopeTrigger : int {
+    Free,    // no trigger, always shows the most recent frames
+    Rising,  // the signal going up through the level, a zero crossing at level 0
+    Falling, // the signal going down through the level
+};
+
+// where a trigger of the given kind happens in samples [0, span) of a channel of interleaved
+// stereo, searching from the newest so the display is as recent as possible.
+// returns span if there isn't one
+std::size_t find_trigger(const float* frames, std::size_t channel, std::size_t span, ScopeTrigger trigger, float level);
+
+// squeezes n frames of one channel into width points for a plot, each point is the sample
+// furthest from zero in its stretch so peaks survive the decimation
+void decimate_peak(const float* frames, std::size_t channel, std::size_t n, float* out, std::size_t width);
+// the same for a plain mono buffer
+void decimate_peak(const float* samples, std::size_t n, float* out, std::size_t width);
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// bounded single-producer/single-consumer queue, wait-free on both ends
+// push() may only be called from one thread and pop() from one other thread
+// capacity must be a power of two so the indices can be masked instead of wrapped
+template <typename T, std::size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+private:
+    T buffer[N]{};
+    // head is only written by the consumer, tail only by the producer
+    // keep them on separate cache lines so the two threads don't fight over one
+    alignas(64) std::atomic<std::size_t> head{ 0 };
+    alignas(64) std::atomic<std::size_t> tail{ 0 };
+public:
+    bool push(const T& value) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        buffer[t & (N - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // pushes all n values or none of them. the consumer sees them appear together,
+    // so a pop() loop that runs until the queue is empty takes all of them or none
+    bool push_all(const T* values, std::size_t n) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (N - (t - head.load(std::memory_order_acquire)) < n)
+            return false;
+        for (std::size_t i = 0; i < n; ++i)
+            buffer[(t + i) & (N - 1)] = values[i];
+        tail.store(t + n, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = buffer[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side, how many more values are sure to fit
+    std::size_t free_space() const {
+        return N - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+    }
+
+    // consumer side, the oldest value without taking it, nullptr if there isn't one
+    const T* front() const {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &buffer[h & (N - 1)];
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t capacity() { return N; }
+};
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include "viewer_cache.h"
+#include "scope.h"
+
+ViewerCache::ViewerCache() : kernel(select_osc_kernel()) {
+}
+
+bool ViewerCache::update(const std::vector<std::pair<Wavetable_t*, LFO_t*>>& oscillators, std::size_t samples, std::size_t width) {
+    Key k{};
+    for (std::size_t j = 0; j < 3; ++j) {
+        const Wavetable_t* osc = oscillators[j].first;
+        k.generation[j] = osc->generation;
+        k.amp[j] = osc->ps.amp.load(std::memory_order_relaxed);
+        k.left_inc[j] = osc->ps.left_phase_inc.load(std::memory_order_relaxed);
+        k.right_inc[j] = osc->ps.right_phase_inc.load(std::memory_order_relaxed);
+    }
+    k.samples = samples;
+    k.width = width;
+    if (valid && k == key)
+        return false;
+
+    for (std::size_t j = 0; j < 3; ++j) {
+        if (valid && k.generation[j] == key.generation[j])
+            continue;
+        std::copy(oscillators[j].first->table, oscillators[j].first->table + TABLE_SIZE, tables[j]);
+        tables[j][TABLE_SIZE] = tables[j][0];
+    }
+
+    full.resize(samples);
+    left_points.resize(width);
+    right_points.resize(width);
+    sum_channel(k, k.left_inc, left_points.data());
+    sum_channel(k, k.right_inc, right_points.data());
+    key = k;
+    valid = true;
+    return true;
+}
+
+// the viewer steps through each table by the increment itself in table entries, from phase 0
+void ViewerCache::sum_channel(const Key& k, const float* incs, float* out) {
+    std::fill(full.begin(), full.end(), 0.0f);
+    for (std::size_t j = 0; j < 3; ++j) {
+        const uint32_t inc = (uint32_t)(int64_t)std::llround(incs[j] / TABLE_SIZE * 4294967296.0);
+        kernel(tables[j], 0, inc, k.amp[j], full.data(), full.size());
+    }
+    decimate_peak(full.data(), full.size(), out, k.width);
+}
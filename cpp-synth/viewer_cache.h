@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "wavetable.h"
+#include "osc_kernel.h"
+
+// the wavetable viewer's summed left and right curves, all three oscillators at their
+// amplitudes and increments. they are only rebuilt when one of those or a table changes,
+// and are kept already decimated to the width of the plot
+class ViewerCache
+{
+private:
+    // everything the curves depend on, compared every frame
+    struct Key {
+        uint32_t generation[3];
+        float amp[3];
+        float left_inc[3];
+        float right_inc[3];
+        std::size_t samples;
+        std::size_t width;
+        bool operator==(const Key&) const = default;
+    };
+    Key key{};
+    bool valid{ false };
+    // each oscillator's table with the guard sample the block kernels want
+    float tables[3][TABLE_SIZE + 1]{};
+    std::vector<float> full;
+    std::vector<float> left_points;
+    std::vector<float> right_points;
+    OscKernel kernel;
+
+    void sum_channel(const Key& k, const float* incs, float* out);
+public:
+    ViewerCache();
+    // gui thread, rebuilds if anything changed. samples is how many table steps the curves
+    // span at full resolution, width how many points they are squeezed to. returns true if rebuilt
+    bool update(const std::vector<std::pair<Wavetable_t*, LFO_t*>>& oscillators, std::size_t samples, std::size_t width);
+    const float* left() const { return left_points.data(); }
+    const float* right() const { return right_points.data(); }
+    std::size_t size() const { return left_points.size(); }
+};
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <memory>
+#include "wavegen.h"
+#include "bandlimit.h"
+#if SYNTH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// lincomb never needs more sources than the triangle does
+constexpr std::size_t MAX_SOURCES = 4;
+
+void lincomb_portable(float* out, std::size_t n, float c, const float* const* src, const float* gain, std::size_t count) {
+    for (std::size_t i = 0; i < n; ++i) {
+        float v = c;
+        for (std::size_t j = 0; j < count; ++j)
+            v += gain[j] * src[j][i];
+        out[i] = v;
+    }
+}
+
+void ramp_portable(float* out, std::size_t n, float start, float step) {
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = start + step * (float)i;
+}
+
+#if SYNTH_HAVE_AVX2
+SYNTH_TARGET_AVX2
+void lincomb_avx2(float* out, std::size_t n, float c, const float* const* src, const float* gain, std::size_t count) {
+    const __m256 vc = _mm256_set1_ps(c);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = vc;
+        for (std::size_t j = 0; j < count; ++j)
+            v = _mm256_fmadd_ps(_mm256_set1_ps(gain[j]), _mm256_loadu_ps(src[j] + i), v);
+        _mm256_storeu_ps(out + i, v);
+    }
+
+    // whatever doesn't fill a full vector
+    const float* rest[MAX_SOURCES];
+    for (std::size_t j = 0; j < count; ++j)
+        rest[j] = src[j] + i;
+    lincomb_portable(out + i, n - i, c, rest, gain, count);
+}
+
+SYNTH_TARGET_AVX2
+void ramp_avx2(float* out, std::size_t n, float start, float step) {
+    const __m256 s = _mm256_set1_ps(step);
+    __m256 idx = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 eight = _mm256_set1_ps(8);
+    const __m256 base = _mm256_set1_ps(start);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_fmadd_ps(s, idx, base));
+        idx = _mm256_add_ps(idx, eight);
+    }
+    for (; i < n; ++i)
+        out[i] = start + step * (float)i;
+}
+#endif
+
+namespace {
+struct GenKernels {
+    LincombKernel lincomb{ lincomb_portable };
+    RampKernel ramp{ ramp_portable };
+    GenKernels() {
+#if SYNTH_HAVE_AVX2
+        if (cpu_has_avx2()) {
+            lincomb = lincomb_avx2;
+            ramp = ramp_avx2;
+        }
+#endif
+    }
+};
+
+// the band-limited levels every parameterised shape is made from. ramp goes from -1/2 to
+// nearly 1/2 over the table, and parabola is its running sum with the mean taken out, so
+// ramp is the first difference of parabola. both are only built once, on first use
+struct BaseLevels {
+    MipTable ramp;
+    MipTable parabola;
+    double ramp_mean = 0;
+    BaseLevels() {
+        float table[TABLE_SIZE];
+        for (int i = 0; i < TABLE_SIZE; ++i) {
+            table[i] = (float)(i / (double)TABLE_SIZE - 0.5);
+            ramp_mean += table[i];
+        }
+        ramp_mean /= TABLE_SIZE;
+        build_mip_levels(table, ramp);
+
+        double sum = 0;
+        for (int i = 0; i < TABLE_SIZE; ++i) {
+            sum += i / (double)TABLE_SIZE - 0.5 + 0.5 / TABLE_SIZE;
+            table[i] = (float)sum;
+        }
+        build_mip_levels(table, parabola);
+    }
+};
+}
+
+static const GenKernels& kernels() {
+    static const GenKernels k;
+    return k;
+}
+
+static const BaseLevels& base_levels() {
+    static const auto levels = std::make_unique<BaseLevels>();
+    return *levels;
+}
+
+const MipTable& ramp_levels() {
+    return base_levels().ramp;
+}
+
+// out[i] = c + sum of gain[j] * table[j][(i - shift[j]) mod TABLE_SIZE] over the whole table.
+// cut into stretches where none of the reads wrap, so each one is a single kernel call
+static void shifted_lincomb(float* out, float c, const float* const* tables, const int* shifts, const float* gain, std::size_t count) {
+    int cuts[MAX_SOURCES + 2];
+    std::size_t ncuts = 0;
+    cuts[ncuts++] = 0;
+    cuts[ncuts++] = TABLE_SIZE;
+    for (std::size_t j = 0; j < count; ++j)
+        cuts[ncuts++] = shifts[j] & TABLE_MASK;
+    std::sort(cuts, cuts + ncuts);
+
+    const float* src[MAX_SOURCES];
+    for (std::size_t s = 0; s + 1 < ncuts; ++s) {
+        const int begin = cuts[s], end = cuts[s + 1];
+        if (begin == end)
+            continue;
+        for (std::size_t j = 0; j < count; ++j)
+            src[j] = tables[j] + ((begin - shifts[j]) & TABLE_MASK);
+        kernels().lincomb(out + begin, end - begin, c, src, gain, count);
+    }
+}
+
+static void set_guard(float* level) {
+    level[TABLE_SIZE] = level[0];
+}
+
+// a triangle peaking at sample k, from the naive formulas. returns the slopes either side of
+// the peak and the odd step into it, which is what the band-limited levels are built from
+struct TriangleShape {
+    int k;
+    double up, down, peak_step;
+};
+
+static TriangleShape triangle_shape(float pw) {
+    const int k = (int)(TABLE_SIZE * pw);
+    const auto value = [pw, k](int i) {
+        return i < k ? 2.0 * i / (TABLE_SIZE * pw) - 1 : -2.0 * (i - TABLE_SIZE) / (TABLE_SIZE - pw * TABLE_SIZE) - 1;
+    };
+    return { k, 2.0 / (TABLE_SIZE * pw), -2.0 / (TABLE_SIZE - pw * TABLE_SIZE), k > 0 ? value(k) - value(k - 1) : 0.0 };
+}
+
+void generate_table(int waveform, float pw, float* out) {
+    switch (waveform) {
+    case WAVE_SAW:
+        std::copy(SAW_TABLE.begin(), SAW_TABLE.end(), out);
+        break;
+    case WAVE_SINE:
+        std::copy(SINE_TABLE.begin(), SINE_TABLE.end(), out);
+        break;
+    case WAVE_PULSE: {
+        const int m = std::clamp((int)(TABLE_SIZE * pw), 0, TABLE_SIZE);
+        std::fill(out, out + m, 1.0f);
+        std::fill(out + m, out + TABLE_SIZE, -1.0f);
+        break;
+    }
+    case WAVE_TRIANGLE: {
+        const TriangleShape t = triangle_shape(pw);
+        const int k = std::clamp(t.k, 0, TABLE_SIZE);
+        kernels().ramp(out, k, -1.0f, (float)t.up);
+        kernels().ramp(out + k, TABLE_SIZE - k, (float)(-2.0 * (k - TABLE_SIZE) / (TABLE_SIZE - pw * TABLE_SIZE) - 1), (float)t.down);
+        break;
+    }
+    }
+}
+
+void generate_levels(int waveform, float pw, MipTable& out) {
+    generate_table(waveform, pw, out.level[0]);
+    out.pulse_width = 0.0f;
+    set_guard(out.level[0]);
+    const BaseLevels& base = base_levels();
+
+    if (waveform == WAVE_PULSE) {
+        // the pulse is high for m samples, which is a constant plus the ramp minus itself m samples later
+        const int m = std::clamp((int)(TABLE_SIZE * pw), 0, TABLE_SIZE);
+        out.pulse_width = (float)m / TABLE_SIZE;
+        const float gain[2] = { -2.0f, 2.0f };
+        const int shifts[2] = { 0, m };
+        for (int n = 1; n < MIP_LEVELS; ++n) {
+            const float* tables[2] = { base.ramp.level[n], base.ramp.level[n] };
+            shifted_lincomb(out.level[n], 2.0f * m / TABLE_SIZE - 1.0f, tables, shifts, gain, 2);
+            set_guard(out.level[n]);
+        }
+        return;
+    }
+
+    const TriangleShape t = triangle_shape(pw);
+    if (waveform != WAVE_TRIANGLE || t.k < 1 || t.k >= TABLE_SIZE) {
+        // fixed shapes, and triangles with no rising or falling side, go through the fft
+        build_mip_levels(out.level[0], out);
+        return;
+    }
+
+    // the triangle's slope is down everywhere except up over [1, k) and one odd step at k.
+    // summed up that's the parabola minus itself k - 1 samples later, plus a ramp starting at k.
+    // the sum only holds up to a constant, which is whatever keeps the table's mean. band
+    // limiting leaves the mean alone, so it is the same constant for every level
+    const float gain[3] = { (float)(t.up - t.down), -(float)(t.up - t.down), -(float)(t.peak_step - t.down) };
+    const int shifts[3] = { t.k, 1, t.k };
+    double mean = 0;
+    for (int i = 0; i < TABLE_SIZE; ++i)
+        mean += out.level[0][i];
+    const float offset = (float)(mean / TABLE_SIZE - gain[2] * base.ramp_mean);
+    for (int n = 1; n < MIP_LEVELS; ++n) {
+        const float* tables[3] = { base.parabola.level[n], base.parabola.level[n], base.ramp.level[n] };
+        shifted_lincomb(out.level[n], offset, tables, shifts, gain, 3);
+        set_guard(out.level[n]);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include "wavetable.h"
+#include "cpu_features.h"
+
+// every table generator in one place. sine and saw never change, so they are worked out by the
+// compiler and baked into the binary. pulse and triangle depend on the pulse width, so they are
+// generated into plain float buffers with simd kernels, and so are their band-limited levels:
+// those come straight from the levels of a ramp and a parabola that are built once, no fft
+
+// sine for the compiler, reduced to [-pi, pi] and summed well past double precision
+constexpr double constexpr_sin(double x) {
+    const double two_pi = 2 * 3.14159265358979323846;
+    x -= two_pi * (long long)(x / two_pi);
+    if (x > two_pi / 2)
+        x -= two_pi;
+    else if (x < -two_pi / 2)
+        x += two_pi;
+    double term = x, sum = x;
+    for (int n = 1; n < 16; ++n) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr std::array<float, TABLE_SIZE> make_sine_table() {
+    std::array<float, TABLE_SIZE> t{};
+    for (int i = 0; i < TABLE_SIZE; ++i)
+        t[i] = (float)constexpr_sin(i / (double)TABLE_SIZE * 2 * 3.14159265358979323846);
+    return t;
+}
+
+// rises from -1 to 1 with the jump half way through the table, starting at 0
+constexpr std::array<float, TABLE_SIZE> make_saw_table() {
+    std::array<float, TABLE_SIZE> t{};
+    for (int i = 0; i < TABLE_SIZE; ++i)
+        t[i] = 2 * ((i + TABLE_SIZE / 2) % TABLE_SIZE) / (float)TABLE_SIZE - 1.0f;
+    return t;
+}
+
+inline constexpr std::array<float, TABLE_SIZE> SINE_TABLE = make_sine_table();
+inline constexpr std::array<float, TABLE_SIZE> SAW_TABLE = make_saw_table();
+
+// the waveforms as the gui numbers them
+enum Waveform : int {
+    WAVE_SAW = 0,
+    WAVE_SINE = 1,
+    WAVE_PULSE = 2,
+    WAVE_TRIANGLE = 3,
+};
+
+// the drawn cycle of a shape, TABLE_SIZE samples. pw is the pulse width, or for the triangle
+// how far through the cycle its peak is
+void generate_table(int waveform, float pw, float* out);
+// every band-limited level of the same shape, exactly what build_mip_levels would give for it
+void generate_levels(int waveform, float pw, MipTable& out);
+// the levels of the ramp every pulse is made of, i / TABLE_SIZE - 0.5 before band limiting. a
+// pulse of width pw is 2 * pw - 1 minus twice the ramp plus twice the ramp pw of a cycle behind
+const MipTable& ramp_levels();
+
+// the kernel the parameterised shapes are built from: out[i] = c + sum of gain[j] * src[j][i]
+// over n contiguous samples, src may point anywhere including into out
+using LincombKernel = void (*)(float* out, std::size_t n, float c, const float* const* src, const float* gain, std::size_t count);
+void lincomb_portable(float* out, std::size_t n, float c, const float* const* src, const float* gain, std::size_t count);
+#if SYNTH_HAVE_AVX2
+void lincomb_avx2(float* out, std::size_t n, float c, const float* const* src, const float* gain, std::size_t count);
+#endif
+// a linear ramp, out[i] = start + step * i
+using RampKernel = void (*)(float* out, std::size_t n, float start, float step);
+void ramp_portable(float* out, std::size_t n, float start, float step);
+#if SYNTH_HAVE_AVX2
+void ramp_avx2(float* out, std::size_t n, float start, float step);
+#endif
@@ -1,75 +1,68 @@
+#include <algorithm>
+#include <memory>
 #include "wavetable.h"
+#include "bandlimit.h"
+#include "wavegen.h"
 
-float Wavetable_t::interpolate_at(float idx) {
-    float wl, fl;
-    fl = std::modf(idx, &wl);
-    return std::lerp(table[(int)wl % TABLE_SIZE], table[(int)(wl + 1) % TABLE_SIZE], fl);
-}
-
-float Wavetable_t::interpolate_left() {
-    float wl, fl;
-    fl = std::modf(ps.left_phase, &wl);
-    return std::lerp(table[(int)wl % TABLE_SIZE], table[(int)(wl + 1) % TABLE_SIZE], fl);
-}
-
-float Wavetable_t::interpolate_right() {
-    float wl, fl;
-    fl = std::modf(ps.right_phase, &wl);
-    return std::lerp(table[(int)wl % TABLE_SIZE], table[(int)(wl + 1) % TABLE_SIZE], fl);
-}
-
-float LFO_t::interpolate_amp() {
-    float wl, fl;
-    fl = std::modf(ps.left_phase, &wl);
-    return std::lerp(table[(int)wl % TABLE_SIZE], table[(int)(wl + 1) % TABLE_SIZE], fl);
-}
-
-void gen_sin_wave(Wavetable_t& table) {
-    for (int i = 0; i < TABLE_SIZE; i++) 
-        table[i] = (float)std::sin((i / (double)TABLE_SIZE) * M_PI * 2.);
+void TableExchange::publish() {
+    back = (unsigned)(middle.exchange(back | FRESH | (uint64_t)epoch << 32, std::memory_order_acq_rel) & SLOT_MASK);
 }
 
-void gen_sin_wave(Wavetable_t* table) {
-    for (int i = 0; i < TABLE_SIZE; i++) 
-        (*table)[i] = (float)std::sin((i / (double)TABLE_SIZE) * M_PI * 2.);
+const MipTable* TableExchange::acquire(uint32_t reached) {
+    uint64_t m = middle.load(std::memory_order_acquire);
+    // wrap-safe, epochs only ever count up
+    const bool held = (int32_t)((uint32_t)(m >> 32) - reached) > 0;
+    // if the gui publishes in between the exchange fails and the table is taken next block
+    if ((m & FRESH) && !held && middle.compare_exchange_strong(m, front, std::memory_order_acq_rel))
+        front = (unsigned)(m & SLOT_MASK);
+    return &slots[front];
 }
 
-void gen_saw_wave(Wavetable_t& table) {
-    for (int i = 0; i < TABLE_SIZE; i++) 
-        table[i] = 2 * ((i + TABLE_SIZE / 2) % TABLE_SIZE) / (float)TABLE_SIZE - 1.0f;
+void Wavetable_t::publish() {
+    build_mip_levels(table, shared.edit());
+    shared.publish();
 }
 
-void gen_saw_wave(Wavetable_t* table) {
-    for (int i = 0; i < TABLE_SIZE; i++) 
-        (*table)[i] = 2 * ((i + TABLE_SIZE / 2) % TABLE_SIZE) / (float)TABLE_SIZE - 1.0f;
+float Wavetable_t::interpolate_at(float idx) {
+    return interpolate(table, idx);
 }
 
-void gen_sqr_wave(Wavetable_t& table, float pw) {
-    for (int i = 0; i < (int)(TABLE_SIZE * pw); i++) 
-        table[i] = 1.0f; 
-    for (int i = (int)(TABLE_SIZE * pw); i < TABLE_SIZE; i++) 
-        table[i] = -1.0f; 
+float Wavetable_t::interpolate_left() {
+    return interpolate(table, ps.left_phase);
 }
 
-void gen_sqr_wave(Wavetable_t* table) {
-    for (int i = 0; i < (int)(TABLE_SIZE * table->ps.pulse_width); i++) 
-        (*table)[i] = 1.0f; 
-    for (int i = (int)(TABLE_SIZE * table->ps.pulse_width); i < TABLE_SIZE; i++) 
-        (*table)[i] = -1.0f; 
+float Wavetable_t::interpolate_right() {
+    return interpolate(table, ps.right_phase);
 }
 
-void gen_tri_wave(Wavetable_t& table, float pw) {
-    for (int i = 0; i < (int)(TABLE_SIZE * pw); i++) 
-        table[i] = 2.0*i / TABLE_SIZE * pw - 1;
-    for (int i = (int)(TABLE_SIZE * pw); i < TABLE_SIZE; i++) 
-        table[i] = -2.0*(i-TABLE_SIZE)/(TABLE_SIZE-pw*TABLE_SIZE);
+bool Wavetable_t::update_shape(int waveform, float pw) {
+    if (waveform == shape_waveform && pw == shape_pw)
+        return false;
+
+    generate_table(waveform, pw, table);
+    shape_waveform = waveform;
+    shape_pw = pw;
+    ++generation;
+
+    // saw and sine never change, so their levels are only ever built once
+    static std::unique_ptr<MipTable> fixed_shapes[2];
+    if (waveform == WAVE_SAW || waveform == WAVE_SINE) {
+        auto& cached = fixed_shapes[waveform];
+        if (!cached) {
+            cached = std::make_unique<MipTable>();
+            generate_levels(waveform, pw, *cached);
+        }
+        shared.edit() = *cached;
+    }
+    else {
+        generate_levels(waveform, pw, shared.edit());
+    }
+    shared.publish();
+    return true;
 }
 
-void gen_tri_wave(Wavetable_t* table, float pw) {
-    for (int i = 0; i < (int)(TABLE_SIZE * table->ps.pulse_width); i++)
-        (*table)[i] = 2.0 * i / (TABLE_SIZE * pw) - 1;
-    for (int i = (int)(TABLE_SIZE * table->ps.pulse_width); i < TABLE_SIZE; i++)
-        (*table)[i] = -2.0 * (i - TABLE_SIZE) / (TABLE_SIZE - pw * TABLE_SIZE) - 1;
+float LFO_t::interpolate_amp() {
+    return interpolate(table, ps.left_phase);
 }
 
 float clip(float amp) {
@@ -2,14 +2,29 @@
 #include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
-constexpr auto TABLE_SIZE = (872);
+// tables are a power of two long so a fixed point phase can index them with a shift
+constexpr auto TABLE_BITS = 10;
+constexpr auto TABLE_SIZE = (1 << TABLE_BITS);
+constexpr auto TABLE_MASK = TABLE_SIZE - 1;
+
+// 32-bit fixed point phase, the top TABLE_BITS bits are the table index
+// and the bits below them are the fraction between two entries
+constexpr auto PHASE_FRAC_BITS = 32 - TABLE_BITS;
+constexpr uint32_t PHASE_FRAC_MASK = (1u << PHASE_FRAC_BITS) - 1;
+constexpr float PHASE_FRAC_SCALE = 1.0f / (1u << PHASE_FRAC_BITS);
+
+// phase increments in the gui and in patches are still in steps of the original 872 entry table,
+// so an increment of 1 is 48000 / 872 ~ 55 Hz at 48 kHz whatever the table size is
+constexpr double PHASE_INC_UNIT = 1.0 / 872.0; // cycles per sample for an increment of 1
 #ifndef M_PI
 #define M_PI  (3.14159265)
 #endif
 
 struct OscSettings {
     std::atomic<float> amp { 0.33f };
+    // table positions for display, oscillator phases themselves belong to the audio thread
     std::atomic<float> left_phase { 0 };
     std::atomic<float> right_phase { 0 };
     std::atomic<float> left_phase_inc { 1 };
@@ -18,36 +33,99 @@ struct OscSettings {
     std::atomic<int> current_note_right { 1 };
     std::atomic<int> current_waveform { 2 };
     std::atomic<float> pulse_width { 0.5f };
+    std::atomic<int> interpolation { 1 }; // an Interp, linear
+    std::atomic<float> morph_position { 0 };
+};
+
+// linear interpolation into a single cycle, idx is a table position and wraps around
+inline float interpolate(const float* table, float idx) {
+    float wl, fl;
+    fl = std::modf(idx, &wl);
+    return std::lerp(table[(int)wl & TABLE_MASK], table[(int)(wl + 1) & TABLE_MASK], fl);
+}
+
+// gui phase increment to a fixed point increment per sample
+inline uint32_t phase_inc_to_fixed(float inc) {
+    return (uint32_t)(int64_t)std::llround(inc * PHASE_INC_UNIT * 4294967296.0);
+}
+
+// fixed point phase to a fractional table position, for display
+inline float phase_to_index(uint32_t phase) {
+    return phase * PHASE_FRAC_SCALE;
+}
+
+// band-limited copies of one waveform, one per octave, see bandlimit.h
+// level n keeps the first (TABLE_SIZE / 2) >> n harmonics, so level 0 is the table as drawn
+// and the last level is a pure sine. every level ends in a guard sample equal to its first
+constexpr auto MIP_LEVELS = TABLE_BITS;
+
+struct MipTable {
+    float level[MIP_LEVELS][TABLE_SIZE + 1];
+    // the width of the pulse the levels were generated for, 0 if they aren't a pulse.
+    // travels with the table so the audio thread can widen and narrow it per voice
+    float pulse_width;
+};
+
+// hands finished tables from the gui thread to the audio thread without either one waiting
+// three slots: the gui writes the back slot, the audio thread reads the front slot,
+// and the middle slot is swapped with a single atomic exchange from either side.
+// a slot only comes back to the gui once the audio thread has let go of it,
+// so a table is never rewritten while it is being read.
+// each table carries the epoch it was published in, and the audio thread leaves a table in the
+// middle until it has reached that epoch, which is how a preset's tables and its parameters
+// arrive in the same block (see SynthEngine::apply_preset)
+class TableExchange
+{
+private:
+    static constexpr uint64_t SLOT_MASK = 3;
+    static constexpr uint64_t FRESH = 4; // set on middle when it holds a table the audio thread hasn't taken yet
+    MipTable slots[3]{};
+    // slot index, FRESH and the epoch in the top half, so one load sees all three together
+    std::atomic<uint64_t> middle{ 1 };
+    unsigned back{ 2 };  // gui thread only
+    unsigned front{ 0 }; // audio thread only
+    uint32_t epoch{ 0 }; // gui thread only
+public:
+    // gui thread, the slot to build the next table in
+    MipTable& edit() { return slots[back]; }
+    // gui thread, tables published from now on are held back until the audio thread reaches epoch
+    void hold_until(uint32_t e) { epoch = e; }
+    // gui thread, makes the slot from edit() the newest table
+    void publish();
+    // audio thread, returns the newest published table unless it is from an epoch later than
+    // reached, in which case the one from the last call is kept. call once per block
+    const MipTable* acquire(uint32_t reached = 0);
 };
 
 struct Wavetable_t {
     OscSettings ps;
-    std::atomic<float> table[TABLE_SIZE]{ 0 };
-    std::atomic<float>& operator[](int i) { return table[i]; }
+    // gui-side copy as drawn, the generators write here and publish() hands
+    // band-limited versions of it to the audio thread
+    float table[TABLE_SIZE]{ 0 };
+    TableExchange shared;
+    // what the current table was generated from, so unchanged shapes aren't rebuilt
+    int shape_waveform{ -1 };
+    float shape_pw{ -1.0f };
+    // bumped every time table changes, so gui caches built from it know to rebuild
+    uint32_t generation{ 0 };
+
+    float& operator[](int i) { return table[i]; }
     float interpolate_at(float idx);
     float interpolate_left();
     float interpolate_right();
+    void publish();
+    // rebuilds and publishes the table, but only if the waveform or pulse width changed
+    bool update_shape(int waveform, float pw);
 };
 
 struct LFO_t : public Wavetable_t {
     float amps[90] { 0 };
     int amp_offset { 0 };
-    double refresh_time { 0.0 };
-    float lfo_amp { 0 };
-    bool lfo_enable { false };
+    std::atomic<float> lfo_amp { 0 };
+    std::atomic<bool> lfo_enable { false };
     float interpolate_amp();
 };
 
 
-void gen_sin_wave(Wavetable_t& table);
-void gen_sin_wave(Wavetable_t* table);
-void gen_saw_wave(Wavetable_t& table);
-void gen_saw_wave(Wavetable_t* table);
-void gen_sqr_wave(Wavetable_t& table, float pw);
-void gen_sqr_wave(Wavetable_t* table);
-void gen_tri_wave(Wavetable_t& table, float pw);
-void gen_tri_wave(Wavetable_t* table, float pw);
-
-
 float clip(float amp);
 float half_f_add_one(float amp);